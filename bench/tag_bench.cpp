@@ -0,0 +1,114 @@
+// Tag reading benchmark: readNativeTags against TagLib::FileRef over the MP3, FLAC
+// and Ogg files of a directory, reading what the library keeps of each file (text
+// tags, duration and stream properties).
+//
+//   tag_bench <directory>
+//
+// Real files are needed, tag layouts and padding vary too much to synthesise them.
+// Each reader runs once to warm the page cache, then the best of three runs is
+// reported. Files readNativeTags declines go to TagLib in the player, they are
+// counted but still timed.
+
+#include "Model/tag_reader.h"
+
+#include <taglib/fileref.h>
+#include <taglib/tag.h>
+
+#include <chrono>
+#include <cctype>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+static double bestOf(const std::function<size_t()> &run, size_t &read)
+{
+    read = run();
+    double best = 1e300;
+    for (int i = 0; i < 3; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        read = run();
+        best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "usage: %s <directory>\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<std::string> files;
+    std::error_code ec;
+    for (const auto &entry : fs::recursive_directory_iterator(argv[1], fs::directory_options::skip_permission_denied, ec))
+    {
+        std::string extension = entry.path().extension().u8string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        if (entry.is_regular_file() && (extension == ".mp3" || extension == ".flac" || extension == ".ogg"))
+            files.push_back(entry.path().u8string());
+    }
+    if (files.empty())
+    {
+        std::fprintf(stderr, "no MP3, FLAC or Ogg files under %s\n", argv[1]);
+        return 1;
+    }
+    std::printf("%zu files\n", files.size());
+
+    size_t read = 0;
+    double nativeMs = bestOf(
+        [&files]()
+        {
+            size_t count = 0;
+            for (const auto &file : files)
+            {
+                NativeTags tags;
+                if (readNativeTags(file, tags))
+                    ++count;
+            }
+            return count;
+        },
+        read);
+    std::printf("  readNativeTags    %8.1f ms  %10.0f files/s  %zu declined\n", nativeMs,
+                files.size() * 1000.0 / nativeMs, files.size() - read);
+
+    double tagLibMs = bestOf(
+        [&files]()
+        {
+            // Same fields as readTagLibMetadata, converted the same way
+            size_t count = 0;
+            for (const auto &file : files)
+            {
+                TagLib::FileRef ref(file.c_str());
+                if (ref.isNull())
+                    continue;
+                std::string text;
+                if (TagLib::Tag *tag = ref.tag())
+                {
+                    text = tag->title().to8Bit(true) + tag->artist().to8Bit(true) + tag->album().to8Bit(true) +
+                           tag->comment().to8Bit(true) + tag->genre().to8Bit(true) + std::to_string(tag->year()) +
+                           std::to_string(tag->track());
+                }
+                if (TagLib::AudioProperties *props = ref.audioProperties())
+                {
+                    text += std::to_string(props->lengthInSeconds() + props->bitrate() + props->channels() +
+                                           props->sampleRate());
+                }
+                ++count;
+            }
+            return count;
+        },
+        read);
+    std::printf("  TagLib::FileRef   %8.1f ms  %10.0f files/s  %zu unreadable\n", tagLibMs,
+                files.size() * 1000.0 / tagLibMs, files.size() - read);
+
+    std::printf("  native is %.1fx TagLib\n", tagLibMs / nativeMs);
+    return 0;
+}
@@ -40,6 +40,15 @@ bool ApplicationController::initialize(MediaListInterface *mlView, PlayerInterfa
         // Load saved playlists
         playlistController->loadAllPlaylists();
 
+        // Tags parsed in earlier sessions
+        metadataController->restoreMetadataCache();
+        // Tags of listed files are changed under the library lock
+        metadataController->setMediaLibrary(mediaListController->getMediaLibrary());
+
+        // Restore the last scanned library from its index
+        mediaListController->restoreLibrary();
+        mediaListController->startDeviceMonitor();
+
         // Callback init
         playlistController->setOnPlaylistSelectedCallback(
             [this](std::shared_ptr<PlaylistModel> playlist)
@@ -62,10 +71,27 @@ bool ApplicationController::initialize(MediaListInterface *mlView, PlayerInterfa
         mediaListController->setOnMediaPlayCallback(
             [this](const std::vector<std::shared_ptr<MediaFileModel>> &playlist, int index)
             {
-                metadataController->preloadMetadata(playlist);
-                metadataController->loadMetadata(playlist[index]); // must load first
+                metadataController->preloadMetadata(playlist, index + 1);
+                metadataController->loadMetadata(playlist[index]); // read ahead of the rest
                 playerController->playPlaylist(playlist, index);
             });
+        mediaListController->setOnViewportChangedCallback(
+            [this](const std::vector<std::shared_ptr<MediaFileModel>> &visible,
+                   const std::vector<std::shared_ptr<MediaFileModel>> &prefetch)
+            {
+                metadataController->loadViewport(visible, prefetch);
+            });
+        metadataController->setOnMetadataLoadedCallback(
+            [this](std::shared_ptr<MediaFileModel> media)
+            {
+                mediaListController->refreshMediaTags(media);
+                playerController->refreshMediaInfo(media);
+            });
+        metadataController->setOnFileWrittenCallback(
+            [this](std::shared_ptr<MediaFileModel> media, uint64_t size, int64_t mtime)
+            {
+                mediaListController->refreshFileStat(media, size, mtime);
+            });
         mediaListController->setOnOtherPlaylistCallback(
             [this](const std::string &name)
             {
@@ -103,6 +129,7 @@ void ApplicationController::run()
     {
         // Let view manager handle events and rendering
         viewManager->handleEvents();
+        viewManager->update();
 
         // Check if application should exit
         if (viewManager->shouldExit())
@@ -127,6 +154,8 @@ void ApplicationController::exit()
 
     // Save data
     playlistController->saveAllPlaylists();
+    mediaListController->saveLibrary();
+    metadataController->saveMetadataCache();
 
     // Additional cleanup if needed
 }
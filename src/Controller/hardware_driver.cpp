@@ -411,12 +411,243 @@ bool USBPortDriver::isMountPoint(std::filesystem::path &path)
     return S_ISDIR(buf.st_mode);
 }
 
+#ifdef __linux__
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+    struct MountEntry
+    {
+        std::string device; // "major:minor"
+        std::string mountPoint;
+    };
+
+    // mountinfo escapes space, tab, newline and backslash as \ooo
+    std::string unescapeMountPath(const std::string &path)
+    {
+        std::string result;
+        result.reserve(path.size());
+        for (size_t i = 0; i < path.size(); ++i)
+        {
+            if (path[i] == '\\' && i + 3 < path.size() &&
+                path[i + 1] >= '0' && path[i + 1] <= '7' &&
+                path[i + 2] >= '0' && path[i + 2] <= '7' &&
+                path[i + 3] >= '0' && path[i + 3] <= '7')
+            {
+                result += static_cast<char>((path[i + 1] - '0') * 64 + (path[i + 2] - '0') * 8 + (path[i + 3] - '0'));
+                i += 3;
+            }
+            else
+            {
+                result += path[i];
+            }
+        }
+        return result;
+    }
+
+    std::vector<MountEntry> readMountTable(int fd)
+    {
+        std::string content;
+        char buffer[16 * 1024];
+        lseek(fd, 0, SEEK_SET);
+        ssize_t nread;
+        while ((nread = read(fd, buffer, sizeof(buffer))) > 0)
+            content.append(buffer, static_cast<size_t>(nread));
+
+        // Fields: mount ID, parent ID, major:minor, root, mount point, ...
+        std::vector<MountEntry> entries;
+        std::istringstream lines(content);
+        std::string line;
+        while (std::getline(lines, line))
+        {
+            std::istringstream fields(line);
+            std::string mountId, parentId, device, root, mountPoint;
+            if (fields >> mountId >> parentId >> device >> root >> mountPoint)
+                entries.push_back({device, unescapeMountPath(mountPoint)});
+        }
+        return entries;
+    }
+
+    // USB sticks and card readers; USB disks often do not set the removable flag
+    bool isRemovableDevice(const std::string &device)
+    {
+        // Major 0 is used by virtual filesystems (proc, tmpfs, overlay, ...)
+        if (device.compare(0, 2, "0:") == 0)
+            return false;
+
+        std::error_code ec;
+        fs::path sysPath = fs::canonical("/sys/dev/block/" + device, ec);
+        if (ec)
+            return false;
+        if (sysPath.string().find("/usb") != std::string::npos)
+            return true;
+
+        // A partition has the flag on its parent disk
+        for (const fs::path &dir : {sysPath, sysPath.parent_path()})
+        {
+            std::ifstream removable(dir / "removable");
+            char flag;
+            if (removable >> flag)
+                return flag == '1';
+        }
+        return false;
+    }
+}
+
+USBPortDriver::USBPortDriver() : running(false), mountInfoFd(-1)
+{
+}
+
+USBPortDriver::~USBPortDriver()
+{
+    stopMonitor();
+}
+
+bool USBPortDriver::startMonitor(MountChangeCallback callback)
+{
+    stopMonitor();
+
+    mountInfoFd = open("/proc/self/mountinfo", O_RDONLY | O_CLOEXEC);
+    if (mountInfoFd < 0)
+    {
+        std::cerr << "Failed to open /proc/self/mountinfo" << std::endl;
+        return false;
+    }
+
+    onMountChange = callback;
+    removableMounts.clear();
+
+    running = true;
+    monitorThread = std::thread(&USBPortDriver::monitorFunc, this);
+    return true;
+}
+
+void USBPortDriver::stopMonitor()
+{
+    if (running)
+    {
+        running = false;
+        if (monitorThread.joinable())
+        {
+            monitorThread.join();
+        }
+    }
+
+    if (mountInfoFd >= 0)
+    {
+        close(mountInfoFd);
+        mountInfoFd = -1;
+    }
+}
+
+void USBPortDriver::updateMounts()
+{
+    std::map<std::string, std::string> current;
+    for (const auto &entry : readMountTable(mountInfoFd))
+    {
+        // Only query sysfs for mounts that were not seen before
+        auto known = removableMounts.find(entry.mountPoint);
+        if ((known != removableMounts.end() && known->second == entry.device) || isRemovableDevice(entry.device))
+            current[entry.mountPoint] = entry.device;
+    }
+
+    std::vector<std::pair<std::string, bool>> changes;
+    for (const auto &[mountPoint, device] : removableMounts)
+    {
+        auto it = current.find(mountPoint);
+        if (it == current.end() || it->second != device)
+            changes.emplace_back(mountPoint, false);
+    }
+    for (const auto &[mountPoint, device] : current)
+    {
+        auto it = removableMounts.find(mountPoint);
+        if (it == removableMounts.end() || it->second != device)
+            changes.emplace_back(mountPoint, true);
+    }
+    removableMounts.swap(current);
+
+    {
+        std::lock_guard<std::mutex> lock(devicesMutex);
+        mountedDevices.clear();
+        for (const auto &[mountPoint, device] : removableMounts)
+            mountedDevices.push_back(mountPoint);
+    }
+
+    for (const auto &[mountPoint, mounted] : changes)
+    {
+        if (onMountChange)
+            onMountChange(mountPoint, mounted);
+    }
+}
+
+void USBPortDriver::monitorFunc()
+{
+    // Devices mounted before the monitor started
+    updateMounts();
+
+    while (running)
+    {
+        // The kernel flags POLLPRI (and POLLERR) on mountinfo whenever the mount table changes
+        struct pollfd pfd = {mountInfoFd, POLLPRI, 0};
+        int ret = poll(&pfd, 1, 100);
+        if (ret > 0 && (pfd.revents & (POLLPRI | POLLERR)))
+            updateMounts();
+    }
+}
+
 std::vector<std::filesystem::path> USBPortDriver::detectUSBDevices()
 {
     std::vector<std::filesystem::path> devices;
 
-    // In a real implementation, this would use Linux-specific APIs to detect USB devices
-    // For simplicity, we'll check common USB mount points
+    int fd = open("/proc/self/mountinfo", O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return devices;
+    for (const auto &entry : readMountTable(fd))
+    {
+        if (isRemovableDevice(entry.device))
+            devices.push_back(entry.mountPoint);
+    }
+    close(fd);
+
+    return devices;
+}
+
+#else
+
+USBPortDriver::USBPortDriver() : running(false), mountInfoFd(-1)
+{
+}
+
+USBPortDriver::~USBPortDriver()
+{
+    stopMonitor();
+}
+
+bool USBPortDriver::startMonitor(MountChangeCallback callback)
+{
+    // Mount monitoring is only implemented with /proc/self/mountinfo
+    onMountChange = callback;
+    return false;
+}
+
+void USBPortDriver::stopMonitor()
+{
+    running = false;
+}
+
+void USBPortDriver::updateMounts() {}
+void USBPortDriver::monitorFunc() {}
+
+std::vector<std::filesystem::path> USBPortDriver::detectUSBDevices()
+{
+    std::vector<std::filesystem::path> devices;
+
+    // Without a mount table, check common USB mount points
     const std::vector<std::string> commonMountPoints = {
         "/media", "/mnt", "/run/media"};
 
@@ -444,10 +675,13 @@ std::vector<std::filesystem::path> USBPortDriver::detectUSBDevices()
     return devices;
 }
 
+#endif
+
 bool USBPortDriver::mountDevice(std::filesystem::path &device)
 {
     // In a real implementation, this would use Linux-specific APIs to mount devices
     // For simplicity we'll assume the device is already mounted
+    std::lock_guard<std::mutex> lock(devicesMutex);
     if (std::find(mountedDevices.begin(), mountedDevices.end(), device) == mountedDevices.end())
     {
         mountedDevices.push_back(device);
@@ -459,6 +693,7 @@ bool USBPortDriver::mountDevice(std::filesystem::path &device)
 bool USBPortDriver::unmountDevice(std::filesystem::path &device)
 {
     // In a real implementation, this would use Linux-specific APIs to unmount devices
+    std::lock_guard<std::mutex> lock(devicesMutex);
     auto it = std::find(mountedDevices.begin(), mountedDevices.end(), device);
     if (it != mountedDevices.end())
     {
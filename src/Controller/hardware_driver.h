@@ -8,6 +8,9 @@
 #include <atomic>
 #include <condition_variable>
 #include <functional>
+#include <filesystem>
+#include <string>
+#include <map>
 
 
 class SerialPortReaderImpl;
@@ -67,15 +70,38 @@ private:
     void detectFunc();
 };
 
-// Controller for USB device operations
+// Controller for USB device operations. The mount monitor waits for changes of
+// /proc/self/mountinfo and reports removable block devices being mounted or unmounted.
 class USBPortDriver
 {
 private:
     std::vector<std::filesystem::path> mountedDevices;
+    std::mutex devicesMutex;
+
+    std::atomic<bool> running;
+    std::thread monitorThread;
+    int mountInfoFd;
+
+    // Mount point -> "major:minor" of the removable devices currently mounted
+    std::map<std::string, std::string> removableMounts;
+
+    // Callback function type for mount events: mount point, true when mounted
+    using MountChangeCallback = std::function<void(const std::filesystem::path &, bool)>;
+    MountChangeCallback onMountChange;
 
     bool isMountPoint(std::filesystem::path &path);
+    void updateMounts();
+    void monitorFunc();
 
 public:
+    USBPortDriver();
+    ~USBPortDriver();
+
+    // Start watching the mount table. Removable devices that are already mounted
+    // are reported first; the callback runs on the monitor thread.
+    bool startMonitor(MountChangeCallback callback);
+    void stopMonitor();
+
     // std::vector<std::string> detectUSBDevices()
     // {
     //     std::vector<std::string> devices;
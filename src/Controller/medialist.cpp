@@ -1,11 +1,31 @@
 #include "medialist.h"
 
+#include <iostream>
+#include <algorithm>
+
+const std::string libraryIndexFilePath = "data/library/index.bin";
 
 // MediaListController
 MediaListController::MediaListController(
-    MediaListInterface *mlI) : mediaListView(mlI)
+    MediaListInterface *mlI) : mediaListView(mlI), libraryChanged(false), scanRunning(false), scanFinished(false),
+                               scanCompleted(false), browseLevel(BrowseLevel::OFF), browseFacet(Facet::ARTIST),
+                               browseStale(false)
 {
     mediaLibrary = std::make_unique<MediaLibrary>();
+    // USB drives often carry media with wrong or missing extensions
+    mediaLibrary->setContentSniffing(true);
+    libraryWatcher = std::make_unique<LibraryWatcher>(mediaLibrary.get());
+    usbDriver = std::make_unique<USBPortDriver>();
+    searchSession = std::make_unique<SearchSession>(mediaLibrary.get());
+}
+
+MediaListController::~MediaListController()
+{
+    // Device scans and watcher rescans stop early, so their threads join quickly
+    mediaLibrary->cancelScan();
+    usbDriver->stopMonitor();
+    libraryWatcher->stop();
+    mediaLibrary->cancelScan();
 }
 
 void MediaListController::setMediaListView(MediaListInterface *view)
@@ -17,11 +37,18 @@ std::shared_ptr<PlaylistModel> MediaListController::getCurrentPlaylist() const
     return currentPlaylist;
 }
 
+MediaLibrary *MediaListController::getMediaLibrary() const
+{
+    return mediaLibrary.get();
+}
+
 void MediaListController::loadPlaylist(std::shared_ptr<PlaylistModel> playlist)
 {
     std::lock_guard<std::mutex> lock(mediaListMutex);
     currentPlaylist = playlist;
     currentDirectory.clear();
+    browseLevel = BrowseLevel::OFF;
+    cancelSearch();
     updatePlaylistView();
 }
 
@@ -85,16 +112,420 @@ void MediaListController::updatePlaylistView()
     }
 }
 
-void MediaListController::scanDirectoryForMedia(std::filesystem::path &path)
+std::vector<std::string> MediaListController::getLibraryFilenames() const
 {
-    mediaLibrary->scanDirectory(path);
-    currentDirectory = path;
     std::vector<std::string> mediaFilesName;
     for (auto media : mediaLibrary->getMediaFiles())
     {
         mediaFilesName.push_back(media->getFilename());
     }
-    mediaListView->setCurrentPlaylist(path.u8string(), mediaFilesName);
+    return mediaFilesName;
+}
+
+void MediaListController::scanDirectoryForMedia(std::filesystem::path &path)
+{
+    // A new scan replaces the running one; once cancelled it delivers no more chunks
+    mediaLibrary->cancelBackgroundScan();
+
+    // The library is rebuilt from scratch, stop applying folder events to it
+    libraryWatcher->stop();
+
+    currentDirectory = path;
+    scanRoot = path;
+    browseLevel = BrowseLevel::OFF;
+    cancelSearch();
+    {
+        std::lock_guard<std::mutex> lock(scanResultMutex);
+        pendingScanFiles.clear();
+    }
+    mediaListView->setCurrentPlaylist(path.u8string(), {});
+
+    scanRunning = true;
+    scanFinished = false;
+    scanJob = mediaLibrary->startScan(
+        path,
+        [this](const std::vector<std::shared_ptr<MediaFileModel>> &found)
+        {
+            std::lock_guard<std::mutex> lock(scanResultMutex);
+            for (const auto &media : found)
+            {
+                pendingScanFiles.push_back(media->getFilename());
+            }
+        },
+        [this](bool completed)
+        {
+            scanCompleted = completed;
+            scanFinished = true;
+        });
+}
+
+void MediaListController::cancelScan()
+{
+    // The finished callback has run once this returns, pollLibraryChanges cleans up
+    mediaLibrary->cancelBackgroundScan();
+}
+
+bool MediaListController::isScanning() const
+{
+    return scanRunning;
+}
+
+std::shared_ptr<ScanJob> MediaListController::getScanJob() const
+{
+    return scanJob;
+}
+
+void MediaListController::finishScan()
+{
+    scanRunning = false;
+    scanJob.reset();
+
+    if (!scanCompleted)
+    {
+        // Cancelled: the library is back to its previous content and root
+        currentDirectory = mediaLibrary->getRootDirectory();
+        browseLevel = BrowseLevel::OFF;
+        if (mediaListView)
+        {
+            mediaListView->setCurrentPlaylist(currentDirectory.u8string(), getLibraryFilenames());
+        }
+        if (!currentDirectory.empty())
+        {
+            watchDirectory(currentDirectory);
+        }
+        return;
+    }
+
+    // The library is now sorted by path, show it in its final order
+    if (currentDirectory == scanRoot)
+    {
+        refreshLibraryView();
+    }
+
+    saveLibrary();
+    watchDirectory(scanRoot);
+    mediaLibrary->detectDuplicates([this]()
+                                   { libraryChanged = true; });
+}
+
+bool MediaListController::restoreLibrary()
+{
+    if (!mediaLibrary->loadIndex(libraryIndexFilePath))
+        return false;
+
+    currentDirectory = mediaLibrary->getRootDirectory();
+    browseLevel = BrowseLevel::OFF;
+    cancelSearch();
+    if (currentDirectory.empty())
+        return false;
+
+    mediaListView->setCurrentPlaylist(currentDirectory.u8string(), getLibraryFilenames());
+    watchDirectory(currentDirectory);
+    mediaLibrary->detectDuplicates([this]()
+                                   { libraryChanged = true; });
+    return true;
+}
+
+void MediaListController::refreshMediaTags(std::shared_ptr<MediaFileModel> file)
+{
+    mediaLibrary->updateFileIndexes(file);
+    if (browseLevel != BrowseLevel::OFF)
+        browseStale = true;
+}
+
+void MediaListController::refreshLibraryView()
+{
+    if (!mediaListView)
+        return;
+    if (browseLevel != BrowseLevel::OFF)
+        showBrowseList(true);
+    else
+        mediaListView->refreshMediaFiles(getLibraryFilenames());
+}
+
+std::string MediaListController::browseTitle(const std::string &title) const
+{
+    // Facets and queries miss the files whose tags are still unread
+    size_t tagged, total;
+    mediaLibrary->getTagCoverage(tagged, total);
+    if (tagged == total)
+        return title;
+    return title + " (" + std::to_string(tagged) + " of " + std::to_string(total) + " tagged)";
+}
+
+void MediaListController::showBrowseList(bool keepPage)
+{
+    browseStale = false;
+    if (browseLevel == BrowseLevel::SEARCH)
+    {
+        // Searched again in the background, listed by pollLibraryChanges when done
+        searchSession->update(searchKeyword);
+        return;
+    }
+    if (!mediaListView)
+        return;
+    if (browseLevel == BrowseLevel::QUERY)
+    {
+        // Run again, the tags or the files may have changed
+        mediaLibrary->queryMedia(queryText, queryResult);
+        mediaListView->showBrowseList(browseTitle(queryText), queryResult.rows.size(), keepPage);
+    }
+    else if (browseLevel == BrowseLevel::VALUES)
+        mediaListView->showBrowseList(browseTitle(facetTitle(browseFacet)), mediaLibrary->getFacetValueCount(browseFacet),
+                                      keepPage);
+    else if (browseLevel == BrowseLevel::DUPLICATES || browseLevel == BrowseLevel::COPIES)
+    {
+        duplicateGroups = mediaLibrary->getDuplicateGroups();
+        if (browseLevel == BrowseLevel::COPIES)
+        {
+            // Follow the opened group into the new result, back to the groups once it is gone
+            auto it = std::find_if(duplicateGroups.begin(), duplicateGroups.end(),
+                                   [this](const DuplicateDetector::Group &group)
+                                   {
+                                       return std::find(group.begin(), group.end(), duplicateCopies.front()) != group.end();
+                                   });
+            if (it != duplicateGroups.end())
+            {
+                duplicateCopies = *it;
+                mediaListView->showBrowseList(duplicateCopies.front()->getFilename(), duplicateCopies.size(), keepPage);
+                return;
+            }
+            browseLevel = BrowseLevel::DUPLICATES;
+            keepPage = false;
+        }
+        mediaListView->showBrowseList("Duplicates", duplicateGroups.size(), keepPage);
+    }
+    else
+        mediaListView->showBrowseList(browseTitle(browseValue), mediaLibrary->getFacetFileCount(browseFacet, browseValue),
+                                      keepPage);
+}
+
+void MediaListController::nextBrowseMode()
+{
+    // Only the library can be browsed, not a playlist
+    if (currentDirectory.empty())
+        return;
+
+    cancelSearch();
+    if (browseLevel == BrowseLevel::DUPLICATES || browseLevel == BrowseLevel::COPIES)
+    {
+        browseLevel = BrowseLevel::OFF;
+        if (mediaListView)
+            mediaListView->setCurrentPlaylist(currentDirectory.u8string(), getLibraryFilenames());
+        return;
+    }
+    if (browseLevel == BrowseLevel::OFF || browseLevel == BrowseLevel::QUERY || browseLevel == BrowseLevel::SEARCH)
+    {
+        browseFacet = Facet::ARTIST;
+    }
+    else
+    {
+        browseFacet = static_cast<Facet>(static_cast<int>(browseFacet) + 1);
+        if (browseFacet == Facet::COUNT)
+        {
+            browseLevel = BrowseLevel::DUPLICATES;
+            showBrowseList(false);
+            return;
+        }
+    }
+    browseLevel = BrowseLevel::VALUES;
+    showBrowseList(false);
+}
+
+void MediaListController::browseBack()
+{
+    cancelSearch();
+    if (browseLevel == BrowseLevel::FILES)
+    {
+        browseLevel = BrowseLevel::VALUES;
+        showBrowseList(false);
+    }
+    else if (browseLevel == BrowseLevel::COPIES)
+    {
+        browseLevel = BrowseLevel::DUPLICATES;
+        showBrowseList(false);
+    }
+    else if (browseLevel != BrowseLevel::OFF)
+    {
+        browseLevel = BrowseLevel::OFF;
+        if (mediaListView)
+            mediaListView->setCurrentPlaylist(currentDirectory.u8string(), getLibraryFilenames());
+    }
+}
+
+void MediaListController::runQuery(const std::string &query)
+{
+    // Queries run over the library, not a playlist
+    if (currentDirectory.empty())
+        return;
+
+    if (query.find_first_not_of(" \t") == std::string::npos)
+    {
+        if (browseLevel == BrowseLevel::QUERY)
+            browseBack();
+        return;
+    }
+
+    QueryResult result;
+    if (!mediaLibrary->queryMedia(query, result))
+        return;
+
+    cancelSearch();
+    queryText = query;
+    browseLevel = BrowseLevel::QUERY;
+    showBrowseList(false);
+}
+
+void MediaListController::searchAsYouType(const std::string &keyword)
+{
+    // Only the library is searched, not a playlist
+    if (currentDirectory.empty())
+        return;
+
+    if (keyword.empty())
+    {
+        if (browseLevel == BrowseLevel::SEARCH)
+            browseBack();
+        else
+            cancelSearch();
+        return;
+    }
+
+    searchKeyword = keyword;
+    searchSession->update(keyword);
+}
+
+void MediaListController::cancelSearch()
+{
+    // A result still on its way is never delivered
+    searchSession->cancel();
+    searchKeyword.clear();
+}
+
+void MediaListController::refreshFileStat(std::shared_ptr<MediaFileModel> file, uint64_t size, int64_t mtime)
+{
+    mediaLibrary->updateFileStat(file, size, mtime);
+}
+
+std::vector<std::string> MediaListController::getBrowseRows(int first, int count) const
+{
+    std::vector<std::string> rows;
+    if (first < 0 || count <= 0)
+        return rows;
+
+    if (browseLevel == BrowseLevel::VALUES)
+    {
+        for (const auto &[value, files] : mediaLibrary->getFacetValues(browseFacet, first, count))
+            rows.push_back(value + " (" + std::to_string(files) + ")");
+    }
+    else if (browseLevel == BrowseLevel::DUPLICATES)
+    {
+        for (int i = first; i < first + count && i < static_cast<int>(duplicateGroups.size()); ++i)
+        {
+            const auto &group = duplicateGroups[i];
+            rows.push_back(group.front()->getFilename() + " (" + std::to_string(group.size()) + " copies)");
+        }
+    }
+    else if (browseLevel == BrowseLevel::COPIES)
+    {
+        // The copies usually share a filename, their folders tell them apart
+        for (const auto &media : getListedFiles(first, count))
+            rows.push_back(media->getFilepath());
+    }
+    else if (browseLevel != BrowseLevel::OFF)
+    {
+        for (const auto &media : getListedFiles(first, count))
+            rows.push_back(media->getFilename());
+    }
+    return rows;
+}
+
+void MediaListController::saveLibrary()
+{
+    if (!mediaLibrary->saveIndex(libraryIndexFilePath))
+    {
+        std::cerr << "Failed to save library index" << std::endl;
+    }
+}
+
+void MediaListController::startDeviceMonitor()
+{
+    usbDriver->startMonitor(
+        [this](const std::filesystem::path &mountPoint, bool mounted)
+        {
+            std::filesystem::path dir = mountPoint;
+            if (mounted)
+            {
+                mediaLibrary->scanUSBDevice(dir);
+                libraryChanged = true;
+            }
+            else if (mediaLibrary->removeUSBDevice(dir))
+            {
+                libraryChanged = true;
+            }
+        });
+}
+
+void MediaListController::watchDirectory(const std::filesystem::path &dir)
+{
+    libraryWatcher->start(dir,
+                          [this]()
+                          {
+                              libraryChanged = true;
+                          });
+}
+
+void MediaListController::pollLibraryChanges()
+{
+    SearchSession::Result found;
+    if (searchSession->takeResult(found))
+    {
+        // A refresh of the listed keyword stays on its page, a new keyword starts at the top
+        bool keepPage = browseLevel == BrowseLevel::SEARCH && found.keyword == searchResult.keyword;
+        searchResult = std::move(found);
+        browseLevel = BrowseLevel::SEARCH;
+        browseStale = false;
+        if (mediaListView)
+            mediaListView->showBrowseList("\"" + searchResult.keyword + "\"", searchResult.files.size(), keepPage);
+    }
+
+    if (scanRunning)
+    {
+        std::vector<std::string> found;
+        {
+            std::lock_guard<std::mutex> lock(scanResultMutex);
+            found.swap(pendingScanFiles);
+        }
+        if (!found.empty() && mediaListView && currentDirectory == scanRoot)
+        {
+            // A browse list is redrawn below, its counts changed
+            if (browseLevel == BrowseLevel::OFF)
+                mediaListView->appendMediaFiles(found);
+            else
+                browseStale = true;
+        }
+        if (browseStale)
+            showBrowseList(true);
+
+        if (scanFinished)
+        {
+            finishScan();
+        }
+        return;
+    }
+
+    if (!libraryChanged.exchange(false))
+    {
+        if (browseStale)
+            showBrowseList(true);
+        return;
+    }
+
+    // Only the library listing follows the folder, not a loaded playlist
+    if (!currentDirectory.empty())
+    {
+        refreshLibraryView();
+    }
 }
 
 void MediaListController::setOnMediaSelectedCallback(std::function<void(std::shared_ptr<MediaFileModel>)> callback)
@@ -112,8 +543,76 @@ void MediaListController::setOnOtherPlaylistCallback(std::function<std::shared_p
     onOtherPlaylistCallback = callback;
 }
 
+void MediaListController::setOnViewportChangedCallback(
+    std::function<void(const std::vector<std::shared_ptr<MediaFileModel>> &,
+                       const std::vector<std::shared_ptr<MediaFileModel>> &)> callback)
+{
+    onViewportChangedCallback = callback;
+}
+
+std::vector<std::shared_ptr<MediaFileModel>> MediaListController::getListedFiles(int first, int count) const
+{
+    if (first < 0)
+    {
+        count += first;
+        first = 0;
+    }
+    if (count <= 0)
+        return {};
+
+    if (browseLevel == BrowseLevel::FILES)
+        return mediaLibrary->getFacetFiles(browseFacet, browseValue, first, count);
+    if (browseLevel == BrowseLevel::QUERY)
+        return mediaLibrary->getQueryFiles(queryResult, first, count);
+    if (browseLevel == BrowseLevel::SEARCH || browseLevel == BrowseLevel::COPIES)
+    {
+        const auto &files = browseLevel == BrowseLevel::SEARCH ? searchResult.files : duplicateCopies;
+        if (first >= static_cast<int>(files.size()))
+            return {};
+        return std::vector<std::shared_ptr<MediaFileModel>>(
+            files.begin() + first, files.begin() + std::min<size_t>(files.size(), first + count));
+    }
+    if (browseLevel == BrowseLevel::VALUES || browseLevel == BrowseLevel::DUPLICATES)
+        return {};
+    if (!currentDirectory.empty())
+        return mediaLibrary->getMediaFiles(first, count);
+
+    std::vector<std::shared_ptr<MediaFileModel>> files;
+    if (currentPlaylist)
+    {
+        for (int i = first; i < first + count && i < static_cast<int>(currentPlaylist->size()); ++i)
+            files.push_back(currentPlaylist->getMediaFile(i));
+    }
+    return files;
+}
+
+void MediaListController::setViewport(int first, int count)
+{
+    if (!onViewportChangedCallback)
+        return;
+
+    // One page either side is read ahead so paging feels instant
+    std::vector<std::shared_ptr<MediaFileModel>> visible = getListedFiles(first, count);
+    std::vector<std::shared_ptr<MediaFileModel>> prefetch = getListedFiles(first + count, count);
+    std::vector<std::shared_ptr<MediaFileModel>> previous = getListedFiles(first - count, count);
+    prefetch.insert(prefetch.end(), previous.begin(), previous.end());
+
+    onViewportChangedCallback(visible, prefetch);
+}
+
 void MediaListController::handleMediaSelected(int index)
 {
+    if (browseLevel == BrowseLevel::FILES || browseLevel == BrowseLevel::QUERY || browseLevel == BrowseLevel::SEARCH ||
+        browseLevel == BrowseLevel::COPIES)
+    {
+        auto files = getListedFiles(index, 1);
+        if (!files.empty() && onMediaSelectedCallback)
+            onMediaSelectedCallback(files.front());
+        return;
+    }
+    if (browseLevel == BrowseLevel::VALUES || browseLevel == BrowseLevel::DUPLICATES)
+        return;
+
     if (currentMediaIndex != index)
     {
         if (onMediaSelectedCallback)
@@ -127,6 +626,63 @@ void MediaListController::handleMediaSelected(int index)
 
 void MediaListController::handleMediaPlay(int index)
 {
+    if (browseLevel == BrowseLevel::VALUES)
+    {
+        auto values = mediaLibrary->getFacetValues(browseFacet, index, 1);
+        if (!values.empty())
+        {
+            browseValue = values.front().first;
+            browseLevel = BrowseLevel::FILES;
+            showBrowseList(false);
+        }
+        return;
+    }
+    if (browseLevel == BrowseLevel::FILES)
+    {
+        // The value's files become the play queue, not the whole library
+        if (onMediaPlayCallback)
+        {
+            auto files = mediaLibrary->getFacetFiles(browseFacet, browseValue, 0,
+                                                     mediaLibrary->getFacetFileCount(browseFacet, browseValue));
+            if (index >= 0 && index < static_cast<int>(files.size()))
+                onMediaPlayCallback(files, index);
+        }
+        return;
+    }
+    if (browseLevel == BrowseLevel::QUERY)
+    {
+        // Likewise the query's matches
+        if (onMediaPlayCallback)
+        {
+            auto files = mediaLibrary->getQueryFiles(queryResult, 0, queryResult.rows.size());
+            if (index >= 0 && index < static_cast<int>(files.size()))
+                onMediaPlayCallback(files, index);
+        }
+        return;
+    }
+    if (browseLevel == BrowseLevel::SEARCH)
+    {
+        if (onMediaPlayCallback && index >= 0 && index < static_cast<int>(searchResult.files.size()))
+            onMediaPlayCallback(searchResult.files, index);
+        return;
+    }
+    if (browseLevel == BrowseLevel::DUPLICATES)
+    {
+        if (index >= 0 && index < static_cast<int>(duplicateGroups.size()))
+        {
+            duplicateCopies = duplicateGroups[index];
+            browseLevel = BrowseLevel::COPIES;
+            showBrowseList(false);
+        }
+        return;
+    }
+    if (browseLevel == BrowseLevel::COPIES)
+    {
+        if (onMediaPlayCallback && index >= 0 && index < static_cast<int>(duplicateCopies.size()))
+            onMediaPlayCallback(duplicateCopies, index);
+        return;
+    }
+
     if (currentMediaIndex != index)
     {
         if (onMediaPlayCallback)
@@ -4,12 +4,18 @@
 #include "View/Interface/Iview.h"
 #include "Model/playlist.h"
 #include "Model/manager.h"
+#include "Model/search_session.h"
+#include "watcher.h"
+#include "hardware_driver.h"
 
 class MediaListController
 {
 private:
     // Model references
     std::unique_ptr<class MediaLibrary> mediaLibrary;
+    std::unique_ptr<class LibraryWatcher> libraryWatcher;
+    std::unique_ptr<class USBPortDriver> usbDriver;
+    std::unique_ptr<class SearchSession> searchSession;
 
     // Current state
     std::filesystem::path currentDirectory;
@@ -22,13 +28,66 @@ private:
     // Mutex for thread safety
     std::mutex mediaListMutex;
 
+    // Set by the watcher thread, consumed on the UI thread
+    std::atomic<bool> libraryChanged;
+
+    // Background streaming scan, results are handed to the UI thread in chunks
+    std::shared_ptr<class ScanJob> scanJob;
+    std::filesystem::path scanRoot;
+    std::atomic<bool> scanRunning;
+    std::atomic<bool> scanFinished;
+    std::atomic<bool> scanCompleted;
+    std::mutex scanResultMutex;
+    std::vector<std::string> pendingScanFiles;
+
+    // Faceted browsing of the library: the values of browseFacet, or the files
+    // listed under browseValue. Pages are read from the facet indexes on demand.
+    // The rows matched by a structured query or a search are browsed the same way,
+    // as are the groups of duplicate files and the copies of one group.
+    enum class BrowseLevel
+    {
+        OFF,
+        VALUES,
+        FILES,
+        QUERY,
+        SEARCH,
+        DUPLICATES,
+        COPIES
+    };
+    BrowseLevel browseLevel;
+    Facet browseFacet;
+    std::string browseValue;
+    std::string queryText;
+    QueryResult queryResult;
+    std::string searchKeyword;          // last keyword typed, empty when not searching
+    SearchSession::Result searchResult; // the result listed
+    std::vector<DuplicateDetector::Group> duplicateGroups; // as last listed
+    DuplicateDetector::Group duplicateCopies;              // the group opened
+    bool browseStale; // tags changed since the browse page was shown
+
+    void watchDirectory(const std::filesystem::path &dir);
+    void finishScan();
+    std::vector<std::string> getLibraryFilenames() const;
+    // Show the library listing, as a browse list while browsing
+    void refreshLibraryView();
+    void showBrowseList(bool keepPage);
+    // Title with how many files are tagged, while some tags are still unread
+    std::string browseTitle(const std::string &title) const;
+    void cancelSearch();
+
     // Callbacks
     std::function<void(std::shared_ptr<class MediaFileModel>)> onMediaSelectedCallback;
     std::function<void(const std::vector<std::shared_ptr<class MediaFileModel>>&, int)> onMediaPlayCallback;
     std::function<std::shared_ptr<class PlaylistModel>(const std::string&)> onOtherPlaylistCallback;
+    // Files shown on screen and those on the neighbouring pages
+    std::function<void(const std::vector<std::shared_ptr<class MediaFileModel>>&,
+                       const std::vector<std::shared_ptr<class MediaFileModel>>&)> onViewportChangedCallback;
+
+    std::vector<std::shared_ptr<class MediaFileModel>> getListedFiles(int first, int count) const;
 
 public:
     MediaListController(MediaListInterface *mlI);
+    ~MediaListController();
 
     void setMediaListView(MediaListInterface *view);
 
@@ -49,17 +108,60 @@ public:
 
     // Accessors
     std::shared_ptr<class PlaylistModel> getCurrentPlaylist() const;
+    MediaLibrary *getMediaLibrary() const;
 
     
-    // Directory scanning for media
+    // Directory scanning for media, runs in the background and fills the list as files are found.
+    // Starting a new scan cancels the running one.
     void scanDirectoryForMedia(std::filesystem::path &path);
+    void cancelScan();
+    bool isScanning() const;
+    std::shared_ptr<class ScanJob> getScanJob() const;
+
+    // Library index persistence
+    bool restoreLibrary();
+    void saveLibrary();
+
+    // Add removable drives to the library when they are mounted, drop them on removal
+    void startDeviceMonitor();
+
+    // Apply streamed scan results and folder changes picked up by the watcher,
+    // called from the UI loop
+    void pollLibraryChanges();
+
+    // Tags of file were loaded or edited, keeps library search and browsing in step
+    void refreshMediaTags(std::shared_ptr<class MediaFileModel> file);
+    // Tags of file were written to disk, which changed its size and mtime
+    void refreshFileStat(std::shared_ptr<class MediaFileModel> file, uint64_t size, int64_t mtime);
+
+    // Browse the library by tag instead of the flat list, cycling
+    // all files -> artists -> albums -> genres -> years -> duplicates -> all files
+    void nextBrowseMode();
+    // From the files of a value (or the copies of a duplicate) back to the value
+    // list, from there to all files
+    void browseBack();
+    // List the library files matching a structured query (see LibraryQuery), an
+    // empty query goes back to all files. A query with a syntax error is ignored.
+    void runQuery(const std::string &query);
+    // Search the library while the keyword is typed, the matches are listed once
+    // found; an empty keyword goes back to all files
+    void searchAsYouType(const std::string &keyword);
+    // Rows [first, first + count) of the browse list, read by the view a page at a time
+    std::vector<std::string> getBrowseRows(int first, int count) const;
 
     // Player Callback set
     void setOnMediaSelectedCallback(std::function<void(std::shared_ptr<class MediaFileModel>)> callback);
     void setOnMediaPlayCallback(std::function<void(const std::vector<std::shared_ptr<class MediaFileModel>>&, int)> callback);
     void setOnOtherPlaylistCallback(std::function<std::shared_ptr<class PlaylistModel>(const std::string&)> callback);
+    void setOnViewportChangedCallback(std::function<void(const std::vector<std::shared_ptr<class MediaFileModel>>&,
+                                                         const std::vector<std::shared_ptr<class MediaFileModel>>&)> callback);
+
+    // Rows [first, first + count) of the list are on screen
+    void setViewport(int first, int count);
 
+    // index counts from the top of the whole list, not of the page
     void handleMediaSelected(int index);
+    // Plays the file at index, or opens the value at index of a browse list
     void handleMediaPlay(int index);
 };
 
@@ -1,11 +1,73 @@
 #include "metadata.h"
 
+#include <SDL2/SDL_image.h>
+
+#include <algorithm>
+#include <iostream>
+
+const std::string metadataCacheFilePath = "data/library/metadata.bin";
+const std::string coverCacheDirectory = "data/covers";
+
+// Runs on the cover loader thread; SDL_image decoding does not touch the renderer
+static bool decodeCoverArt(const std::string &image, Thumbnail &decoded)
+{
+    SDL_RWops *stream = SDL_RWFromConstMem(image.data(), static_cast<int>(image.size()));
+    SDL_Surface *surface = stream ? IMG_Load_RW(stream, 1) : nullptr;
+    if (!surface)
+        return false;
+
+    SDL_Surface *rgba = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA32, 0);
+    SDL_FreeSurface(surface);
+    if (!rgba)
+        return false;
+
+    decoded.width = rgba->w;
+    decoded.height = rgba->h;
+    decoded.pixels.resize(size_t(rgba->w) * rgba->h * 4);
+    for (int y = 0; y < rgba->h; ++y)
+    {
+        const uint8_t *row = static_cast<const uint8_t *>(rgba->pixels) + size_t(y) * rgba->pitch;
+        std::copy(row, row + size_t(rgba->w) * 4, decoded.pixels.begin() + size_t(y) * rgba->w * 4);
+    }
+    SDL_FreeSurface(rgba);
+    return true;
+}
+
+// Estimated heap use of a file's tags; interned values shared with other files are counted in full
+static size_t metadataBytes(const MediaFileModel &file)
+{
+    size_t bytes = 0;
+    for (const auto &[key, value] : file.getAllMetadata())
+        bytes += 32 + value.capacity();
+    return bytes;
+}
 
 // MetadataController implementation
 MetadataController::MetadataController(
-    MetadataInterface *mV) : metadataView(mV)
+    MetadataInterface *mV) : reportedBatchProgress(0), metadataView(mV), mediaLibrary(nullptr), residentBytes(0),
+                             metadataMemoryBudget(defaultMetadataMemoryBudget)
+{
+    metadataCache = std::make_shared<MetadataCache>();
+    metadataExtractor = std::make_unique<MetadataExtractor>();
+    metadataExtractor->setCache(metadataCache);
+    metadataWriter = std::make_unique<MetadataWriter>();
+    metadataWriter->setCache(metadataCache);
+    batchEditor = std::make_unique<BatchMetadataEditor>();
+    batchEditor->setCache(metadataCache);
+    coverArtLoader = std::make_unique<CoverArtLoader>(decodeCoverArt, coverCacheDirectory);
+}
+
+bool MetadataController::restoreMetadataCache()
+{
+    return metadataCache->load(metadataCacheFilePath);
+}
+
+void MetadataController::saveMetadataCache()
 {
-    metadataManager = std::make_shared<MetadataManager>();
+    if (!metadataCache->save(metadataCacheFilePath))
+    {
+        std::cerr << "Failed to save metadata cache" << std::endl;
+    }
 }
 
 void MetadataController::setMetadataView(MetadataInterface *view)
@@ -13,53 +75,354 @@ void MetadataController::setMetadataView(MetadataInterface *view)
     metadataView = view;
 }
 
-void MetadataController::preloadMetadata(std::vector<std::shared_ptr<MediaFileModel>> mediaFiles)
+void MetadataController::setMediaLibrary(MediaLibrary *library)
 {
-    std::lock_guard<std::mutex> lock(metadataMutex);
+    mediaLibrary = library;
+}
 
-    for (auto &file : mediaFiles)
+void MetadataController::preloadMetadata(const std::vector<std::shared_ptr<MediaFileModel>> &mediaFiles, int startIndex)
+{
+    // Only the next few tracks, later ones are read as playback reaches them. Those of
+    // the previous call are no longer next.
+    metadataExtractor->clearPending(MetadataExtractor::Priority::UPCOMING);
+    std::vector<std::shared_ptr<MediaFileModel>> upcoming;
+    for (int i = std::max(startIndex, 0); i < static_cast<int>(mediaFiles.size()) && i < startIndex + preloadWindow; ++i)
     {
-        metadataManager->loadMetadata(file);
+        // Tags restored from the library index are still valid
+        if (!mediaFiles[i]->isMetadataLoaded())
+            upcoming.push_back(mediaFiles[i]);
     }
+    metadataExtractor->enqueue(upcoming, MetadataExtractor::Priority::UPCOMING);
 }
 
 void MetadataController::loadMetadata(std::shared_ptr<MediaFileModel> file)
 {
     std::lock_guard<std::mutex> lock(metadataMutex);
 
-    metadataManager->loadMetadata(file);
+    if (file != currentMedia)
+    {
+        // Covers of files selected earlier are no longer wanted
+        coverArtLoader->clearPending();
+        coverArtLoader->request(file->getFilepath());
+        if (metadataView)
+            metadataView->showCoverArt(nullptr);
+    }
     currentMedia = file;
-    // Load metadata
+    if (!file->isMetadataLoaded())
+    {
+        // Shown once pollMetadata picks up the result
+        metadataExtractor->enqueue(file, MetadataExtractor::Priority::HIGH);
+    }
+    else
+    {
+        touchResident(file);
+    }
+    showCurrentMedia();
+}
+
+void MetadataController::loadViewport(const std::vector<std::shared_ptr<MediaFileModel>> &visible,
+                                      const std::vector<std::shared_ptr<MediaFileModel>> &prefetch)
+{
+    std::lock_guard<std::mutex> lock(metadataMutex);
+
+    // Rows scrolled past are no longer worth reading; the upcoming tracks still are
+    metadataExtractor->clearPending(MetadataExtractor::Priority::NORMAL);
+    metadataExtractor->clearPending(MetadataExtractor::Priority::PREFETCH);
+
+    viewportFiles.clear();
+    std::vector<std::shared_ptr<MediaFileModel>> missingVisible;
+    std::vector<std::shared_ptr<MediaFileModel>> missingPrefetch;
+    // Prefetched pages first, so the visible rows end up most recently used
+    for (const auto &file : prefetch)
+    {
+        viewportFiles.insert(file.get());
+        if (file->isMetadataLoaded())
+            touchResident(file);
+        else
+            missingPrefetch.push_back(file);
+    }
+    for (const auto &file : visible)
+    {
+        viewportFiles.insert(file.get());
+        if (file->isMetadataLoaded())
+            touchResident(file);
+        else
+            missingVisible.push_back(file);
+    }
+
+    metadataExtractor->enqueue(missingVisible, MetadataExtractor::Priority::NORMAL);
+    metadataExtractor->enqueue(missingPrefetch, MetadataExtractor::Priority::PREFETCH);
+    evictOverBudget();
+}
+
+void MetadataController::setMetadataMemoryBudget(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(metadataMutex);
+    metadataMemoryBudget = bytes;
+    evictOverBudget();
+}
+
+size_t MetadataController::getResidentMetadataBytes() const
+{
+    return residentBytes;
+}
+
+void MetadataController::touchResident(const std::shared_ptr<MediaFileModel> &file)
+{
+    size_t bytes = metadataBytes(*file);
+    auto it = residentIndex.find(file.get());
+    if (it != residentIndex.end())
+    {
+        residentBytes -= it->second->bytes;
+        it->second->bytes = bytes;
+        residentFiles.splice(residentFiles.begin(), residentFiles, it->second);
+    }
+    else
+    {
+        residentFiles.push_front({file, bytes});
+        residentIndex[file.get()] = residentFiles.begin();
+    }
+    residentBytes += bytes;
+}
+
+void MetadataController::evictOverBudget()
+{
+    std::vector<std::shared_ptr<MediaFileModel>> evicted;
+    auto it = residentFiles.end();
+    while (residentBytes > metadataMemoryBudget && it != residentFiles.begin())
+    {
+        --it;
+        if (viewportFiles.count(it->file.get()) || it->file == currentMedia || isBeingWritten(it->file.get()))
+            continue;
+
+        evicted.push_back(it->file);
+        residentBytes -= it->bytes;
+        residentIndex.erase(it->file.get());
+        it = residentFiles.erase(it);
+    }
+
+    modifyTags(
+        [&evicted]()
+        {
+            for (const auto &file : evicted)
+                file->clearMetadata();
+        });
+}
+
+void MetadataController::modifyTags(const std::function<void()> &modify)
+{
+    // The library indexes tags on its scan and watcher threads under its lock
+    if (mediaLibrary)
+        mediaLibrary->modifyFiles(modify);
+    else
+        modify();
+}
+
+bool MetadataController::isBeingWritten(const MediaFileModel *file) const
+{
+    return metadataWriter->isPending(file) || batchEditor->isEditing(file);
+}
+
+void MetadataController::showCurrentMedia()
+{
     originalMetadata = currentMedia->getAllMetadata();
     editedMetadata = originalMetadata; // Make a copy for editing
 
     updateMetadataView();
 }
 
+void MetadataController::pollMetadata()
+{
+    for (const auto &written : metadataWriter->takeResults())
+    {
+        if (metadataView)
+            metadataView->showSaveResult(written.file->getFilename(), written.success);
+        if (written.success && written.modifiedTime != 0 && onFileWrittenCallback)
+            onFileWrittenCallback(written.file, written.fileSize, written.modifiedTime);
+    }
+    pollBatchEdit();
+
+    for (const auto &cover : coverArtLoader->takeResults())
+    {
+        std::lock_guard<std::mutex> lock(metadataMutex);
+        if (metadataView && currentMedia && cover.filepath == currentMedia->getFilepath())
+            metadataView->showCoverArt(cover.thumbnail);
+    }
+
+    std::vector<MetadataExtractor::Result> results = metadataExtractor->takeResults();
+    if (results.empty())
+        return;
+
+    std::vector<std::shared_ptr<MediaFileModel>> loaded;
+    {
+        std::lock_guard<std::mutex> lock(metadataMutex);
+        // Tags read before a queued edit reaches the disk are already outdated
+        results.erase(std::remove_if(results.begin(), results.end(),
+                                     [this](const MetadataExtractor::Result &result)
+                                     {
+                                         return !result.success || isBeingWritten(result.file.get());
+                                     }),
+                      results.end());
+        modifyTags(
+            [&results]()
+            {
+                for (const auto &result : results)
+                    MetadataExtractor::applyResult(result);
+            });
+
+        for (const auto &result : results)
+        {
+            loaded.push_back(result.file);
+            touchResident(result.file);
+            if (result.file == currentMedia)
+                showCurrentMedia();
+        }
+        evictOverBudget();
+    }
+
+    if (onMetadataLoadedCallback)
+    {
+        for (const auto &file : loaded)
+            onMetadataLoadedCallback(file);
+    }
+}
+
+void MetadataController::setOnMetadataLoadedCallback(std::function<void(std::shared_ptr<MediaFileModel>)> callback)
+{
+    onMetadataLoadedCallback = callback;
+}
+
+void MetadataController::setOnFileWrittenCallback(std::function<void(std::shared_ptr<MediaFileModel>, uint64_t, int64_t)> callback)
+{
+    onFileWrittenCallback = callback;
+}
+
 bool MetadataController::saveMetadata()
+{
+    std::shared_ptr<MediaFileModel> edited;
+    {
+        std::lock_guard<std::mutex> lock(metadataMutex);
+
+        if (!currentMedia)
+            return false;
+        if (batchEditor->isEditing(currentMedia.get()))
+        {
+            std::cerr << "Cannot save " << currentMedia->getFilename() << " while a batch edit writes it" << std::endl;
+            return false;
+        }
+
+        // Apply edited metadata to the media file
+        modifyTags(
+            [this]()
+            {
+                for (const auto &[key, value] : editedMetadata)
+                    currentMedia->setMetadata(key, value);
+            });
+
+        // Written in the background, the model already holds the edited values
+        metadataWriter->enqueue(currentMedia, currentMedia->getAllMetadata());
+        touchResident(currentMedia);
+        originalMetadata = editedMetadata;
+
+        updateMetadataView();
+        if (metadataView)
+            metadataView->showSavePending(currentMedia->getFilename());
+        edited = currentMedia;
+    }
+
+    if (onMetadataLoadedCallback)
+        onMetadataLoadedCallback(edited);
+    return true;
+}
+
+bool MetadataController::saveMetadataBatch(const std::vector<std::shared_ptr<MediaFileModel>> &files,
+                                           const std::map<std::string, std::string> &changes)
 {
     std::lock_guard<std::mutex> lock(metadataMutex);
 
-    if (!currentMedia)
+    if (files.empty() || batchEditor->isRunning())
         return false;
-
-    // Apply edited metadata to the media file
-    for (const auto &[key, value] : editedMetadata)
+    // A queued single save would race with the backup of the same file
+    for (const auto &file : files)
     {
-        currentMedia->setMetadata(key, value);
+        if (metadataWriter->isPending(file.get()))
+        {
+            std::cerr << "Cannot batch edit " << file->getFilename() << " while it is being saved" << std::endl;
+            return false;
+        }
     }
 
-    // Save changes to file
-    bool success = metadataManager->saveMetadata(currentMedia);
+    if (!batchEditor->start(files, changes))
+        return false;
+    reportedBatchProgress = 0;
+    if (metadataView)
+        metadataView->showBatchProgress(0, files.size());
+    return true;
+}
+
+void MetadataController::cancelMetadataBatch()
+{
+    batchEditor->cancel();
+}
+
+bool MetadataController::isMetadataBatchRunning() const
+{
+    return batchEditor->isRunning();
+}
 
-    if (success)
+void MetadataController::pollBatchEdit()
+{
+    BatchMetadataEditor::Result finished;
+    if (!batchEditor->takeResult(finished))
     {
-        // Update original metadata with saved changes
-        originalMetadata = editedMetadata;
+        size_t done, count;
+        batchEditor->getProgress(done, count);
+        if (batchEditor->isRunning() && done != reportedBatchProgress && metadataView)
+            metadataView->showBatchProgress(done, count);
+        reportedBatchProgress = done;
+        return;
     }
 
-    updateMetadataView();
-    return success;
+    if (finished.success)
+    {
+        std::lock_guard<std::mutex> lock(metadataMutex);
+        modifyTags(
+            [&finished]()
+            {
+                for (const auto &file : finished.files)
+                {
+                    for (const auto &[key, value] : finished.changes)
+                        file->setMetadata(key, value);
+                }
+            });
+        for (const auto &file : finished.files)
+        {
+            touchResident(file);
+            if (file == currentMedia)
+                showCurrentMedia();
+        }
+        evictOverBudget();
+    }
+    else if (!finished.cancelled)
+    {
+        std::cerr << "Batch edit failed at " << finished.failedFile << ", all files were restored" << std::endl;
+    }
+
+    if (onFileWrittenCallback)
+    {
+        for (size_t i = 0; i < finished.files.size(); ++i)
+        {
+            if (finished.modifiedTimes[i] != 0)
+                onFileWrittenCallback(finished.files[i], finished.fileSizes[i], finished.modifiedTimes[i]);
+        }
+    }
+    if (metadataView)
+        metadataView->showBatchResult(finished.files.size(), finished.success);
+    if (finished.success && onMetadataLoadedCallback)
+    {
+        for (const auto &file : finished.files)
+            onMetadataLoadedCallback(file);
+    }
 }
 
 void MetadataController::discardChanges()
@@ -4,13 +4,26 @@
 #include "View/Interface/Iview.h"
 #include "Model/playlist.h"
 #include "Model/manager.h"
+#include "Model/metadata_extractor.h"
+#include "Model/metadata_writer.h"
+#include "Model/batch_editor.h"
+#include "Model/cover_loader.h"
+
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
 
 // Controller for metadata operations
 class MetadataController
 {
 private:
     // Model references
-    std::shared_ptr<class MetadataManager> metadataManager;
+    std::shared_ptr<class MetadataCache> metadataCache;
+    std::unique_ptr<class MetadataExtractor> metadataExtractor;
+    std::unique_ptr<class MetadataWriter> metadataWriter;
+    std::unique_ptr<class BatchMetadataEditor> batchEditor;
+    size_t reportedBatchProgress; // files done when the view was last told
+    std::unique_ptr<class CoverArtLoader> coverArtLoader;
 
     // Current state
     std::shared_ptr<class MediaFileModel> currentMedia;
@@ -20,22 +33,84 @@ private:
     // View interface
     MetadataInterface *metadataView;
 
+    // Library whose lock guards tag changes, models may be shared with it
+    MediaLibrary *mediaLibrary;
+
     // Mutex for thread safety
     std::mutex metadataMutex;
 
+    // Callback invoked on the UI thread after tags of a file were loaded in the background or edited
+    std::function<void(std::shared_ptr<class MediaFileModel>)> onMetadataLoadedCallback;
+    // Callback invoked on the UI thread with the new size and mtime of a file whose tags were written
+    std::function<void(std::shared_ptr<class MediaFileModel>, uint64_t, int64_t)> onFileWrittenCallback;
+
+    // Files whose tags are in memory, most recently on screen first. Once the total
+    // passes the budget, tags of files furthest back are dropped.
+    struct ResidentFile
+    {
+        std::shared_ptr<class MediaFileModel> file;
+        size_t bytes;
+    };
+    std::list<ResidentFile> residentFiles;
+    std::unordered_map<const MediaFileModel *, std::list<ResidentFile>::iterator> residentIndex;
+    size_t residentBytes;
+    size_t metadataMemoryBudget;
+    std::unordered_set<const MediaFileModel *> viewportFiles; // never evicted
+
+    static constexpr size_t defaultMetadataMemoryBudget = 4 * 1024 * 1024;
+    static constexpr int preloadWindow = 8; // upcoming tracks read ahead when playing
+
+    void showCurrentMedia();
+    void touchResident(const std::shared_ptr<class MediaFileModel> &file);
+    void evictOverBudget();
+    bool isBeingWritten(const MediaFileModel *file) const;
+    // Change the tags of listed models, see MediaLibrary::modifyFiles
+    void modifyTags(const std::function<void()> &modify);
+    void pollBatchEdit();
+
 public:
     MetadataController(MetadataInterface *mV);
 
     // View setter
     void setMetadataView(MetadataInterface *view);
+    // The library of the media list, set before tags are loaded
+    void setMediaLibrary(MediaLibrary *library);
+
+    // Persistent tag cache shared by every read, so unchanged files are not parsed again
+    bool restoreMetadataCache();
+    void saveMetadataCache();
 
-    // Metadata operations
+    // Metadata operations. Tags are read on the extractor pool: loadMetadata moves
+    // its file to the front, loadViewport reads the rows on screen and then the
+    // neighbouring pages, preloadMetadata reads the tracks following startIndex.
     const std::map<std::string, std::string> &getMetadata() const;
-    void preloadMetadata(std::vector<std::shared_ptr<MediaFileModel>> mediaFiles);
+    void preloadMetadata(const std::vector<std::shared_ptr<MediaFileModel>> &mediaFiles, int startIndex = 0);
     void loadMetadata(std::shared_ptr<class MediaFileModel> file);
+    void loadViewport(const std::vector<std::shared_ptr<MediaFileModel>> &visible,
+                      const std::vector<std::shared_ptr<MediaFileModel>> &prefetch);
+
+    // Bytes of tags kept in memory before files away from the viewport are evicted
+    void setMetadataMemoryBudget(size_t bytes);
+    size_t getResidentMetadataBytes() const;
+
+    // Apply tags read by the pool since the last call and report finished writes
+    // to the view, called from the UI loop
+    void pollMetadata();
+    void setOnMetadataLoadedCallback(std::function<void(std::shared_ptr<class MediaFileModel>)> callback);
+    void setOnFileWrittenCallback(std::function<void(std::shared_ptr<class MediaFileModel>, uint64_t, int64_t)> callback);
+    // Shows the edits at once and queues writing them to the file
     bool saveMetadata();
     void discardChanges();
 
+    // Writes changes (field name -> value) to all files in the background, several at
+    // a time, all or nothing: a failed write rolls back the files already written.
+    // The models take the changes once the batch succeeded. Returns false when a batch
+    // is running or one of the files still has a single save queued.
+    bool saveMetadataBatch(const std::vector<std::shared_ptr<MediaFileModel>> &files,
+                           const std::map<std::string, std::string> &changes);
+    void cancelMetadataBatch();
+    bool isMetadataBatchRunning() const;
+
     // Field operations
     void updateField(const std::string &key, const std::string &value);
     void addNewField(const std::string &key, const std::string &value);
@@ -360,6 +360,22 @@ int PlayerController::getDuration() const
     return totalDuration;
 }
 
+void PlayerController::refreshMediaInfo(std::shared_ptr<MediaFileModel> media)
+{
+    std::lock_guard<std::mutex> lock(playbackMutex);
+    if (!media || media != currentMedia)
+        return;
+
+    totalDuration = media->getDuration();
+    if (playerView)
+    {
+        if ((currentMedia->getMetadata("Title").empty()) || (currentMedia->getMetadata("Artist").empty()))
+            playerView->setCurrentMedia(currentMedia->getFilename(), "");
+        else
+            playerView->setCurrentMedia(currentMedia->getMetadata("Title"), currentMedia->getMetadata("Artist"));
+    }
+}
+
 bool PlayerController::loadMedia(std::shared_ptr<MediaFileModel> media)
 {
     if (!media)
@@ -84,6 +84,9 @@ public:
     int getCurrentPosition() const;
     int getDuration() const;
 
+    // Pick up duration and tags of media loaded after playback started
+    void refreshMediaInfo(std::shared_ptr<class MediaFileModel> media);
+
 private:
     // Thread function for playback monitoring
     void playbackMonitorThread();
@@ -0,0 +1,280 @@
+#include "watcher.h"
+
+#include <chrono>
+#include <iostream>
+
+#ifdef __linux__
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+namespace fs = std::filesystem;
+using namespace std::chrono;
+
+#ifdef __linux__
+static const uint32_t watchMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                  IN_CLOSE_WRITE | IN_MODIFY | IN_ONLYDIR | IN_EXCL_UNLINK;
+#endif
+
+// LibraryWatcher implementation
+LibraryWatcher::LibraryWatcher(MediaLibrary *library)
+    : mediaLibrary(library), inotifyFd(-1), running(false), needFullRescan(false)
+{
+}
+
+LibraryWatcher::~LibraryWatcher()
+{
+    stop();
+}
+
+bool LibraryWatcher::isRunning() const
+{
+    return running;
+}
+
+#ifdef __linux__
+
+bool LibraryWatcher::start(const fs::path &root, ChangeCallback callback)
+{
+    stop();
+
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0)
+    {
+        std::cerr << "Failed to initialize inotify" << std::endl;
+        return false;
+    }
+
+    rootDirectory = root;
+    onLibraryChanged = callback;
+
+    // The library was just scanned, so files found here are already known
+    std::vector<std::string> ignored;
+    addWatchRecursive(rootDirectory, ignored);
+
+    running = true;
+    watchThread = std::thread(&LibraryWatcher::watchThreadFunc, this);
+    return true;
+}
+
+void LibraryWatcher::stop()
+{
+    if (running)
+    {
+        running = false;
+        if (watchThread.joinable())
+        {
+            watchThread.join();
+        }
+    }
+
+    if (inotifyFd >= 0)
+    {
+        close(inotifyFd);
+        inotifyFd = -1;
+    }
+    watchedDirectories.clear();
+    pendingChanges.clear();
+    needFullRescan = false;
+}
+
+void LibraryWatcher::addWatchRecursive(const fs::path &dir, std::vector<std::string> &foundFiles)
+{
+    auto addWatch = [this](const fs::path &path)
+    {
+        int wd = inotify_add_watch(inotifyFd, path.c_str(), watchMask);
+        if (wd < 0)
+        {
+            std::cerr << "Failed to watch " << path.string() << std::endl;
+            return;
+        }
+        watchedDirectories[wd] = path.string();
+    };
+
+    // Register the watch before listing, so files created meanwhile are not missed
+    addWatch(dir);
+
+    std::error_code ec;
+    fs::recursive_directory_iterator it(dir, fs::directory_options::skip_permission_denied, ec);
+    for (; !ec && it != fs::recursive_directory_iterator(); it.increment(ec))
+    {
+        std::error_code typeEc;
+        if (it->is_directory(typeEc) && !it->is_symlink(typeEc))
+            addWatch(it->path());
+        else if (it->is_regular_file(typeEc))
+            foundFiles.push_back(it->path().string());
+    }
+}
+
+void LibraryWatcher::removeWatchesUnder(const std::string &dir)
+{
+    for (auto it = watchedDirectories.begin(); it != watchedDirectories.end();)
+    {
+        const std::string &path = it->second;
+        if (path == dir || (path.size() > dir.size() && path.compare(0, dir.size(), dir) == 0 && path[dir.size()] == '/'))
+        {
+            inotify_rm_watch(inotifyFd, it->first);
+            it = watchedDirectories.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void LibraryWatcher::readEvents()
+{
+    alignas(struct inotify_event) char buffer[16 * 1024];
+
+    while (true)
+    {
+        ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+        if (length <= 0)
+            break;
+
+        for (char *ptr = buffer; ptr < buffer + length;)
+        {
+            const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(ptr);
+            ptr += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                needFullRescan = true;
+                continue;
+            }
+            if (event->mask & IN_IGNORED)
+            {
+                watchedDirectories.erase(event->wd);
+                continue;
+            }
+
+            auto dirIt = watchedDirectories.find(event->wd);
+            if (dirIt == watchedDirectories.end() || event->len == 0)
+                continue;
+            std::string path = dirIt->second + "/" + event->name;
+
+            if (event->mask & IN_ISDIR)
+            {
+                if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                    pendingChanges[path] = Change::DIRECTORY_ADDED;
+                else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+                    pendingChanges[path] = Change::REMOVED;
+            }
+            else
+            {
+                if (event->mask & (IN_CREATE | IN_MOVED_TO | IN_MODIFY | IN_CLOSE_WRITE))
+                    pendingChanges[path] = Change::FILE_CHANGED;
+                else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+                    pendingChanges[path] = Change::REMOVED;
+            }
+        }
+    }
+}
+
+void LibraryWatcher::flushChanges()
+{
+    bool modified = false;
+
+    if (needFullRescan)
+    {
+        // Events were lost, fall back to a full scan and fresh watches
+        std::cerr << "inotify queue overflow, rescanning " << rootDirectory.string() << std::endl;
+        for (const auto &[wd, path] : watchedDirectories)
+            inotify_rm_watch(inotifyFd, wd);
+        watchedDirectories.clear();
+
+        std::vector<std::string> ignored;
+        addWatchRecursive(rootDirectory, ignored);
+        fs::path root = rootDirectory;
+        mediaLibrary->scanDirectory(root);
+
+        pendingChanges.clear();
+        needFullRescan = false;
+        modified = true;
+    }
+
+    std::vector<std::string> changedFiles;
+    std::vector<std::string> removedPaths;
+    for (const auto &[path, change] : pendingChanges)
+    {
+        switch (change)
+        {
+        case Change::FILE_CHANGED:
+            changedFiles.push_back(path);
+            break;
+        case Change::REMOVED:
+            removedPaths.push_back(path);
+            removeWatchesUnder(path);
+            break;
+        case Change::DIRECTORY_ADDED:
+            // Copied or moved in: watch it and pick up everything already inside
+            removedPaths.push_back(path);
+            addWatchRecursive(path, changedFiles);
+            break;
+        }
+    }
+    pendingChanges.clear();
+
+    if (!changedFiles.empty() || !removedPaths.empty())
+        modified = mediaLibrary->updateFiles(changedFiles, removedPaths) || modified;
+
+    if (modified && onLibraryChanged)
+        onLibraryChanged();
+}
+
+void LibraryWatcher::watchThreadFunc()
+{
+    bool batching = false;
+    steady_clock::time_point batchStart, lastEvent;
+
+    while (running)
+    {
+        struct pollfd pfd = {inotifyFd, POLLIN, 0};
+        int ret = poll(&pfd, 1, batching ? settleTimeMs : 100);
+
+        auto now = steady_clock::now();
+        if (ret > 0 && (pfd.revents & POLLIN))
+        {
+            readEvents();
+            if (!batching)
+            {
+                batching = true;
+                batchStart = now;
+            }
+            lastEvent = now;
+        }
+
+        // Apply once the burst is quiet, or periodically during a long copy
+        if (batching && (now - lastEvent >= milliseconds(settleTimeMs) ||
+                         now - batchStart >= milliseconds(maxBatchDelayMs)))
+        {
+            flushChanges();
+            batching = false;
+        }
+    }
+}
+
+#else
+
+bool LibraryWatcher::start(const fs::path &root, ChangeCallback callback)
+{
+    // Folder watching is only implemented with inotify
+    rootDirectory = root;
+    onLibraryChanged = callback;
+    return false;
+}
+
+void LibraryWatcher::stop()
+{
+    running = false;
+}
+
+void LibraryWatcher::addWatchRecursive(const fs::path &, std::vector<std::string> &) {}
+void LibraryWatcher::removeWatchesUnder(const std::string &) {}
+void LibraryWatcher::readEvents() {}
+void LibraryWatcher::flushChanges() {}
+void LibraryWatcher::watchThreadFunc() {}
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef LIBRARY_WATCHER_H
+#define LIBRARY_WATCHER_H
+
+#include "Model/manager.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <filesystem>
+
+// Watches a scanned media folder (inotify on Linux) and feeds create, delete,
+// move and modify events to MediaLibrary as incremental updates.
+class LibraryWatcher
+{
+private:
+    MediaLibrary *mediaLibrary;
+
+    int inotifyFd;
+    std::unordered_map<int, std::string> watchedDirectories; // watch descriptor -> path
+    std::filesystem::path rootDirectory;
+
+    std::atomic<bool> running;
+    std::thread watchThread;
+
+    // Events are collected and applied together once the burst settles
+    enum class Change
+    {
+        FILE_CHANGED,
+        REMOVED,
+        DIRECTORY_ADDED
+    };
+    std::map<std::string, Change> pendingChanges;
+    bool needFullRescan;
+
+    static constexpr int settleTimeMs = 200; // quiet period that ends a burst
+    static constexpr int maxBatchDelayMs = 2000;
+
+    // Callback function type, invoked from the watcher thread after the library changed
+    using ChangeCallback = std::function<void()>;
+    ChangeCallback onLibraryChanged;
+
+    void addWatchRecursive(const std::filesystem::path &dir, std::vector<std::string> &foundFiles);
+    void removeWatchesUnder(const std::string &dir);
+    void readEvents();
+    void flushChanges();
+    void watchThreadFunc();
+
+public:
+    LibraryWatcher(MediaLibrary *library);
+    ~LibraryWatcher();
+
+    // Start watching root and all its subdirectories, replacing any previous root
+    bool start(const std::filesystem::path &root, ChangeCallback callback);
+    void stop();
+
+    bool isRunning() const;
+};
+
+#endif // LIBRARY_WATCHER_H
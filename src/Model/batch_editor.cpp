@@ -0,0 +1,217 @@
+#include "batch_editor.h"
+
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    const unsigned int defaultBatchThreads = 4;
+
+    std::string backupPath(const std::string &path)
+    {
+        return path + ".tagbak";
+    }
+
+    // Copy keeping the modification time, so a file restored from it looks unchanged to the library index
+    bool backupFile(const std::string &path)
+    {
+        std::error_code ec;
+        fs::copy_file(fs::u8path(path), fs::u8path(backupPath(path)), fs::copy_options::overwrite_existing, ec);
+        if (ec)
+        {
+            std::cerr << "Failed to back up " << path << ": " << ec.message() << "\n";
+            return false;
+        }
+        auto mtime = fs::last_write_time(fs::u8path(path), ec);
+        if (!ec)
+            fs::last_write_time(fs::u8path(backupPath(path)), mtime, ec);
+        return true;
+    }
+
+    void restoreBackup(const std::string &path)
+    {
+        std::error_code ec;
+        fs::rename(fs::u8path(backupPath(path)), fs::u8path(path), ec);
+        if (ec)
+            std::cerr << "Failed to restore " << path << " from " << backupPath(path) << ": " << ec.message() << "\n";
+    }
+
+    void removeBackup(const std::string &path)
+    {
+        std::error_code ec;
+        fs::remove(fs::u8path(backupPath(path)), ec);
+    }
+}
+
+// BatchMetadataEditor implementation
+BatchMetadataEditor::BatchMetadataEditor() : running(false), cancelled(false), completed(0), total(0), hasResult(false)
+{
+    setThreadCount(0);
+}
+
+BatchMetadataEditor::~BatchMetadataEditor()
+{
+    cancel();
+    if (batchThread.joinable())
+        batchThread.join();
+}
+
+void BatchMetadataEditor::setThreadCount(unsigned int threads)
+{
+    threadCount = threads == 0 ? defaultBatchThreads : threads;
+}
+
+unsigned int BatchMetadataEditor::getThreadCount() const
+{
+    return threadCount;
+}
+
+void BatchMetadataEditor::setCache(std::shared_ptr<MetadataCache> cache)
+{
+    metadataManager.setCache(cache);
+}
+
+void BatchMetadataEditor::setTagPadding(size_t bytes)
+{
+    metadataManager.setTagPadding(bytes);
+}
+
+bool BatchMetadataEditor::start(const std::vector<std::shared_ptr<MediaFileModel>> &files,
+                                const std::map<std::string, std::string> &changes)
+{
+    if (running)
+        return false;
+    if (batchThread.joinable())
+        batchThread.join();
+
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        editing.clear();
+        for (const auto &file : files)
+            editing.insert(file.get());
+        hasResult = false;
+    }
+    completed = 0;
+    total = files.size();
+    cancelled = false;
+    running = true;
+    batchThread = std::thread(&BatchMetadataEditor::run, this, files, changes);
+    return true;
+}
+
+void BatchMetadataEditor::cancel()
+{
+    cancelled = true;
+}
+
+bool BatchMetadataEditor::isRunning() const
+{
+    return running;
+}
+
+bool BatchMetadataEditor::isEditing(const MediaFileModel *file) const
+{
+    std::lock_guard<std::mutex> lock(stateMutex);
+    return editing.count(file) > 0;
+}
+
+void BatchMetadataEditor::getProgress(size_t &done, size_t &count) const
+{
+    done = completed;
+    count = total;
+}
+
+bool BatchMetadataEditor::takeResult(Result &finished)
+{
+    std::lock_guard<std::mutex> lock(stateMutex);
+    if (!hasResult)
+        return false;
+    finished = std::move(result);
+    hasResult = false;
+    return true;
+}
+
+void BatchMetadataEditor::run(std::vector<std::shared_ptr<MediaFileModel>> files, std::map<std::string, std::string> changes)
+{
+    // Each worker writes only its own slots of backedUp
+    std::vector<char> backedUp(files.size(), 0);
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+    std::atomic<uint64_t> bytesWritten(0);
+    std::mutex failMutex;
+    std::string failedFile;
+
+    auto fail = [&](const std::string &path)
+    {
+        std::lock_guard<std::mutex> lock(failMutex);
+        if (failedFile.empty())
+            failedFile = path;
+        failed = true;
+    };
+
+    auto worker = [&]()
+    {
+        for (size_t n = next++; n < files.size() && !failed && !cancelled; n = next++)
+        {
+            const std::string &path = files[n]->getFilepath();
+            if (!backupFile(path))
+            {
+                fail(path);
+                break;
+            }
+            backedUp[n] = 1;
+
+            // Written from a scratch model, the listed ones stay with the UI thread. It holds
+            // only the changes, so saveMetadata drops the file from the cache.
+            auto scratch = std::make_shared<MediaFileModel>(path);
+            scratch->setContainer(files[n]->getContainer());
+            for (const auto &[key, value] : changes)
+                scratch->setMetadata(key, value);
+
+            TagWriteStats stats;
+            if (!metadataManager.saveMetadata(scratch, &stats))
+            {
+                std::cerr << "Failed to write tags to " << path << "\n";
+                fail(path);
+                break;
+            }
+            bytesWritten += stats.bytesWritten;
+            completed++;
+        }
+    };
+
+    size_t nThreads = std::min<size_t>(threadCount, files.size());
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < nThreads; ++t)
+        workers.emplace_back(worker);
+    worker();
+    for (auto &thread : workers)
+        thread.join();
+
+    // All or nothing: a failure or a cancel puts back every file touched so far
+    bool success = !failed && !cancelled;
+    // Restored files have a new mtime too
+    std::vector<uint64_t> sizes(files.size(), 0);
+    std::vector<int64_t> mtimes(files.size(), 0);
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        if (!backedUp[i])
+            continue;
+        if (success)
+            removeBackup(files[i]->getFilepath());
+        else
+            restoreBackup(files[i]->getFilepath());
+        if (!readFileStat(files[i]->getFilepath(), sizes[i], mtimes[i]))
+            sizes[i] = mtimes[i] = 0;
+    }
+
+    std::lock_guard<std::mutex> lock(stateMutex);
+    result = {std::move(files), std::move(changes), success, cancelled && !failed, failedFile, bytesWritten,
+              std::move(sizes), std::move(mtimes)};
+    hasResult = true;
+    editing.clear();
+    running = false;
+}
@@ -0,0 +1,84 @@
+#ifndef BATCH_EDITOR_H
+#define BATCH_EDITOR_H
+
+#include "manager.h"
+
+#include <map>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <unordered_set>
+
+// Writes the same field changes to many files at once, as one transaction.
+// Files are written in parallel on a small pool of threads; each file is copied
+// to a backup next to it before its tags are touched. When every write succeeds
+// the backups are removed, otherwise every file already written is restored
+// from its backup, so either all files carry the changes or none does.
+class BatchMetadataEditor
+{
+public:
+    struct Result
+    {
+        std::vector<std::shared_ptr<MediaFileModel>> files;
+        std::map<std::string, std::string> changes;
+        bool success;
+        bool cancelled;
+        std::string failedFile; // first file that could not be written, empty on success
+        uint64_t bytesWritten;  // tag bytes written, including those rolled back
+        // Stat of each file once the batch ended, 0 for files never touched
+        std::vector<uint64_t> fileSizes;
+        std::vector<int64_t> modifiedTimes;
+    };
+
+private:
+    MetadataManager metadataManager;
+    unsigned int threadCount;
+
+    std::thread batchThread;
+    std::atomic<bool> running;
+    std::atomic<bool> cancelled;
+    std::atomic<size_t> completed;
+    std::atomic<size_t> total;
+
+    // Files of the running batch, read by the UI thread
+    mutable std::mutex stateMutex;
+    std::unordered_set<const MediaFileModel *> editing;
+    bool hasResult;
+    Result result;
+
+    void run(std::vector<std::shared_ptr<MediaFileModel>> files, std::map<std::string, std::string> changes);
+
+public:
+    BatchMetadataEditor();
+    // Cancels a running batch and waits for its rollback
+    ~BatchMetadataEditor();
+
+    // Files written at the same time, 0 = default (4, disks gain little beyond that)
+    void setThreadCount(unsigned int threads);
+    unsigned int getThreadCount() const;
+
+    // Share the persistent tag cache and padding with the other writers; set before start
+    void setCache(std::shared_ptr<MetadataCache> cache);
+    void setTagPadding(size_t bytes);
+
+    // Write changes (field name -> new value) to files in the background. The models
+    // are not touched; apply result.changes to them once takeResult reports success.
+    // Returns false when a batch is already running.
+    bool start(const std::vector<std::shared_ptr<MediaFileModel>> &files, const std::map<std::string, std::string> &changes);
+    // Stop starting new writes and roll back the ones done
+    void cancel();
+
+    bool isRunning() const;
+    // True while file is part of the running batch
+    bool isEditing(const MediaFileModel *file) const;
+    // Files finished (written or failed) out of the batch size
+    void getProgress(size_t &done, size_t &count) const;
+
+    // The outcome of the last batch once it finished, only reported once
+    bool takeResult(Result &finished);
+};
+
+#endif // BATCH_EDITOR_H
@@ -0,0 +1,76 @@
+#include "binary_io.h"
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <filesystem>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+bool readBinaryFile(const std::string &path, std::string &buffer)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+        return false;
+    buffer.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return true;
+}
+
+bool writeBinaryFile(const std::string &path, const std::string &data)
+{
+    std::error_code ec;
+    fs::path target(path);
+    if (target.has_parent_path())
+        fs::create_directories(target.parent_path(), ec);
+
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!out.is_open())
+        {
+            std::cerr << "Failed to open " << tmpPath << " for writing\n";
+            return false;
+        }
+        out.write(data.data(), data.size());
+        if (!out)
+        {
+            std::cerr << "Failed to write " << tmpPath << "\n";
+            return false;
+        }
+    }
+
+    // On disk before the rename, or a crash may replace the old file with an empty one
+    if (!syncFile(tmpPath))
+    {
+        std::cerr << "Failed to sync " << tmpPath << "\n";
+        return false;
+    }
+
+    fs::rename(tmpPath, target, ec);
+    if (ec)
+    {
+        std::cerr << "Failed to replace " << path << ": " << ec.message() << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool syncFile(const std::string &path)
+{
+#ifdef _WIN32
+    (void)path;
+    return true;
+#else
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    bool synced = fsync(fd) == 0;
+    close(fd);
+    return synced;
+#endif
+}
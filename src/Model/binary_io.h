@@ -0,0 +1,108 @@
+#ifndef BINARY_IO_H
+#define BINARY_IO_H
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+
+// Helpers shared by the binary on-disk caches (library index, metadata cache).
+// Values are stored in host byte order; strings as u32 length + bytes.
+class BinaryWriter
+{
+private:
+    std::string buffer;
+
+public:
+    template <typename T>
+    void put(T value)
+    {
+        buffer.append(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    // A whole column in one append
+    template <typename T>
+    void putArray(const std::vector<T> &values)
+    {
+        buffer.append(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(T));
+    }
+
+    void putString(const std::string &str)
+    {
+        put<uint32_t>(static_cast<uint32_t>(str.size()));
+        buffer.append(str);
+    }
+
+    void putMagic(const char (&magic)[4])
+    {
+        buffer.append(magic, sizeof(magic));
+    }
+
+    const std::string &data() const { return buffer; }
+};
+
+class BinaryReader
+{
+private:
+    const std::string &buffer;
+    size_t offset;
+
+public:
+    BinaryReader(const std::string &buf) : buffer(buf), offset(0) {}
+
+    template <typename T>
+    bool get(T &value)
+    {
+        if (buffer.size() - offset < sizeof(T))
+            return false;
+        std::memcpy(&value, buffer.data() + offset, sizeof(T));
+        offset += sizeof(T);
+        return true;
+    }
+
+    template <typename T>
+    bool getArray(std::vector<T> &values, size_t count)
+    {
+        if ((buffer.size() - offset) / sizeof(T) < count)
+            return false;
+        values.resize(count);
+        std::memcpy(values.data(), buffer.data() + offset, count * sizeof(T));
+        offset += count * sizeof(T);
+        return true;
+    }
+
+    bool getString(std::string &str)
+    {
+        uint32_t length;
+        if (!get(length) || buffer.size() - offset < length)
+            return false;
+        str.assign(buffer, offset, length);
+        offset += length;
+        return true;
+    }
+
+    // Bytes not read yet, to bound counts read from the file before allocating for them
+    size_t remaining() const
+    {
+        return buffer.size() - offset;
+    }
+
+    bool getMagic(const char (&magic)[4])
+    {
+        if (buffer.size() < sizeof(magic) || std::memcmp(buffer.data(), magic, sizeof(magic)) != 0)
+            return false;
+        offset = sizeof(magic);
+        return true;
+    }
+};
+
+// Read a whole file into buffer
+bool readBinaryFile(const std::string &path, std::string &buffer);
+
+// Write to path.tmp and rename over path, so a crash never leaves a half-written file
+bool writeBinaryFile(const std::string &path, const std::string &data);
+
+// Flush a written file to the disk, e.g. before it replaces another one by rename
+bool syncFile(const std::string &path);
+
+#endif // BINARY_IO_H
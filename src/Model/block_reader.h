@@ -0,0 +1,158 @@
+#ifndef BLOCK_READER_H
+#define BLOCK_READER_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <fstream>
+#include <filesystem>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+// Blocks of a file read with pread, so walking a header while skipping large
+// frames, boxes or payload costs a few reads instead of a read of the whole file
+class BlockReader
+{
+private:
+    static constexpr size_t blockSize = 16 * 1024;
+
+#ifdef _WIN32
+    std::ifstream file;
+#else
+    int fd;
+#endif
+    uint64_t fileSize;
+    std::vector<uint8_t> block;
+    uint64_t blockStart;
+    size_t blockLength;
+    uint64_t bytesRead;
+
+    size_t readAt(uint8_t *buffer, size_t length, uint64_t offset)
+    {
+#ifdef _WIN32
+        file.clear();
+        file.seekg(static_cast<std::streamoff>(offset));
+        file.read(reinterpret_cast<char *>(buffer), length);
+        return static_cast<size_t>(file.gcount());
+#else
+        size_t done = 0;
+        while (done < length)
+        {
+            ssize_t nread = pread(fd, buffer + done, length - done, static_cast<off_t>(offset + done));
+            if (nread <= 0)
+                break;
+            done += static_cast<size_t>(nread);
+        }
+        return done;
+#endif
+    }
+
+public:
+#ifdef _WIN32
+    BlockReader(const std::string &filepath)
+        : file(std::filesystem::u8path(filepath), std::ios::binary), fileSize(0), blockStart(0), blockLength(0), bytesRead(0)
+    {
+        std::error_code ec;
+        if (file.is_open())
+            fileSize = std::filesystem::file_size(std::filesystem::u8path(filepath), ec);
+    }
+    bool isOpen() const { return file.is_open(); }
+#else
+    BlockReader(const std::string &filepath)
+        : fd(open(filepath.c_str(), O_RDONLY | O_CLOEXEC)), fileSize(0), blockStart(0), blockLength(0), bytesRead(0)
+    {
+        struct stat st;
+        if (fd >= 0 && fstat(fd, &st) == 0)
+            fileSize = static_cast<uint64_t>(st.st_size);
+    }
+    ~BlockReader()
+    {
+        if (fd >= 0)
+            close(fd);
+    }
+    bool isOpen() const { return fd >= 0; }
+#endif
+
+    uint64_t size() const { return fileSize; }
+    // Total read from the file so far
+    uint64_t getBytesRead() const { return bytesRead; }
+
+    // length bytes at offset, valid until the next call; nullptr past the end of the file
+    const uint8_t *get(uint64_t offset, size_t length)
+    {
+        if (offset >= blockStart && offset + length <= blockStart + blockLength)
+            return block.data() + (offset - blockStart);
+        if (offset > fileSize || length > fileSize - offset)
+            return nullptr;
+
+        size_t wanted = std::max(length, blockSize);
+        if (block.size() < wanted)
+            block.resize(wanted);
+        blockStart = offset;
+        blockLength = readAt(block.data(), wanted, offset);
+        bytesRead += blockLength;
+        return blockLength >= length ? block.data() : nullptr;
+    }
+};
+
+// The first count packets of the first logical stream of an Ogg file, i.e. its
+// codec headers, each at most maxPacketSize bytes
+inline bool readOggHeaderPackets(BlockReader &reader, std::vector<uint8_t> *packets, int count, size_t maxPacketSize,
+                                 uint32_t &serial)
+{
+    int packetIndex = 0;
+    uint64_t pos = 0;
+    bool first = true;
+    while (packetIndex < count)
+    {
+        const uint8_t *page = reader.get(pos, 27);
+        if (!page || std::memcmp(page, "OggS", 4) != 0 || page[4] != 0)
+            return false;
+        uint32_t pageSerial = uint32_t(page[14]) | (uint32_t(page[15]) << 8) | (uint32_t(page[16]) << 16) | (uint32_t(page[17]) << 24);
+        uint8_t segments = page[26];
+        if (first)
+        {
+            serial = pageSerial;
+            first = false;
+        }
+
+        std::vector<uint8_t> lacing;
+        const uint8_t *table = reader.get(pos + 27, segments);
+        if (!table)
+            return false;
+        lacing.assign(table, table + segments);
+        uint64_t body = pos + 27 + segments;
+        size_t bodyLength = 0;
+        for (uint8_t lace : lacing)
+            bodyLength += lace;
+        pos = body + bodyLength;
+        if (pageSerial != serial)
+            continue;
+
+        const uint8_t *data = reader.get(body, bodyLength);
+        if (!data)
+            return false;
+        for (uint8_t lace : lacing)
+        {
+            if (packetIndex < count)
+            {
+                packets[packetIndex].insert(packets[packetIndex].end(), data, data + lace);
+                if (packets[packetIndex].size() > maxPacketSize)
+                    return false;
+            }
+            data += lace;
+            if (lace < 255)
+                packetIndex++;
+        }
+    }
+    return true;
+}
+
+#endif // BLOCK_READER_H
@@ -0,0 +1,697 @@
+#include "container_probe.h"
+#include "block_reader.h"
+
+#include <cctype>
+#include <cstring>
+
+namespace
+{
+    const size_t maxStringSize = 1024; // codec ids and titles are short
+
+    uint16_t readBE16(const uint8_t *p) { return static_cast<uint16_t>((p[0] << 8) | p[1]); }
+    uint32_t readBE32(const uint8_t *p) { return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3]; }
+    uint64_t readBE64(const uint8_t *p) { return (uint64_t(readBE32(p)) << 32) | readBE32(p + 4); }
+    uint16_t readLE16(const uint8_t *p) { return static_cast<uint16_t>(p[0] | (p[1] << 8)); }
+    uint32_t readLE32(const uint8_t *p) { return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24); }
+
+    double readBEDouble(const uint8_t *p)
+    {
+        uint64_t bits = readBE64(p);
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    double readBEFloat(const uint8_t *p)
+    {
+        uint32_t bits = readBE32(p);
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    // First video and first audio codec found, each with the format's own name for it
+    struct Streams
+    {
+        std::string videoCodec;
+        std::string audioCodec;
+        int channels = 0;
+        int sampleRate = 0;
+        double duration = 0; // in seconds
+    };
+
+    std::string fourccName(const uint8_t *p)
+    {
+        std::string name(reinterpret_cast<const char *>(p), 4);
+        while (!name.empty() && (name.back() == ' ' || name.back() == '\0'))
+            name.pop_back();
+        return name;
+    }
+
+    struct CodecName
+    {
+        const char *id;
+        const char *name;
+    };
+
+    // Display name of a codec id, the id itself when it is not listed
+    template <size_t N>
+    std::string lookupCodec(const CodecName (&names)[N], const std::string &id, bool prefix = false)
+    {
+        for (const auto &entry : names)
+        {
+            if (prefix ? id.compare(0, std::strlen(entry.id), entry.id) == 0 : id == entry.id)
+                return entry.name;
+        }
+        return id;
+    }
+
+    void finish(const Streams &streams, uint64_t fileSize, ContainerInfo &info)
+    {
+        info.codec = streams.videoCodec;
+        if (!streams.audioCodec.empty())
+            info.codec += (info.codec.empty() ? "" : ", ") + streams.audioCodec;
+        info.duration = static_cast<int>(streams.duration + 0.5);
+        if (streams.duration > 0)
+            info.bitrate = static_cast<int>(fileSize * 8 / streams.duration / 1000);
+        info.channels = streams.channels;
+        info.sampleRate = streams.sampleRate;
+    }
+
+    // MP4 / QuickTime
+    const CodecName mp4Codecs[] = {
+        {"avc1", "H.264"}, {"avc3", "H.264"}, {"hvc1", "HEVC"}, {"hev1", "HEVC"}, {"av01", "AV1"},
+        {"vp08", "VP8"}, {"vp09", "VP9"}, {"mp4v", "MPEG-4 Visual"}, {"jpeg", "Motion JPEG"}, {"apcn", "ProRes"},
+        {"apch", "ProRes"}, {"apcs", "ProRes"}, {"apco", "ProRes"}, {"ap4h", "ProRes"},
+        {"mp4a", "AAC"}, {"ac-3", "AC-3"}, {"ec-3", "E-AC-3"}, {"Opus", "Opus"}, {".mp3", "MP3"},
+        {"fLaC", "FLAC"}, {"alac", "ALAC"}, {"sowt", "PCM"}, {"twos", "PCM"}, {"lpcm", "PCM"}};
+
+    struct Box
+    {
+        char type[4];
+        uint64_t payload;
+        uint64_t end;
+    };
+
+    bool readBox(BlockReader &reader, uint64_t offset, uint64_t limit, Box &box)
+    {
+        const uint8_t *p = reader.get(offset, 8);
+        if (!p || limit - offset < 8)
+            return false;
+        uint64_t size = readBE32(p);
+        std::memcpy(box.type, p + 4, 4);
+        uint64_t header = 8;
+        if (size == 1)
+        {
+            p = reader.get(offset + 8, 8);
+            if (!p)
+                return false;
+            size = readBE64(p);
+            header = 16;
+        }
+        else if (size == 0)
+        {
+            size = limit - offset; // up to the end of the file
+        }
+        if (size < header || size > limit - offset)
+            return false;
+        box.payload = offset + header;
+        box.end = offset + size;
+        return true;
+    }
+
+    bool isBox(const Box &box, const char *type)
+    {
+        return std::memcmp(box.type, type, 4) == 0;
+    }
+
+    // First child of the given type within [begin, end)
+    bool findBox(BlockReader &reader, uint64_t begin, uint64_t end, const char *type, Box &found)
+    {
+        for (uint64_t offset = begin; offset + 8 <= end; offset = found.end)
+        {
+            if (!readBox(reader, offset, end, found))
+                return false;
+            if (isBox(found, type))
+                return true;
+        }
+        return false;
+    }
+
+    void readSampleEntry(BlockReader &reader, const Box &stsd, bool video, Streams &streams)
+    {
+        // stsd: version/flags, entry count, then the first sample entry
+        const uint8_t *p = reader.get(stsd.payload + 8, 36);
+        if (!p || stsd.end - stsd.payload < 44)
+            return;
+        std::string codec = lookupCodec(mp4Codecs, fourccName(p + 4));
+        if (video)
+        {
+            if (streams.videoCodec.empty())
+                streams.videoCodec = codec;
+            return;
+        }
+        if (!streams.audioCodec.empty())
+            return;
+
+        streams.audioCodec = codec;
+        uint16_t version = readBE16(p + 16);
+        streams.channels = readBE16(p + 24);
+        streams.sampleRate = readBE16(p + 32); // 16.16 fixed point
+        if (version == 2)
+        {
+            // QuickTime sound description v2: float64 rate and 32-bit channel count
+            const uint8_t *v2 = reader.get(stsd.payload + 8 + 40, 12);
+            if (v2)
+            {
+                streams.sampleRate = static_cast<int>(readBEDouble(v2));
+                streams.channels = static_cast<int>(readBE32(v2 + 8));
+            }
+        }
+    }
+
+    void readTrak(BlockReader &reader, const Box &trak, Streams &streams)
+    {
+        Box mdia, hdlr, minf, stbl, stsd;
+        if (!findBox(reader, trak.payload, trak.end, "mdia", mdia) ||
+            !findBox(reader, mdia.payload, mdia.end, "hdlr", hdlr))
+            return;
+        const uint8_t *p = reader.get(hdlr.payload + 8, 4); // after version/flags and pre_defined
+        if (!p)
+            return;
+        bool video = std::memcmp(p, "vide", 4) == 0;
+        bool audio = std::memcmp(p, "soun", 4) == 0;
+        if ((!video && !audio) ||
+            !findBox(reader, mdia.payload, mdia.end, "minf", minf) ||
+            !findBox(reader, minf.payload, minf.end, "stbl", stbl) ||
+            !findBox(reader, stbl.payload, stbl.end, "stsd", stsd))
+            return;
+        readSampleEntry(reader, stsd, video, streams);
+    }
+
+    bool probeMp4(BlockReader &reader, ContainerInfo &info)
+    {
+        // Old QuickTime files may start with any of these instead of ftyp
+        static const char *const topLevel[] = {"ftyp", "moov", "mdat", "free", "skip", "wide", "pnot"};
+        const uint8_t *p = reader.get(4, 4);
+        if (!p)
+            return false;
+        bool known = false;
+        for (const char *type : topLevel)
+            known = known || std::memcmp(p, type, 4) == 0;
+        if (!known)
+            return false;
+
+        // moov may follow mdat; the payload is stepped over by its size, never read
+        Box moov;
+        if (!findBox(reader, 0, reader.size(), "moov", moov))
+            return false;
+
+        Streams streams;
+        Box child;
+        for (uint64_t offset = moov.payload; offset + 8 <= moov.end; offset = child.end)
+        {
+            if (!readBox(reader, offset, moov.end, child))
+                break;
+            if (isBox(child, "mvhd"))
+            {
+                p = reader.get(child.payload, 32);
+                if (!p)
+                    return false;
+                bool version1 = p[0] == 1;
+                uint32_t timescale = readBE32(p + (version1 ? 20 : 12));
+                uint64_t duration = version1 ? readBE64(p + 24) : readBE32(p + 16);
+                if (timescale)
+                    streams.duration = static_cast<double>(duration) / timescale;
+            }
+            else if (isBox(child, "trak"))
+            {
+                readTrak(reader, child, streams);
+            }
+        }
+
+        finish(streams, reader.size(), info);
+        return true;
+    }
+
+    // Matroska / WebM
+    const uint32_t ebmlHeaderId = 0x1A45DFA3;
+    const uint32_t segmentId = 0x18538067;
+    const uint32_t seekHeadId = 0x114D9B74;
+    const uint32_t seekId = 0x4DBB;
+    const uint32_t seekIdId = 0x53AB;
+    const uint32_t seekPositionId = 0x53AC;
+    const uint32_t infoId = 0x1549A966;
+    const uint32_t timecodeScaleId = 0x2AD7B1;
+    const uint32_t durationId = 0x4489;
+    const uint32_t titleId = 0x7BA9;
+    const uint32_t tracksId = 0x1654AE6B;
+    const uint32_t trackEntryId = 0xAE;
+    const uint32_t trackTypeId = 0x83;
+    const uint32_t codecIdId = 0x86;
+    const uint32_t audioId = 0xE1;
+    const uint32_t samplingFrequencyId = 0xB5;
+    const uint32_t channelsId = 0x9F;
+    const uint32_t clusterId = 0x1F43B675;
+
+    const CodecName matroskaCodecs[] = {
+        {"V_MPEG4/ISO/AVC", "H.264"}, {"V_MPEGH/ISO/HEVC", "HEVC"}, {"V_AV1", "AV1"}, {"V_VP8", "VP8"},
+        {"V_VP9", "VP9"}, {"V_MPEG4/ISO/", "MPEG-4 Visual"}, {"V_MPEG4/MS/V3", "MS MPEG-4 v3"},
+        {"V_MPEG2", "MPEG-2"}, {"V_MPEG1", "MPEG-1"}, {"V_THEORA", "Theora"}, {"V_MJPEG", "Motion JPEG"},
+        {"V_PRORES", "ProRes"}, {"A_AAC", "AAC"}, {"A_OPUS", "Opus"}, {"A_VORBIS", "Vorbis"}, {"A_AC3", "AC-3"},
+        {"A_EAC3", "E-AC-3"}, {"A_DTS", "DTS"}, {"A_FLAC", "FLAC"}, {"A_MPEG/L3", "MP3"}, {"A_MPEG/L2", "MP2"},
+        {"A_TRUEHD", "TrueHD"}, {"A_PCM/", "PCM"}};
+
+    struct Element
+    {
+        uint32_t id;
+        uint64_t data;
+        uint64_t end;
+        uint64_t size;
+        bool unknownSize;
+    };
+
+    // EBML variable length integer; ids keep their length marker, sizes do not
+    bool readVint(BlockReader &reader, uint64_t offset, size_t maxLength, bool keepMarker, uint64_t &value, size_t &length,
+                  bool &allOnes)
+    {
+        const uint8_t *p = reader.get(offset, 1);
+        if (!p || p[0] == 0)
+            return false;
+        length = 1;
+        while (!(p[0] & (0x80 >> (length - 1))))
+            length++;
+        if (length > maxLength)
+            return false;
+        p = reader.get(offset, length);
+        if (!p)
+            return false;
+
+        uint8_t marker = 0x80 >> (length - 1);
+        value = keepMarker ? p[0] : p[0] & (marker - 1);
+        allOnes = (p[0] & (marker - 1)) == marker - 1;
+        for (size_t i = 1; i < length; ++i)
+        {
+            value = (value << 8) | p[i];
+            allOnes = allOnes && p[i] == 0xFF;
+        }
+        return true;
+    }
+
+    bool readElement(BlockReader &reader, uint64_t offset, uint64_t limit, Element &element)
+    {
+        uint64_t id, size;
+        size_t idLength, sizeLength;
+        bool allOnes;
+        if (!readVint(reader, offset, 4, true, id, idLength, allOnes) ||
+            !readVint(reader, offset + idLength, 8, false, size, sizeLength, allOnes))
+            return false;
+
+        element.id = static_cast<uint32_t>(id);
+        element.data = offset + idLength + sizeLength;
+        element.unknownSize = allOnes;
+        if (element.data > limit)
+            return false;
+        if (allOnes)
+            size = limit - element.data; // live streams: up to the end of the parent
+        else if (size > limit - element.data)
+            return false;
+        element.size = size;
+        element.end = element.data + size;
+        return true;
+    }
+
+    uint64_t readUnsigned(BlockReader &reader, const Element &element)
+    {
+        const uint8_t *p = element.size <= 8 ? reader.get(element.data, element.size) : nullptr;
+        uint64_t value = 0;
+        for (size_t i = 0; p && i < element.size; ++i)
+            value = (value << 8) | p[i];
+        return value;
+    }
+
+    double readFloat(BlockReader &reader, const Element &element)
+    {
+        const uint8_t *p = reader.get(element.data, element.size);
+        if (p && element.size == 4)
+            return readBEFloat(p);
+        if (p && element.size == 8)
+            return readBEDouble(p);
+        return 0;
+    }
+
+    std::string readString(BlockReader &reader, const Element &element)
+    {
+        size_t length = static_cast<size_t>(std::min<uint64_t>(element.size, maxStringSize));
+        const uint8_t *p = reader.get(element.data, length);
+        if (!p)
+            return std::string();
+        std::string text(reinterpret_cast<const char *>(p), length);
+        return text.substr(0, text.find('\0'));
+    }
+
+    // Calls visit for each child of [begin, end) until it returns false
+    template <typename Visit>
+    void forEachElement(BlockReader &reader, uint64_t begin, uint64_t end, Visit visit)
+    {
+        Element element;
+        for (uint64_t offset = begin; offset < end; offset = element.end)
+        {
+            if (!readElement(reader, offset, end, element) || !visit(element))
+                return;
+        }
+    }
+
+    void readInfo(BlockReader &reader, const Element &info, std::string &title, Streams &streams)
+    {
+        uint64_t timecodeScale = 1000000; // ns, the default when absent
+        double duration = 0;
+        forEachElement(reader, info.data, info.end,
+                       [&](const Element &child)
+                       {
+                           if (child.id == timecodeScaleId)
+                               timecodeScale = readUnsigned(reader, child);
+                           else if (child.id == durationId)
+                               duration = readFloat(reader, child);
+                           else if (child.id == titleId)
+                               title = readString(reader, child);
+                           return true;
+                       });
+        streams.duration = duration * timecodeScale / 1e9;
+    }
+
+    void readTracks(BlockReader &reader, const Element &tracks, Streams &streams)
+    {
+        forEachElement(reader, tracks.data, tracks.end,
+                       [&](const Element &entry)
+                       {
+                           if (entry.id != trackEntryId)
+                               return true;
+
+                           uint64_t type = 0;
+                           std::string codec;
+                           Element audio{};
+                           forEachElement(reader, entry.data, entry.end,
+                                          [&](const Element &child)
+                                          {
+                                              if (child.id == trackTypeId)
+                                                  type = readUnsigned(reader, child);
+                                              else if (child.id == codecIdId)
+                                                  codec = lookupCodec(matroskaCodecs, readString(reader, child), true);
+                                              else if (child.id == audioId)
+                                                  audio = child;
+                                              return true;
+                                          });
+
+                           if (type == 1 && streams.videoCodec.empty())
+                           {
+                               streams.videoCodec = codec;
+                           }
+                           else if (type == 2 && streams.audioCodec.empty())
+                           {
+                               streams.audioCodec = codec;
+                               streams.channels = 1; // Matroska default
+                               streams.sampleRate = 8000;
+                               forEachElement(reader, audio.data, audio.end,
+                                              [&](const Element &child)
+                                              {
+                                                  if (child.id == samplingFrequencyId)
+                                                      streams.sampleRate = static_cast<int>(readFloat(reader, child));
+                                                  else if (child.id == channelsId)
+                                                      streams.channels = static_cast<int>(readUnsigned(reader, child));
+                                                  return true;
+                                              });
+                           }
+                           return true;
+                       });
+    }
+
+    bool probeMatroska(BlockReader &reader, ContainerInfo &info)
+    {
+        Element header, segment;
+        if (!readElement(reader, 0, reader.size(), header) || header.id != ebmlHeaderId)
+            return false;
+
+        bool found = false;
+        forEachElement(reader, header.end, reader.size(),
+                       [&](const Element &element)
+                       {
+                           found = element.id == segmentId;
+                           if (found)
+                               segment = element;
+                           return !found;
+                       });
+        if (!found)
+            return false;
+
+        // Info and Tracks normally come before the clusters; otherwise the SeekHead points to them
+        Streams streams;
+        bool haveInfo = false, haveTracks = false;
+        uint64_t infoPosition = 0, tracksPosition = 0;
+        forEachElement(reader, segment.data, segment.end,
+                       [&](const Element &element)
+                       {
+                           if (element.id == seekHeadId)
+                           {
+                               forEachElement(reader, element.data, element.end,
+                                              [&](const Element &seek)
+                                              {
+                                                  if (seek.id != seekId)
+                                                      return true;
+                                                  uint64_t id = 0, position = 0;
+                                                  forEachElement(reader, seek.data, seek.end,
+                                                                 [&](const Element &child)
+                                                                 {
+                                                                     if (child.id == seekIdId)
+                                                                         id = readUnsigned(reader, child);
+                                                                     else if (child.id == seekPositionId)
+                                                                         position = readUnsigned(reader, child);
+                                                                     return true;
+                                                                 });
+                                                  if (id == infoId)
+                                                      infoPosition = position;
+                                                  else if (id == tracksId)
+                                                      tracksPosition = position;
+                                                  return true;
+                                              });
+                           }
+                           else if (element.id == infoId)
+                           {
+                               readInfo(reader, element, info.title, streams);
+                               haveInfo = true;
+                           }
+                           else if (element.id == tracksId)
+                           {
+                               readTracks(reader, element, streams);
+                               haveTracks = true;
+                           }
+                           // Never walk into the clusters, they hold the media
+                           return element.id != clusterId && !element.unknownSize && !(haveInfo && haveTracks);
+                       });
+
+        Element element;
+        if (!haveInfo && infoPosition && readElement(reader, segment.data + infoPosition, segment.end, element) &&
+            element.id == infoId)
+        {
+            readInfo(reader, element, info.title, streams);
+            haveInfo = true;
+        }
+        if (!haveTracks && tracksPosition && readElement(reader, segment.data + tracksPosition, segment.end, element) &&
+            element.id == tracksId)
+        {
+            readTracks(reader, element, streams);
+            haveTracks = true;
+        }
+        if (!haveInfo && !haveTracks)
+            return false;
+
+        finish(streams, reader.size(), info);
+        return true;
+    }
+
+    // AVI
+    const CodecName aviVideoCodecs[] = {
+        {"H264", "H.264"}, {"X264", "H.264"}, {"AVC1", "H.264"}, {"HEVC", "HEVC"}, {"H265", "HEVC"},
+        {"XVID", "MPEG-4 Visual"}, {"DIVX", "MPEG-4 Visual"}, {"DX50", "MPEG-4 Visual"}, {"FMP4", "MPEG-4 Visual"},
+        {"MP4V", "MPEG-4 Visual"}, {"DIV3", "MS MPEG-4 v3"}, {"MP43", "MS MPEG-4 v3"}, {"MJPG", "Motion JPEG"},
+        {"MPG2", "MPEG-2"}, {"VP80", "VP8"}, {"VP90", "VP9"}, {"AV01", "AV1"}, {"WMV3", "WMV9"}};
+
+    std::string aviAudioCodec(uint16_t formatTag)
+    {
+        switch (formatTag)
+        {
+        case 0x0001:
+            return "PCM";
+        case 0x0050:
+            return "MP2";
+        case 0x0055:
+            return "MP3";
+        case 0x00FF:
+        case 0x1610:
+        case 0x706D:
+            return "AAC";
+        case 0x0161:
+            return "WMA";
+        case 0x2000:
+            return "AC-3";
+        case 0x2001:
+            return "DTS";
+        default:
+        {
+            // Unlisted WAVE format tags are shown as their hex value, e.g. "0x0160"
+            static const char digits[] = "0123456789ABCDEF";
+            std::string name = "0x";
+            for (int shift = 12; shift >= 0; shift -= 4)
+                name += digits[(formatTag >> shift) & 0xF];
+            return name;
+        }
+        }
+    }
+
+    struct Chunk
+    {
+        char id[4];
+        uint64_t data;
+        uint64_t end; // next chunk, after the pad byte
+        uint32_t size;
+    };
+
+    bool readChunk(BlockReader &reader, uint64_t offset, uint64_t limit, Chunk &chunk)
+    {
+        const uint8_t *p = reader.get(offset, 8);
+        if (!p || limit - offset < 8)
+            return false;
+        std::memcpy(chunk.id, p, 4);
+        chunk.size = readLE32(p + 4);
+        chunk.data = offset + 8;
+        chunk.end = std::min<uint64_t>(chunk.data + chunk.size + (chunk.size & 1), limit);
+        return true;
+    }
+
+    // A LIST chunk of the given list type
+    bool isList(BlockReader &reader, const Chunk &chunk, const char *type)
+    {
+        if (std::memcmp(chunk.id, "LIST", 4) != 0 || chunk.size < 4)
+            return false;
+        const uint8_t *p = reader.get(chunk.data, 4);
+        return p && std::memcmp(p, type, 4) == 0;
+    }
+
+    void readStreamList(BlockReader &reader, const Chunk &strl, Streams &streams)
+    {
+        char type[4] = {};
+        std::string handler;
+        double length = 0;
+        Chunk chunk;
+        for (uint64_t offset = strl.data + 4; offset + 8 <= strl.end; offset = chunk.end)
+        {
+            if (!readChunk(reader, offset, strl.end, chunk))
+                return;
+            if (!std::memcmp(chunk.id, "strh", 4) && chunk.size >= 36)
+            {
+                const uint8_t *p = reader.get(chunk.data, 36);
+                if (!p)
+                    return;
+                std::memcpy(type, p, 4);
+                handler = fourccName(p + 4);
+                uint32_t scale = readLE32(p + 20);
+                uint32_t rate = readLE32(p + 24);
+                if (rate)
+                    length = static_cast<double>(readLE32(p + 32)) * scale / rate;
+            }
+            else if (!std::memcmp(chunk.id, "strf", 4) && !std::memcmp(type, "vids", 4) && chunk.size >= 20)
+            {
+                const uint8_t *p = reader.get(chunk.data, 20);
+                if (p && streams.videoCodec.empty())
+                {
+                    // BITMAPINFOHEADER biCompression, the stream handler when it is not a fourcc
+                    std::string fourcc = fourccName(p + 16);
+                    if (fourcc.size() < 4)
+                        fourcc = handler;
+                    for (auto &c : fourcc)
+                        c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+                    streams.videoCodec = lookupCodec(aviVideoCodecs, fourcc);
+                    streams.duration = length;
+                }
+            }
+            else if (!std::memcmp(chunk.id, "strf", 4) && !std::memcmp(type, "auds", 4) && chunk.size >= 8)
+            {
+                const uint8_t *p = reader.get(chunk.data, 8);
+                if (p && streams.audioCodec.empty())
+                {
+                    // WAVEFORMATEX
+                    streams.audioCodec = aviAudioCodec(readLE16(p));
+                    streams.channels = readLE16(p + 2);
+                    streams.sampleRate = static_cast<int>(readLE32(p + 4));
+                    if (streams.duration == 0)
+                        streams.duration = length;
+                }
+            }
+        }
+    }
+
+    bool probeAvi(BlockReader &reader, ContainerInfo &info)
+    {
+        const uint8_t *p = reader.get(0, 12);
+        if (!p || std::memcmp(p, "RIFF", 4) != 0 || std::memcmp(p + 8, "AVI ", 4) != 0)
+            return false;
+
+        // hdrl is the first list; movi with the frames follows and is not read
+        Chunk hdrl;
+        uint64_t offset = 12;
+        do
+        {
+            if (!readChunk(reader, offset, reader.size(), hdrl))
+                return false;
+            offset = hdrl.end;
+        } while (!isList(reader, hdrl, "hdrl"));
+
+        Streams streams;
+        uint32_t microSecPerFrame = 0;
+        uint32_t totalFrames = 0;
+        Chunk chunk;
+        for (offset = hdrl.data + 4; offset + 8 <= hdrl.end; offset = chunk.end)
+        {
+            if (!readChunk(reader, offset, hdrl.end, chunk))
+                break;
+            if (!std::memcmp(chunk.id, "avih", 4) && chunk.size >= 20)
+            {
+                p = reader.get(chunk.data, 20);
+                if (!p)
+                    return false;
+                microSecPerFrame = readLE32(p);
+                totalFrames = std::max(totalFrames, readLE32(p + 16));
+            }
+            else if (isList(reader, chunk, "strl"))
+            {
+                readStreamList(reader, chunk, streams);
+            }
+            else if (isList(reader, chunk, "odml"))
+            {
+                // OpenDML files over 1 GB count all frames only here
+                Chunk dmlh;
+                if (readChunk(reader, chunk.data + 4, chunk.end, dmlh) && !std::memcmp(dmlh.id, "dmlh", 4) &&
+                    (p = reader.get(dmlh.data, 4)))
+                    totalFrames = std::max(totalFrames, readLE32(p));
+            }
+        }
+
+        double mainDuration = static_cast<double>(totalFrames) * microSecPerFrame / 1e6;
+        if (mainDuration > streams.duration)
+            streams.duration = mainDuration;
+        finish(streams, reader.size(), info);
+        return true;
+    }
+}
+
+bool probeContainer(const std::string &filepath, ContainerInfo &info)
+{
+    BlockReader reader(filepath);
+    if (!reader.isOpen())
+        return false;
+
+    info = ContainerInfo();
+    bool probed = probeMatroska(reader, info) || probeAvi(reader, info) || probeMp4(reader, info);
+    info.bytesRead = reader.getBytesRead();
+    return probed;
+}
@@ -0,0 +1,28 @@
+#ifndef CONTAINER_PROBE_H
+#define CONTAINER_PROBE_H
+
+#include <string>
+#include <cstdint>
+
+// Stream properties of a video file, as MetadataManager stores them
+struct ContainerInfo
+{
+    std::string title; // Matroska segment title, empty for other containers
+    std::string codec; // video codec, then audio codec: "H.264, AAC"
+    int duration = 0;  // in seconds
+    int bitrate = 0;   // overall, kbps
+    int channels = 0;  // of the first audio track
+    int sampleRate = 0;
+    uint64_t bytesRead = 0; // I/O the probe cost
+};
+
+// Reads the stream headers of a video container without touching the media payload:
+//   MP4/MOV: moov/mvhd and each trak's hdlr and stsd (mdat is skipped, wherever it is)
+//   Matroska/WebM: the Segment Info and Tracks elements, found through the SeekHead
+//                  when they come after the first Cluster
+//   AVI: the avih, strh and strf chunks of the hdrl list (dmlh for OpenDML files)
+// Only box and element headers are read with pread, a few KB for any file size.
+// Returns false for other formats and for damaged headers.
+bool probeContainer(const std::string &filepath, ContainerInfo &info);
+
+#endif // CONTAINER_PROBE_H
@@ -0,0 +1,490 @@
+#include "cover_art.h"
+#include "block_reader.h"
+#include "binary_io.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <cstdio>
+#include <filesystem>
+
+// Thumbnail file layout:
+//   magic "MPTH", u32 version, u32 width, u32 height, width * height * 4 bytes RGBA
+static const char thumbnailMagic[4] = {'M', 'P', 'T', 'H'};
+static const uint32_t thumbnailVersion = 1;
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    const size_t maxPictureSize = 16 * 1024 * 1024;
+    const uint32_t frontCover = 3; // ID3v2 / FLAC picture type
+
+    uint32_t readBE32(const uint8_t *p) { return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3]; }
+    uint32_t readLE32(const uint8_t *p) { return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24); }
+    uint32_t readSyncsafe(const uint8_t *p) { return (uint32_t(p[0]) << 21) | (uint32_t(p[1]) << 14) | (uint32_t(p[2]) << 7) | p[3]; }
+
+    // Keeps the first front cover, or the first picture when there is no front cover
+    struct PictureChoice
+    {
+        std::string image;
+        bool found = false;
+        bool front = false;
+
+        void offer(const uint8_t *data, size_t length, uint32_t type)
+        {
+            if (length == 0 || (found && (front || type != frontCover)))
+                return;
+            image.assign(reinterpret_cast<const char *>(data), length);
+            found = true;
+            front = type == frontCover;
+        }
+    };
+
+    std::string decodeBase64(const char *text, size_t length)
+    {
+        auto value = [](char c) -> int
+        {
+            if (c >= 'A' && c <= 'Z')
+                return c - 'A';
+            if (c >= 'a' && c <= 'z')
+                return c - 'a' + 26;
+            if (c >= '0' && c <= '9')
+                return c - '0' + 52;
+            if (c == '+')
+                return 62;
+            if (c == '/')
+                return 63;
+            return -1;
+        };
+
+        std::string out;
+        out.reserve(length / 4 * 3);
+        uint32_t bits = 0;
+        int count = 0;
+        for (size_t i = 0; i < length; ++i)
+        {
+            int v = value(text[i]);
+            if (v < 0)
+                continue; // padding and line breaks
+            bits = (bits << 6) | static_cast<uint32_t>(v);
+            if (++count == 4)
+            {
+                out += static_cast<char>(bits >> 16);
+                out += static_cast<char>(bits >> 8);
+                out += static_cast<char>(bits);
+                bits = 0;
+                count = 0;
+            }
+        }
+        if (count == 3)
+        {
+            out += static_cast<char>(bits >> 10);
+            out += static_cast<char>(bits >> 2);
+        }
+        else if (count == 2)
+        {
+            out += static_cast<char>(bits >> 4);
+        }
+        return out;
+    }
+
+    // FLAC PICTURE block body, also the content of METADATA_BLOCK_PICTURE comments
+    void parsePictureBlock(const uint8_t *data, size_t length, PictureChoice &choice)
+    {
+        if (length < 8)
+            return;
+        uint32_t type = readBE32(data);
+        uint64_t pos = 8 + uint64_t(readBE32(data + 4)); // after the MIME type
+        if (pos + 4 > length)
+            return;
+        pos += 4 + uint64_t(readBE32(data + pos)); // after the description
+        pos += 16;                                 // width, height, depth, colours
+        if (pos + 4 > length)
+            return;
+        uint32_t dataLength = readBE32(data + pos);
+        pos += 4;
+        if (pos + dataLength <= length)
+            choice.offer(data + pos, dataLength, type);
+    }
+
+    void parseCommentPictures(const uint8_t *data, size_t length, PictureChoice &choice)
+    {
+        if (length < 8)
+            return;
+        uint64_t pos = 4 + uint64_t(readLE32(data));
+        if (pos + 4 > length)
+            return;
+        uint32_t count = readLE32(data + pos);
+        pos += 4;
+
+        static const char pictureKey[] = "METADATA_BLOCK_PICTURE=";
+        static const char legacyKey[] = "COVERART="; // base64 of the image itself
+        for (uint32_t i = 0; i < count && pos + 4 <= length; ++i)
+        {
+            uint32_t entryLength = readLE32(data + pos);
+            pos += 4;
+            if (pos + entryLength > length)
+                return;
+            const char *entry = reinterpret_cast<const char *>(data + pos);
+            pos += entryLength;
+
+            auto hasKey = [&](const char *key, size_t keyLength)
+            {
+                if (entryLength < keyLength)
+                    return false;
+                for (size_t k = 0; k < keyLength; ++k)
+                {
+                    if (std::toupper(static_cast<unsigned char>(entry[k])) != key[k])
+                        return false;
+                }
+                return true;
+            };
+            if (hasKey(pictureKey, sizeof(pictureKey) - 1))
+            {
+                std::string block = decodeBase64(entry + sizeof(pictureKey) - 1, entryLength - (sizeof(pictureKey) - 1));
+                parsePictureBlock(reinterpret_cast<const uint8_t *>(block.data()), block.size(), choice);
+            }
+            else if (hasKey(legacyKey, sizeof(legacyKey) - 1))
+            {
+                std::string image = decodeBase64(entry + sizeof(legacyKey) - 1, entryLength - (sizeof(legacyKey) - 1));
+                choice.offer(reinterpret_cast<const uint8_t *>(image.data()), image.size(), frontCover);
+            }
+        }
+    }
+
+    // Size of the ID3v2 tag at the start of the file, 0 when there is none
+    uint64_t id3v2Size(BlockReader &reader)
+    {
+        const uint8_t *header = reader.get(0, 10);
+        if (!header || std::memcmp(header, "ID3", 3) != 0)
+            return 0;
+        return 10 + uint64_t(readSyncsafe(header + 6)) + ((header[5] & 0x10) ? 10 : 0);
+    }
+
+    void readApic(BlockReader &reader, PictureChoice &choice)
+    {
+        const uint8_t *header = reader.get(0, 10);
+        if (!header || std::memcmp(header, "ID3", 3) != 0)
+            return;
+        int major = header[3];
+        uint8_t flags = header[5];
+        if ((major != 3 && major != 4) || (flags & 0x80))
+            return; // ID3v2.2 or unsynchronised
+        uint64_t end = 10 + uint64_t(readSyncsafe(header + 6));
+
+        uint64_t pos = 10;
+        if (flags & 0x40)
+        {
+            const uint8_t *ext = reader.get(pos, 4);
+            if (!ext)
+                return;
+            pos += major == 4 ? readSyncsafe(ext) : readBE32(ext) + 4;
+        }
+
+        // Compressed, encrypted, grouped or unsynchronised frames are skipped
+        const uint8_t unsupported = major == 4 ? 0x4E : 0xE0;
+        while (pos + 10 <= end)
+        {
+            const uint8_t *frame = reader.get(pos, 10);
+            if (!frame || frame[0] == 0)
+                return;
+            bool apic = std::memcmp(frame, "APIC", 4) == 0;
+            uint32_t size = major == 4 ? readSyncsafe(frame + 4) : readBE32(frame + 4);
+            uint8_t frameFlags = frame[9];
+            uint64_t body = pos + 10;
+            pos = body + size;
+            if (pos > end)
+                return;
+            if (!apic || (frameFlags & unsupported) || size > maxPictureSize)
+                continue;
+            if (major == 4 && (frameFlags & 0x01))
+            {
+                // Data length indicator
+                if (size < 4)
+                    continue;
+                body += 4;
+                size -= 4;
+            }
+
+            const uint8_t *data = reader.get(body, size);
+            if (!data || size < 4)
+                continue;
+            uint8_t encoding = data[0];
+            const uint8_t *mimeEnd = static_cast<const uint8_t *>(std::memchr(data + 1, 0, size - 1));
+            if (!mimeEnd || mimeEnd + 2 > data + size)
+                continue;
+            uint32_t type = mimeEnd[1];
+            size_t desc = mimeEnd + 2 - data;
+
+            // The description ends with one zero byte, or two aligned ones in UTF-16
+            size_t picture = 0;
+            if (encoding == 1 || encoding == 2)
+            {
+                for (size_t i = desc; i + 1 < size; i += 2)
+                {
+                    if (data[i] == 0 && data[i + 1] == 0)
+                    {
+                        picture = i + 2;
+                        break;
+                    }
+                }
+            }
+            else
+            {
+                const uint8_t *descEnd = static_cast<const uint8_t *>(std::memchr(data + desc, 0, size - desc));
+                picture = descEnd ? descEnd + 1 - data : 0;
+            }
+            if (picture > 0 && picture < size)
+                choice.offer(data + picture, size - picture, type);
+        }
+    }
+
+    void readFlacPictures(BlockReader &reader, uint64_t offset, PictureChoice &choice)
+    {
+        const uint8_t *magic = reader.get(offset, 4);
+        if (!magic || std::memcmp(magic, "fLaC", 4) != 0)
+            return;
+
+        uint64_t pos = offset + 4;
+        while (true)
+        {
+            const uint8_t *header = reader.get(pos, 4);
+            if (!header)
+                return;
+            bool last = header[0] & 0x80;
+            uint8_t type = header[0] & 0x7F;
+            uint32_t length = (uint32_t(header[1]) << 16) | (uint32_t(header[2]) << 8) | header[3];
+            pos += 4;
+            if ((type == 6 || type == 4) && length <= maxPictureSize)
+            {
+                const uint8_t *data = reader.get(pos, length);
+                if (data && type == 6)
+                    parsePictureBlock(data, length, choice);
+                else if (data)
+                    parseCommentPictures(data, length, choice);
+            }
+            pos += length;
+            if (last)
+                return;
+        }
+    }
+
+    void readOggPictures(BlockReader &reader, PictureChoice &choice)
+    {
+        std::vector<uint8_t> packets[2];
+        uint32_t serial;
+        if (!readOggHeaderPackets(reader, packets, 2, maxPictureSize, serial))
+            return;
+
+        const std::vector<uint8_t> &comment = packets[1];
+        if (comment.size() >= 7 && std::memcmp(comment.data(), "\x03vorbis", 7) == 0)
+            parseCommentPictures(comment.data() + 7, comment.size() - 7, choice);
+        else if (comment.size() >= 8 && std::memcmp(comment.data(), "OpusTags", 8) == 0)
+            parseCommentPictures(comment.data() + 8, comment.size() - 8, choice);
+    }
+
+    // Payload [begin, end) of the first box of the given type within [begin, end)
+    bool findMp4Box(BlockReader &reader, uint64_t &begin, uint64_t &end, const char *type)
+    {
+        uint64_t pos = begin;
+        while (pos + 8 <= end)
+        {
+            const uint8_t *header = reader.get(pos, 8);
+            if (!header)
+                return false;
+            uint64_t size = readBE32(header);
+            uint64_t headerSize = 8;
+            if (size == 1)
+            {
+                header = reader.get(pos, 16);
+                if (!header)
+                    return false;
+                size = (uint64_t(readBE32(header + 8)) << 32) | readBE32(header + 12);
+                headerSize = 16;
+            }
+            else if (size == 0)
+            {
+                size = end - pos;
+            }
+            if (size < headerSize || size > end - pos)
+                return false;
+            if (std::memcmp(header + 4, type, 4) == 0)
+            {
+                begin = pos + headerSize;
+                end = pos + size;
+                return true;
+            }
+            pos += size;
+        }
+        return false;
+    }
+
+    void readMp4Cover(BlockReader &reader, PictureChoice &choice)
+    {
+        const uint8_t *head = reader.get(4, 4);
+        if (!head || std::memcmp(head, "ftyp", 4) != 0)
+            return;
+
+        uint64_t begin = 0, end = reader.size();
+        if (!findMp4Box(reader, begin, end, "moov") || !findMp4Box(reader, begin, end, "udta") ||
+            !findMp4Box(reader, begin, end, "meta"))
+            return;
+        // meta is a full box in MP4 (version and flags first), a plain one in QuickTime
+        const uint8_t *child = reader.get(begin + 4, 4);
+        if (child && std::memcmp(child, "hdlr", 4) != 0)
+            begin += 4;
+        if (!findMp4Box(reader, begin, end, "ilst") || !findMp4Box(reader, begin, end, "covr") ||
+            !findMp4Box(reader, begin, end, "data") || end - begin < 8 || end - begin - 8 > maxPictureSize)
+            return;
+
+        // data: type and locale, then the image
+        const uint8_t *image = reader.get(begin + 8, end - begin - 8);
+        if (image)
+            choice.offer(image, end - begin - 8, frontCover);
+    }
+}
+
+bool readEmbeddedCoverArt(const std::string &filepath, std::string &image)
+{
+    BlockReader reader(filepath);
+    if (!reader.isOpen())
+        return false;
+
+    PictureChoice choice;
+    const uint8_t *head = reader.get(0, 4);
+    if (head && !std::memcmp(head, "OggS", 4))
+    {
+        readOggPictures(reader, choice);
+    }
+    else
+    {
+        readApic(reader, choice);
+        if (!choice.front)
+            readFlacPictures(reader, id3v2Size(reader), choice);
+        if (!choice.found)
+            readMp4Cover(reader, choice);
+    }
+
+    if (!choice.found)
+        return false;
+    image.swap(choice.image);
+    return true;
+}
+
+std::string findFolderCoverArt(const std::string &directory)
+{
+    static const char *const names[] = {"cover", "folder", "front", "albumart"};
+    static const char *const extensions[] = {".jpg", ".jpeg", ".png"};
+
+    std::string best;
+    size_t bestRank = sizeof(names) / sizeof(names[0]);
+    std::error_code ec;
+    for (fs::directory_iterator it(fs::u8path(directory), ec), end; !ec && it != end; it.increment(ec))
+    {
+        std::string name = it->path().filename().u8string();
+        for (auto &c : name)
+            c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+
+        for (size_t rank = 0; rank < bestRank; ++rank)
+        {
+            for (const char *extension : extensions)
+            {
+                if (name == std::string(names[rank]) + extension)
+                {
+                    best = it->path().u8string();
+                    bestRank = rank;
+                }
+            }
+        }
+    }
+    return best;
+}
+
+uint64_t hashCoverArt(const std::string &image)
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : image)
+        hash = (hash ^ c) * 1099511628211ull;
+    return hash;
+}
+
+Thumbnail downscaleThumbnail(const uint8_t *pixels, int width, int height, int pitch, int maxSize)
+{
+    Thumbnail thumbnail;
+    if (width <= 0 || height <= 0)
+        return thumbnail;
+
+    int longest = std::max(width, height);
+    thumbnail.width = longest > maxSize ? std::max(1, width * maxSize / longest) : width;
+    thumbnail.height = longest > maxSize ? std::max(1, height * maxSize / longest) : height;
+    thumbnail.pixels.resize(size_t(thumbnail.width) * thumbnail.height * 4);
+
+    // Each target pixel is the average of the source pixels it covers
+    uint8_t *out = thumbnail.pixels.data();
+    for (int ty = 0; ty < thumbnail.height; ++ty)
+    {
+        int y0 = ty * height / thumbnail.height;
+        int y1 = std::max(y0 + 1, (ty + 1) * height / thumbnail.height);
+        for (int tx = 0; tx < thumbnail.width; ++tx)
+        {
+            int x0 = tx * width / thumbnail.width;
+            int x1 = std::max(x0 + 1, (tx + 1) * width / thumbnail.width);
+            uint32_t sum[4] = {0, 0, 0, 0};
+            for (int y = y0; y < y1; ++y)
+            {
+                const uint8_t *row = pixels + size_t(y) * pitch;
+                for (int x = x0; x < x1; ++x)
+                {
+                    for (int c = 0; c < 4; ++c)
+                        sum[c] += row[x * 4 + c];
+                }
+            }
+            uint32_t count = uint32_t(y1 - y0) * uint32_t(x1 - x0);
+            for (int c = 0; c < 4; ++c)
+                *out++ = static_cast<uint8_t>(sum[c] / count);
+        }
+    }
+    return thumbnail;
+}
+
+// ThumbnailCache implementation
+ThumbnailCache::ThumbnailCache(const std::string &directory) : directory(directory)
+{
+}
+
+std::string ThumbnailCache::pathFor(uint64_t hash) const
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.thumb", static_cast<unsigned long long>(hash));
+    return directory + "/" + name;
+}
+
+bool ThumbnailCache::load(uint64_t hash, Thumbnail &thumbnail) const
+{
+    std::string buffer;
+    if (!readBinaryFile(pathFor(hash), buffer))
+        return false;
+
+    BinaryReader reader(buffer);
+    uint32_t version, width, height;
+    if (!reader.getMagic(thumbnailMagic) || !reader.get(version) || version != thumbnailVersion ||
+        !reader.get(width) || !reader.get(height) || width > thumbnailSize || height > thumbnailSize ||
+        !reader.getArray(thumbnail.pixels, size_t(width) * height * 4))
+        return false;
+    thumbnail.width = static_cast<int>(width);
+    thumbnail.height = static_cast<int>(height);
+    return true;
+}
+
+bool ThumbnailCache::store(uint64_t hash, const Thumbnail &thumbnail) const
+{
+    BinaryWriter writer;
+    writer.putMagic(thumbnailMagic);
+    writer.put<uint32_t>(thumbnailVersion);
+    writer.put<uint32_t>(static_cast<uint32_t>(thumbnail.width));
+    writer.put<uint32_t>(static_cast<uint32_t>(thumbnail.height));
+    writer.putArray(thumbnail.pixels);
+    return writeBinaryFile(pathFor(hash), writer.data());
+}
@@ -0,0 +1,52 @@
+#ifndef COVER_ART_H
+#define COVER_ART_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// A decoded picture, 8-bit RGBA with packed rows
+struct Thumbnail
+{
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> pixels;
+};
+
+constexpr int thumbnailSize = 128; // longest side of a cached thumbnail
+
+// The embedded cover of an audio file, still encoded (JPEG, PNG, ...):
+//   MP3: ID3v2.3/2.4 APIC frame
+//   FLAC: PICTURE block, or a METADATA_BLOCK_PICTURE comment
+//   Ogg Vorbis/Opus: METADATA_BLOCK_PICTURE comment
+//   MP4/M4A: moov/udta/meta/ilst/covr atom
+// The front cover is preferred when there are several pictures. Returns false
+// when the file has none; the audio data itself is never read.
+bool readEmbeddedCoverArt(const std::string &filepath, std::string &image);
+
+// cover, folder, front or albumart .jpg/.jpeg/.png (any case) in directory; empty when there is none
+std::string findFolderCoverArt(const std::string &directory);
+
+uint64_t hashCoverArt(const std::string &image);
+
+// Area-averaging downscale of RGBA pixels so the longest side is at most maxSize;
+// smaller pictures are copied as they are
+Thumbnail downscaleThumbnail(const uint8_t *pixels, int width, int height, int pitch, int maxSize);
+
+// Thumbnails on disk, one file per picture named after its content hash, so a
+// cover shared by every track of an album is decoded once
+class ThumbnailCache
+{
+private:
+    std::string directory;
+
+    std::string pathFor(uint64_t hash) const;
+
+public:
+    explicit ThumbnailCache(const std::string &directory);
+
+    bool load(uint64_t hash, Thumbnail &thumbnail) const;
+    bool store(uint64_t hash, const Thumbnail &thumbnail) const;
+};
+
+#endif // COVER_ART_H
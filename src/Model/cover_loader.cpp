@@ -0,0 +1,100 @@
+#include "cover_loader.h"
+#include "binary_io.h"
+
+#include <algorithm>
+#include <filesystem>
+
+// CoverArtLoader implementation
+CoverArtLoader::CoverArtLoader(Decoder decoder, const std::string &cacheDirectory)
+    : decoder(std::move(decoder)), cache(cacheDirectory), stopping(false)
+{
+    loaderThread = std::thread(&CoverArtLoader::loaderFunc, this);
+}
+
+CoverArtLoader::~CoverArtLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+        queue.clear();
+    }
+    queueCondition.notify_all();
+
+    if (loaderThread.joinable())
+        loaderThread.join();
+}
+
+void CoverArtLoader::request(const std::string &filepath)
+{
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        auto it = std::find(queue.begin(), queue.end(), filepath);
+        if (it != queue.end())
+            queue.erase(it);
+        queue.push_front(filepath);
+    }
+    queueCondition.notify_one();
+}
+
+void CoverArtLoader::clearPending()
+{
+    std::lock_guard<std::mutex> lock(queueMutex);
+    queue.clear();
+}
+
+std::vector<CoverArtLoader::Result> CoverArtLoader::takeResults()
+{
+    std::vector<Result> completed;
+    std::lock_guard<std::mutex> lock(resultMutex);
+    completed.swap(results);
+    return completed;
+}
+
+std::shared_ptr<const Thumbnail> CoverArtLoader::load(const std::string &filepath)
+{
+    std::string image;
+    if (!readEmbeddedCoverArt(filepath, image))
+    {
+        // Every track of an album shares its folder, look it up once
+        std::string directory = std::filesystem::u8path(filepath).parent_path().u8string();
+        auto it = folderCovers.find(directory);
+        if (it == folderCovers.end())
+            it = folderCovers.emplace(directory, findFolderCoverArt(directory)).first;
+        if (it->second.empty() || !readBinaryFile(it->second, image))
+            return nullptr;
+    }
+
+    uint64_t hash = hashCoverArt(image);
+    auto thumbnail = std::make_shared<Thumbnail>();
+    if (cache.load(hash, *thumbnail))
+        return thumbnail;
+
+    Thumbnail decoded;
+    if (!decoder || !decoder(image, decoded) || decoded.pixels.size() < size_t(decoded.width) * decoded.height * 4)
+        return nullptr;
+    *thumbnail = downscaleThumbnail(decoded.pixels.data(), decoded.width, decoded.height, decoded.width * 4, thumbnailSize);
+    cache.store(hash, *thumbnail);
+    return thumbnail;
+}
+
+void CoverArtLoader::loaderFunc()
+{
+    while (true)
+    {
+        std::string filepath;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCondition.wait(lock, [this]()
+                                { return stopping || !queue.empty(); });
+            if (stopping)
+                return;
+            filepath = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        auto thumbnail = load(filepath);
+
+        std::lock_guard<std::mutex> lock(resultMutex);
+        results.push_back({std::move(filepath), std::move(thumbnail)});
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef COVER_LOADER_H
+#define COVER_LOADER_H
+
+#include "cover_art.h"
+
+#include <deque>
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+#include <unordered_map>
+
+// Finds, decodes and downscales cover art on a background thread. A file's
+// embedded picture is used first, then a cover image in its folder. Thumbnails
+// come from the on-disk ThumbnailCache when the same picture was seen before,
+// so only new covers are decoded.
+class CoverArtLoader
+{
+public:
+    // Decodes an encoded picture to RGBA; supplied by the view layer, which owns the image library
+    using Decoder = std::function<bool(const std::string &image, Thumbnail &decoded)>;
+
+    struct Result
+    {
+        std::string filepath;
+        std::shared_ptr<const Thumbnail> thumbnail; // nullptr when the file has no cover
+    };
+
+private:
+    Decoder decoder;
+    ThumbnailCache cache;
+    std::thread loaderThread;
+
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    std::deque<std::string> queue; // newest request first
+    bool stopping;
+
+    std::mutex resultMutex;
+    std::vector<Result> results;
+
+    // Worker thread only
+    std::unordered_map<std::string, std::string> folderCovers; // directory -> cover path, "" for none
+
+    void loaderFunc();
+    std::shared_ptr<const Thumbnail> load(const std::string &filepath);
+
+public:
+    CoverArtLoader(Decoder decoder, const std::string &cacheDirectory);
+    // Drops the requests not started yet
+    ~CoverArtLoader();
+
+    // Queue loading the cover of filepath, ahead of older requests
+    void request(const std::string &filepath);
+    // Forget the requests not started yet, e.g. when the selection moves on
+    void clearPending();
+
+    // Results completed since the last call, in completion order
+    std::vector<Result> takeResults();
+};
+
+#endif // COVER_LOADER_H
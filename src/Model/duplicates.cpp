@@ -0,0 +1,264 @@
+#include "duplicates.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <fstream>
+#include <filesystem>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    constexpr uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+    constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+
+    // 64-bit multiply/rotate mixing, eight bytes per step
+    uint64_t hashBytes(uint64_t hash, const uint8_t *data, size_t length)
+    {
+        size_t i = 0;
+        for (; i + 8 <= length; i += 8)
+        {
+            uint64_t word;
+            std::memcpy(&word, data + i, sizeof(word));
+            hash ^= word * prime2;
+            hash = ((hash << 31) | (hash >> 33)) * prime1;
+        }
+        for (; i < length; ++i)
+        {
+            hash ^= data[i] * prime1;
+            hash = ((hash << 11) | (hash >> 53)) * prime2;
+        }
+        return hash;
+    }
+
+    uint64_t finalizeHash(uint64_t hash)
+    {
+        hash ^= hash >> 33;
+        hash *= prime2;
+        hash ^= hash >> 29;
+        hash *= prime1;
+        hash ^= hash >> 32;
+        return hash != 0 ? hash : 1; // 0 is reserved for "not computed"
+    }
+
+    class SampleReader
+    {
+    private:
+#ifdef _WIN32
+        std::ifstream file;
+#else
+        int fd;
+#endif
+
+    public:
+#ifdef _WIN32
+        SampleReader(const std::string &filepath) : file(std::filesystem::u8path(filepath), std::ios::binary) {}
+        bool isOpen() const { return file.is_open(); }
+
+        bool read(uint8_t *buffer, size_t length, uint64_t offset)
+        {
+            file.seekg(static_cast<std::streamoff>(offset));
+            file.read(reinterpret_cast<char *>(buffer), length);
+            return static_cast<size_t>(file.gcount()) == length;
+        }
+#else
+        SampleReader(const std::string &filepath) : fd(open(filepath.c_str(), O_RDONLY | O_CLOEXEC))
+        {
+#ifdef POSIX_FADV_RANDOM
+            // Only a few chunks are read, readahead beyond them is wasted
+            if (fd >= 0)
+                posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+#endif
+        }
+        ~SampleReader()
+        {
+            if (fd >= 0)
+                close(fd);
+        }
+        bool isOpen() const { return fd >= 0; }
+
+        bool read(uint8_t *buffer, size_t length, uint64_t offset)
+        {
+            size_t done = 0;
+            while (done < length)
+            {
+                ssize_t nread = pread(fd, buffer + done, length - done, static_cast<off_t>(offset + done));
+                if (nread <= 0)
+                    return false;
+                done += static_cast<size_t>(nread);
+            }
+            return true;
+        }
+#endif
+    };
+}
+
+uint64_t hashFileSamples(const std::string &filepath, uint64_t size)
+{
+    SampleReader reader(filepath);
+    if (!reader.isOpen())
+        return 0;
+
+    std::vector<uint8_t> buffer(duplicateSampleSize);
+    uint64_t hash = hashBytes(prime1, reinterpret_cast<const uint8_t *>(&size), sizeof(size));
+
+    if (size <= 3 * duplicateSampleSize)
+    {
+        for (uint64_t offset = 0; offset < size; offset += duplicateSampleSize)
+        {
+            size_t length = static_cast<size_t>(std::min<uint64_t>(duplicateSampleSize, size - offset));
+            if (!reader.read(buffer.data(), length, offset))
+                return 0;
+            hash = hashBytes(hash, buffer.data(), length);
+        }
+        return finalizeHash(hash);
+    }
+
+    const uint64_t offsets[] = {0, size / 2 - duplicateSampleSize / 2, size - duplicateSampleSize};
+    for (uint64_t offset : offsets)
+    {
+        if (!reader.read(buffer.data(), duplicateSampleSize, offset))
+            return 0;
+        hash = hashBytes(hash, buffer.data(), duplicateSampleSize);
+    }
+    return finalizeHash(hash);
+}
+
+// DuplicateDetector implementation
+DuplicateDetector::DuplicateDetector() : running(false)
+{
+    setThreadCount(0);
+}
+
+DuplicateDetector::~DuplicateDetector()
+{
+    stop();
+}
+
+void DuplicateDetector::setThreadCount(unsigned int threads)
+{
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    threadCount = std::max(1u, threads);
+}
+
+unsigned int DuplicateDetector::getThreadCount() const
+{
+    return threadCount;
+}
+
+bool DuplicateDetector::isRunning() const
+{
+    return running;
+}
+
+void DuplicateDetector::start(std::vector<Candidate> files, ResultCallback onFinished)
+{
+    stop();
+    running = true;
+    detectThread = std::thread(&DuplicateDetector::run, this, std::move(files), std::move(onFinished));
+}
+
+void DuplicateDetector::stop()
+{
+    running = false;
+    if (detectThread.joinable())
+    {
+        detectThread.join();
+    }
+}
+
+void DuplicateDetector::run(std::vector<Candidate> files, ResultCallback onFinished)
+{
+    // A file with a unique size cannot have a duplicate, so most files are never opened
+    std::unordered_map<uint64_t, std::vector<size_t>> bySize;
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        if (files[i].size > 0)
+            bySize[files[i].size].push_back(i);
+    }
+
+    std::vector<uint64_t> hashes(files.size(), 0);
+    std::vector<size_t> toHash;
+    for (const auto &[size, indices] : bySize)
+    {
+        if (indices.size() < 2)
+            continue;
+        for (size_t i : indices)
+        {
+            hashes[i] = files[i].contentHash;
+            if (hashes[i] == 0)
+                toHash.push_back(i);
+        }
+    }
+
+    // Each worker writes only its own slots of hashes
+    std::atomic<size_t> next(0);
+    auto worker = [&]()
+    {
+        for (size_t n = next++; n < toHash.size() && running; n = next++)
+        {
+            size_t i = toHash[n];
+            hashes[i] = hashFileSamples(files[i].file->getFilepath(), files[i].size);
+        }
+    };
+
+    size_t nThreads = std::min<size_t>(threadCount, toHash.size());
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < nThreads; ++t)
+        workers.emplace_back(worker);
+    worker();
+    for (auto &thread : workers)
+        thread.join();
+
+    if (!running)
+        return;
+
+    std::vector<std::pair<Candidate, uint64_t>> computed;
+    for (size_t i : toHash)
+    {
+        if (hashes[i] != 0)
+            computed.emplace_back(files[i], hashes[i]);
+    }
+
+    std::vector<Group> groups;
+    for (const auto &[size, indices] : bySize)
+    {
+        if (indices.size() < 2)
+            continue;
+
+        std::unordered_map<uint64_t, Group> byHash;
+        for (size_t i : indices)
+        {
+            if (hashes[i] != 0)
+                byHash[hashes[i]].push_back(files[i].file);
+        }
+        for (auto &[hash, group] : byHash)
+        {
+            if (group.size() >= 2)
+                groups.push_back(std::move(group));
+        }
+    }
+
+    // Stable order for the views: members and groups by path
+    auto byPath = [](const std::shared_ptr<MediaFileModel> &a, const std::shared_ptr<MediaFileModel> &b)
+    {
+        return a->getFilepath() < b->getFilepath();
+    };
+    for (auto &group : groups)
+        std::sort(group.begin(), group.end(), byPath);
+    std::sort(groups.begin(), groups.end(),
+              [&byPath](const Group &a, const Group &b)
+              {
+                  return byPath(a.front(), b.front());
+              });
+
+    if (onFinished)
+        onFinished(std::move(computed), std::move(groups));
+    running = false;
+}
@@ -0,0 +1,66 @@
+#ifndef DUPLICATES_H
+#define DUPLICATES_H
+
+#include "media.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+
+// Bytes hashed from the head, the middle and the tail of a file
+constexpr size_t duplicateSampleSize = 64 * 1024;
+
+// Fast non-cryptographic hash of the file size and three sampled chunks (the
+// whole file when it is smaller than the samples). Returns 0 on read errors.
+uint64_t hashFileSamples(const std::string &filepath, uint64_t size);
+
+// Finds files with the same content in the background. Candidates are first
+// grouped by size, only files sharing a size are hashed, on a pool of threads.
+// Hashes already cached on the models are reused.
+class DuplicateDetector
+{
+public:
+    using Group = std::vector<std::shared_ptr<MediaFileModel>>;
+
+    // What a run knows of a file, copied from the model under the library lock:
+    // the detector thread never reads the stat or the hash of a shared model
+    struct Candidate
+    {
+        std::shared_ptr<MediaFileModel> file;
+        uint64_t size;
+        int64_t modifiedTime;
+        uint64_t contentHash; // 0 when not hashed yet
+    };
+
+    // Called from the detector thread when a run completes: the candidates
+    // hashed by this run with their new hash, and the groups of identical files
+    using ResultCallback = std::function<void(std::vector<std::pair<Candidate, uint64_t>> &&computed,
+                                              std::vector<Group> &&groups)>;
+
+private:
+    unsigned int threadCount;
+    std::atomic<bool> running;
+    std::thread detectThread;
+
+    void run(std::vector<Candidate> files, ResultCallback onFinished);
+
+public:
+    DuplicateDetector();
+    ~DuplicateDetector();
+
+    // Number of hashing threads, 0 = hardware concurrency
+    void setThreadCount(unsigned int threads);
+    unsigned int getThreadCount() const;
+
+    // Start a run over files, cancelling the previous one
+    void start(std::vector<Candidate> files, ResultCallback onFinished);
+    void stop();
+
+    bool isRunning() const;
+};
+
+#endif // DUPLICATES_H
@@ -0,0 +1,265 @@
+#include "facet_index.h"
+
+#include <algorithm>
+
+MetadataField facetField(Facet facet)
+{
+    switch (facet)
+    {
+    case Facet::ARTIST:
+        return MetadataField::ARTIST;
+    case Facet::ALBUM:
+        return MetadataField::ALBUM;
+    case Facet::GENRE:
+        return MetadataField::GENRE;
+    case Facet::YEAR:
+        return MetadataField::YEAR;
+    default:
+        return MetadataField::COUNT;
+    }
+}
+
+const std::string &facetTitle(Facet facet)
+{
+    static const std::string titles[] = {"Artists", "Albums", "Genres", "Years", ""};
+    return titles[static_cast<size_t>(facet)];
+}
+
+namespace
+{
+    bool lessIgnoringCase(const std::string &a, const std::string &b)
+    {
+        auto lower = [](unsigned char c)
+        {
+            return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+        };
+        for (size_t i = 0; i < a.size() && i < b.size(); ++i)
+        {
+            if (lower(a[i]) != lower(b[i]))
+                return lower(a[i]) < lower(b[i]);
+        }
+        if (a.size() != b.size())
+            return a.size() < b.size();
+        return a < b;
+    }
+
+    bool byPath(const std::shared_ptr<MediaFileModel> &a, const std::shared_ptr<MediaFileModel> &b)
+    {
+        return a->getFilepath() < b->getFilepath();
+    }
+}
+
+void FacetIndex::insert(const std::shared_ptr<MediaFileModel> &file, const Membership &values)
+{
+    for (size_t i = 0; i < facetCount; ++i)
+    {
+        if (!values[i].isSet())
+            continue;
+
+        FacetValues &facet = facets[i];
+        auto [it, created] = facet.buckets.try_emplace(values[i]);
+        Bucket &bucket = it->second;
+        if (bucket.sorted && !bucket.files.empty() && byPath(file, bucket.files.back()))
+            bucket.sorted = false;
+        bucket.files.push_back(file);
+        if (created)
+            facet.orderStale = true;
+    }
+    memberships[file.get()] = values;
+}
+
+void FacetIndex::add(const std::shared_ptr<MediaFileModel> &file, const FacetIndex *previous)
+{
+    if (!file->isMetadataLoaded() && file->getAllMetadata().empty())
+    {
+        // Tags evicted from memory, keep the file under the values indexed before
+        if (memberships.count(file.get()))
+            return;
+        if (previous)
+        {
+            auto old = previous->memberships.find(file.get());
+            if (old != previous->memberships.end())
+            {
+                insert(file, old->second);
+                if (previous->unread.count(file.get()))
+                    unread.insert(file.get());
+                return;
+            }
+        }
+    }
+
+    if (file->isMetadataLoaded() || !file->getAllMetadata().empty())
+        unread.erase(file.get());
+    else
+        unread.insert(file.get());
+
+    Membership values;
+    for (size_t i = 0; i < facetCount; ++i)
+    {
+        const std::string &value = file->getMetadata(facetField(static_cast<Facet>(i)));
+        // Readers store 0 for a missing year
+        if (value.empty() || (static_cast<Facet>(i) == Facet::YEAR && value == "0"))
+            continue;
+        values[i] = InternedString::intern(value);
+    }
+
+    auto it = memberships.find(file.get());
+    if (it != memberships.end() && it->second == values)
+        return; // tags changed, but none of the facets
+    remove(file.get());
+    insert(file, values);
+}
+
+void FacetIndex::remove(const MediaFileModel *file)
+{
+    auto it = memberships.find(file);
+    if (it == memberships.end())
+        return;
+
+    for (size_t i = 0; i < facetCount; ++i)
+    {
+        if (!it->second[i].isSet())
+            continue;
+
+        FacetValues &facet = facets[i];
+        auto bucket = facet.buckets.find(it->second[i]);
+        if (bucket == facet.buckets.end())
+            continue;
+
+        // Removing keeps the order, a sorted bucket stays sorted
+        auto &files = bucket->second.files;
+        auto member = files.end();
+        if (bucket->second.sorted)
+        {
+            member = std::lower_bound(files.begin(), files.end(), file->getFilepath(),
+                                      [](const std::shared_ptr<MediaFileModel> &candidate, const std::string &path)
+                                      {
+                                          return candidate->getFilepath() < path;
+                                      });
+        }
+        if (member == files.end() || member->get() != file)
+        {
+            member = std::find_if(files.begin(), files.end(),
+                                  [file](const std::shared_ptr<MediaFileModel> &candidate)
+                                  {
+                                      return candidate.get() == file;
+                                  });
+        }
+        if (member != files.end())
+            files.erase(member);
+        if (files.empty())
+        {
+            facet.buckets.erase(bucket);
+            facet.orderStale = true;
+        }
+    }
+    memberships.erase(it);
+    unread.erase(file);
+}
+
+void FacetIndex::clear()
+{
+    for (auto &facet : facets)
+    {
+        facet.buckets.clear();
+        facet.order.clear();
+        facet.orderStale = false;
+    }
+    memberships.clear();
+    unread.clear();
+}
+
+void FacetIndex::swap(FacetIndex &other)
+{
+    facets.swap(other.facets);
+    memberships.swap(other.memberships);
+    unread.swap(other.unread);
+}
+
+size_t FacetIndex::size() const
+{
+    return memberships.size();
+}
+
+size_t FacetIndex::getUnreadCount() const
+{
+    return unread.size();
+}
+
+const FacetIndex::Bucket *FacetIndex::findBucket(Facet facet, const std::string &value) const
+{
+    if (facet >= Facet::COUNT)
+        return nullptr;
+
+    FacetValues &values = facets[static_cast<size_t>(facet)];
+    auto it = values.buckets.find(InternedString::intern(value));
+    if (it == values.buckets.end())
+        return nullptr;
+
+    Bucket &bucket = it->second;
+    if (!bucket.sorted)
+    {
+        std::sort(bucket.files.begin(), bucket.files.end(), byPath);
+        bucket.sorted = true;
+    }
+    return &bucket;
+}
+
+const std::vector<InternedString> &FacetIndex::sortedValues(Facet facet) const
+{
+    FacetValues &values = facets[static_cast<size_t>(facet)];
+    if (values.orderStale)
+    {
+        values.order.clear();
+        values.order.reserve(values.buckets.size());
+        for (const auto &[value, bucket] : values.buckets)
+            values.order.push_back(value);
+        std::sort(values.order.begin(), values.order.end(),
+                  [](const InternedString &a, const InternedString &b)
+                  {
+                      return lessIgnoringCase(a.str(), b.str());
+                  });
+        values.orderStale = false;
+    }
+    return values.order;
+}
+
+size_t FacetIndex::getValueCount(Facet facet) const
+{
+    if (facet >= Facet::COUNT)
+        return 0;
+    return facets[static_cast<size_t>(facet)].buckets.size();
+}
+
+std::vector<std::pair<std::string, size_t>> FacetIndex::getValues(Facet facet, size_t first, size_t count) const
+{
+    std::vector<std::pair<std::string, size_t>> page;
+    if (facet >= Facet::COUNT)
+        return page;
+
+    const std::vector<InternedString> &order = sortedValues(facet);
+    const auto &buckets = facets[static_cast<size_t>(facet)].buckets;
+    for (size_t i = first; i < order.size() && i < first + count; ++i)
+        page.emplace_back(order[i].str(), buckets.at(order[i]).files.size());
+    return page;
+}
+
+size_t FacetIndex::getFileCount(Facet facet, const std::string &value) const
+{
+    if (facet >= Facet::COUNT)
+        return 0;
+
+    const auto &buckets = facets[static_cast<size_t>(facet)].buckets;
+    auto it = buckets.find(InternedString::intern(value));
+    return it != buckets.end() ? it->second.files.size() : 0;
+}
+
+std::vector<std::shared_ptr<MediaFileModel>> FacetIndex::getFiles(Facet facet, const std::string &value, size_t first,
+                                                                  size_t count) const
+{
+    const Bucket *bucket = findBucket(facet, value);
+    if (!bucket || first >= bucket->files.size())
+        return {};
+    size_t last = first + std::min(count, bucket->files.size() - first);
+    return std::vector<std::shared_ptr<MediaFileModel>>(bucket->files.begin() + first, bucket->files.begin() + last);
+}
@@ -0,0 +1,86 @@
+#ifndef FACET_INDEX_H
+#define FACET_INDEX_H
+
+#include "media.h"
+#include "interned_string.h"
+
+#include <array>
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <unordered_map>
+#include <unordered_set>
+
+// Tags the library can be browsed by
+enum class Facet
+{
+    ARTIST,
+    ALBUM,
+    GENRE,
+    YEAR,
+    COUNT
+};
+
+MetadataField facetField(Facet facet);
+// "Artists", "Albums", ... as shown when browsing
+const std::string &facetTitle(Facet facet);
+
+// Secondary indexes of the library by artist, album, genre and year. Each value
+// keeps its files in a bucket, so counts are O(1) and a page of a value or of
+// the value list is read without walking the library. Files without the tag
+// are not listed under that facet. Not thread-safe, MediaLibrary guards it with
+// its lock.
+class FacetIndex
+{
+private:
+    static constexpr size_t facetCount = static_cast<size_t>(Facet::COUNT);
+
+    // Files are appended unsorted and sorted by path on the first read after a change
+    struct Bucket
+    {
+        std::vector<std::shared_ptr<MediaFileModel>> files;
+        bool sorted = true;
+    };
+
+    struct FacetValues
+    {
+        std::unordered_map<InternedString, Bucket, InternedString::Hash> buckets;
+        std::vector<InternedString> order; // values sorted for display, rebuilt when stale
+        bool orderStale = false;
+    };
+
+    using Membership = std::array<InternedString, facetCount>; // unset when not listed
+
+    mutable std::array<FacetValues, facetCount> facets;
+    std::unordered_map<const MediaFileModel *, Membership> memberships;
+    std::unordered_set<const MediaFileModel *> unread; // indexed before their tags were read
+
+    void insert(const std::shared_ptr<MediaFileModel> &file, const Membership &values);
+    const Bucket *findBucket(Facet facet, const std::string &value) const;
+    const std::vector<InternedString> &sortedValues(Facet facet) const;
+
+public:
+    // Index file under its current tags, replacing its previous entry. A file whose
+    // tags were dropped to save memory stays where it was, here or in previous.
+    void add(const std::shared_ptr<MediaFileModel> &file, const FacetIndex *previous = nullptr);
+    void remove(const MediaFileModel *file);
+    void clear();
+    void swap(FacetIndex &other);
+
+    // Files indexed, and those of them not listed yet because their tags were never read
+    size_t size() const;
+    size_t getUnreadCount() const;
+
+    // Distinct values of facet
+    size_t getValueCount(Facet facet) const;
+    // Values [first, first + count) in case-insensitive order, with their file counts
+    std::vector<std::pair<std::string, size_t>> getValues(Facet facet, size_t first, size_t count) const;
+
+    size_t getFileCount(Facet facet, const std::string &value) const;
+    // Files [first, first + count) listed under value, sorted by path
+    std::vector<std::shared_ptr<MediaFileModel>> getFiles(Facet facet, const std::string &value, size_t first,
+                                                          size_t count) const;
+};
+
+#endif // FACET_INDEX_H
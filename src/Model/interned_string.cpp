@@ -0,0 +1,107 @@
+#include "interned_string.h"
+
+#include <mutex>
+#include <atomic>
+#include <string_view>
+#include <unordered_map>
+
+// Copies and releases that do not drop the last reference only touch refs; the
+// pool lock is taken to intern and to release the last reference, so a lookup
+// never finds an entry on its way out
+struct InternedStringEntry
+{
+    std::string value;
+    std::atomic<size_t> refs;
+};
+
+namespace
+{
+    struct StringPool
+    {
+        std::mutex mutex;
+        std::unordered_map<std::string_view, InternedStringEntry *> entries; // keys view into the entries
+    };
+
+    // Never destroyed, so models released during static destruction still find it
+    StringPool &pool()
+    {
+        static StringPool *instance = new StringPool();
+        return *instance;
+    }
+
+    const std::string emptyString;
+}
+
+InternedString InternedString::intern(const std::string &value)
+{
+    StringPool &p = pool();
+    std::lock_guard<std::mutex> lock(p.mutex);
+
+    auto it = p.entries.find(value);
+    if (it != p.entries.end())
+    {
+        it->second->refs.fetch_add(1, std::memory_order_relaxed);
+        return InternedString(it->second);
+    }
+
+    Entry *entry = new Entry{value, 1};
+    p.entries.emplace(entry->value, entry);
+    return InternedString(entry);
+}
+
+size_t InternedString::poolSize()
+{
+    StringPool &p = pool();
+    std::lock_guard<std::mutex> lock(p.mutex);
+    return p.entries.size();
+}
+
+InternedString::InternedString(const InternedString &other) : entry(other.entry)
+{
+    // other holds a reference, the entry cannot go away meanwhile
+    if (entry)
+        entry->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+InternedString &InternedString::operator=(const InternedString &other)
+{
+    if (entry != other.entry)
+    {
+        InternedString copy(other);
+        std::swap(entry, copy.entry);
+    }
+    return *this;
+}
+
+InternedString &InternedString::operator=(InternedString &&other) noexcept
+{
+    std::swap(entry, other.entry);
+    return *this;
+}
+
+InternedString::~InternedString()
+{
+    if (!entry)
+        return;
+
+    size_t refs = entry->refs.load(std::memory_order_relaxed);
+    while (refs > 1)
+    {
+        if (entry->refs.compare_exchange_weak(refs, refs - 1, std::memory_order_acq_rel))
+            return;
+    }
+
+    // Possibly the last one, unless intern hands out the entry again first
+    StringPool &p = pool();
+    std::lock_guard<std::mutex> lock(p.mutex);
+    if (entry->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        p.entries.erase(entry->value);
+        delete entry;
+    }
+}
+
+const std::string &InternedString::str() const
+{
+    return entry ? entry->value : emptyString;
+}
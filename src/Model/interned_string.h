@@ -0,0 +1,49 @@
+#ifndef INTERNED_STRING_H
+#define INTERNED_STRING_H
+
+#include <string>
+#include <cstddef>
+#include <functional>
+
+// Reference-counted handle to a string in a process-wide pool: equal values
+// share one copy, which goes away with the last handle. Pointer-sized, and
+// comparing two handles compares pointers. A default handle holds no value.
+// Copying a handle never locks the pool, only interning and dropping the last
+// handle of a value do.
+struct InternedStringEntry;
+
+class InternedString
+{
+private:
+    using Entry = InternedStringEntry;
+    Entry *entry;
+
+    explicit InternedString(Entry *e) : entry(e) {}
+
+public:
+    InternedString() : entry(nullptr) {}
+    InternedString(const InternedString &other);
+    InternedString(InternedString &&other) noexcept : entry(other.entry) { other.entry = nullptr; }
+    InternedString &operator=(const InternedString &other);
+    InternedString &operator=(InternedString &&other) noexcept;
+    ~InternedString();
+
+    static InternedString intern(const std::string &value);
+    // Number of distinct strings alive in the pool
+    static size_t poolSize();
+
+    bool isSet() const { return entry != nullptr; }
+    // Empty string when not set
+    const std::string &str() const;
+
+    bool operator==(const InternedString &other) const { return entry == other.entry; }
+    bool operator!=(const InternedString &other) const { return entry != other.entry; }
+
+    // Hashes the handle, for unordered containers keyed by interned values
+    struct Hash
+    {
+        size_t operator()(const InternedString &value) const { return std::hash<const void *>()(value.entry); }
+    };
+};
+
+#endif // INTERNED_STRING_H
@@ -0,0 +1,205 @@
+#include "library_index.h"
+#include "binary_io.h"
+
+#include <iostream>
+#include <algorithm>
+
+// File layout (host byte order):
+//   magic "MPLI", u32 version, string root, u32 count, count * record
+//   record: string path, u64 size, i64 mtime, u64 hash, u8 type, u8 container, i32 duration,
+//           u8 metadataLoaded, u32 n, n * (string key, string value)
+//   string: u32 length + bytes
+static const char indexMagic[4] = {'M', 'P', 'L', 'I'};
+static const uint32_t indexVersion = 5; // 2: mtime in ns since the Unix epoch, 3: container, 4: content hash, 5: video Codec
+
+// LibraryIndex implementation
+bool LibraryIndex::load(const std::string &indexPath)
+{
+    clear();
+
+    // Read the whole index in one go, then decode from memory
+    std::string buffer;
+    if (!readBinaryFile(indexPath, buffer))
+        return false;
+
+    BinaryReader reader(buffer);
+    uint32_t version = 0, count = 0;
+    if (!reader.getMagic(indexMagic) || !reader.get(version) || version != indexVersion)
+    {
+        std::cerr << "Library index " << indexPath << " has an unknown format, ignoring it\n";
+        return false;
+    }
+    if (!reader.getString(rootDirectory) || !reader.get(count))
+    {
+        std::cerr << "Library index " << indexPath << " is truncated\n";
+        clear();
+        return false;
+    }
+
+    // Bounded by what the file can hold, a corrupt count must not allocate
+    const size_t minRecordSize = sizeof(uint32_t) + 3 * sizeof(uint64_t) + 3 * sizeof(uint8_t) + sizeof(int32_t) +
+                                 sizeof(uint32_t);
+    records.reserve(std::min<size_t>(count, reader.remaining() / minRecordSize));
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        LibraryIndexRecord record;
+        uint8_t type, container, loaded;
+        int32_t duration;
+        uint32_t nMetadata;
+
+        if (!reader.getString(record.filepath) || !reader.get(record.size) || !reader.get(record.mtime) || !reader.get(record.contentHash) ||
+            !reader.get(type) || !reader.get(container) || !reader.get(duration) || !reader.get(loaded) || !reader.get(nMetadata))
+        {
+            std::cerr << "Library index " << indexPath << " is truncated\n";
+            clear();
+            return false;
+        }
+
+        record.type = static_cast<MediaType>(type);
+        record.container = static_cast<ContainerFormat>(container);
+        record.duration = duration;
+        record.metadataLoaded = loaded != 0;
+
+        for (uint32_t j = 0; j < nMetadata; ++j)
+        {
+            std::string key, value;
+            if (!reader.getString(key) || !reader.getString(value))
+            {
+                std::cerr << "Library index " << indexPath << " is truncated\n";
+                clear();
+                return false;
+            }
+            record.metadata.emplace(std::move(key), std::move(value));
+        }
+
+        recordByPath[record.filepath] = records.size();
+        records.push_back(std::move(record));
+    }
+
+    return true;
+}
+
+bool LibraryIndex::save(const std::string &indexPath) const
+{
+    BinaryWriter writer;
+    writer.putMagic(indexMagic);
+    writer.put<uint32_t>(indexVersion);
+    writer.putString(rootDirectory);
+    writer.put<uint32_t>(static_cast<uint32_t>(records.size()));
+
+    for (const auto &record : records)
+    {
+        writer.putString(record.filepath);
+        writer.put<uint64_t>(record.size);
+        writer.put<int64_t>(record.mtime);
+        writer.put<uint64_t>(record.contentHash);
+        writer.put<uint8_t>(static_cast<uint8_t>(record.type));
+        writer.put<uint8_t>(static_cast<uint8_t>(record.container));
+        writer.put<int32_t>(record.duration);
+        writer.put<uint8_t>(record.metadataLoaded ? 1 : 0);
+        writer.put<uint32_t>(static_cast<uint32_t>(record.metadata.size()));
+        for (const auto &[key, value] : record.metadata)
+        {
+            writer.putString(key);
+            writer.putString(value);
+        }
+    }
+
+    return writeBinaryFile(indexPath, writer.data());
+}
+
+void LibraryIndex::setRootDirectory(const std::string &root)
+{
+    rootDirectory = root;
+}
+
+const std::string &LibraryIndex::getRootDirectory() const
+{
+    return rootDirectory;
+}
+
+void LibraryIndex::assign(const std::vector<std::shared_ptr<MediaFileModel>> &mediaFiles, const LibraryIndex &previous)
+{
+    records.clear();
+    recordByPath.clear();
+    records.reserve(mediaFiles.size());
+
+    for (const auto &file : mediaFiles)
+    {
+        LibraryIndexRecord record;
+        record.filepath = file->getFilepath();
+        record.size = file->getFileSize();
+        record.mtime = file->getModifiedTime();
+        record.contentHash = file->getContentHash();
+        record.type = file->getType();
+        record.container = file->getContainer();
+        record.duration = file->getDuration();
+        record.metadataLoaded = file->isMetadataLoaded();
+        record.metadata = file->getAllMetadata();
+
+        if (!record.metadataLoaded)
+        {
+            // Tags dropped from memory to save space are still those of the
+            // previous record as long as the file did not change
+            auto it = previous.recordByPath.find(record.filepath);
+            if (it != previous.recordByPath.end())
+            {
+                const LibraryIndexRecord &old = previous.records[it->second];
+                if (old.metadataLoaded && old.size == record.size && old.mtime == record.mtime)
+                {
+                    record.metadataLoaded = true;
+                    record.metadata = old.metadata;
+                    if (record.duration == 0)
+                        record.duration = old.duration;
+                }
+            }
+        }
+
+        recordByPath[record.filepath] = records.size();
+        records.push_back(std::move(record));
+    }
+}
+
+const std::vector<LibraryIndexRecord> &LibraryIndex::getRecords() const
+{
+    return records;
+}
+
+const LibraryIndexRecord *LibraryIndex::findUnchanged(const std::string &filepath, uint64_t size, int64_t mtime) const
+{
+    auto it = recordByPath.find(filepath);
+    if (it == recordByPath.end())
+        return nullptr;
+
+    const LibraryIndexRecord &record = records[it->second];
+    if (record.size != size || record.mtime != mtime)
+        return nullptr;
+    return &record;
+}
+
+std::shared_ptr<MediaFileModel> LibraryIndex::createMediaFile(const LibraryIndexRecord &record)
+{
+    std::shared_ptr<MediaFileModel> media;
+    if (record.type == MediaType::AUDIO)
+        media = std::make_shared<AudioFileModel>(record.filepath);
+    else if (record.type == MediaType::VIDEO)
+        media = std::make_shared<VideoFileModel>(record.filepath);
+    else
+        media = std::make_shared<MediaFileModel>(record.filepath);
+
+    media->setContainer(record.container);
+    media->setFileStat(record.size, record.mtime);
+    media->setContentHash(record.contentHash);
+    media->setDuration(record.duration);
+    for (const auto &[key, value] : record.metadata)
+        media->setMetadata(key, value);
+    media->setMetadataLoaded(record.metadataLoaded);
+    return media;
+}
+
+void LibraryIndex::clear()
+{
+    rootDirectory.clear();
+    records.clear();
+    recordByPath.clear();
+}
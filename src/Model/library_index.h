@@ -0,0 +1,58 @@
+#ifndef LIBRARY_INDEX_H
+#define LIBRARY_INDEX_H
+
+#include "media.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+
+// One indexed media file, as last seen on disk
+struct LibraryIndexRecord
+{
+    std::string filepath;
+    uint64_t size = 0;
+    int64_t mtime = 0; // ns since the Unix epoch, see readFileStat
+    uint64_t contentHash = 0; // see hashFileSamples
+    MediaType type = MediaType::UNKNOWN;
+    ContainerFormat container = ContainerFormat::UNKNOWN;
+    int duration = 0;
+    bool metadataLoaded = false;
+    std::map<std::string, std::string> metadata;
+};
+
+// Binary on-disk snapshot of the media library, so startup does not have to
+// rescan the tree and re-read every tag.
+class LibraryIndex
+{
+private:
+    std::string rootDirectory;
+    std::vector<LibraryIndexRecord> records;
+    std::unordered_map<std::string, size_t> recordByPath;
+
+public:
+    bool load(const std::string &indexPath);
+    bool save(const std::string &indexPath) const;
+
+    void setRootDirectory(const std::string &root);
+    const std::string &getRootDirectory() const;
+
+    // Replace the content with the current state of the given files. An unchanged
+    // file whose tags were evicted from memory keeps the tags of its record in previous.
+    void assign(const std::vector<std::shared_ptr<MediaFileModel>> &mediaFiles, const LibraryIndex &previous);
+
+    const std::vector<LibraryIndexRecord> &getRecords() const;
+
+    // Record for filepath only if size and mtime still match, nullptr otherwise
+    const LibraryIndexRecord *findUnchanged(const std::string &filepath, uint64_t size, int64_t mtime) const;
+
+    // Build a model from a record, restoring the cached tags
+    static std::shared_ptr<MediaFileModel> createMediaFile(const LibraryIndexRecord &record);
+
+    void clear();
+};
+
+#endif // LIBRARY_INDEX_H
@@ -0,0 +1,539 @@
+#include "library_query.h"
+
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+
+namespace
+{
+    const MetadataField textFields[] = {MetadataField::ARTIST, MetadataField::ALBUM, MetadataField::GENRE,
+                                        MetadataField::TITLE};
+
+    // Rows filtered together, small enough for the mask to stay in L1
+    const size_t blockRows = 4096;
+
+    uint64_t nextGeneration()
+    {
+        static std::atomic<uint64_t> counter{0};
+        return ++counter;
+    }
+
+    // ASCII letters only, as in the search index
+    std::string fold(const std::string &value)
+    {
+        std::string out = value;
+        for (char &c : out)
+        {
+            if (c >= 'A' && c <= 'Z')
+                c = static_cast<char>(c - 'A' + 'a');
+        }
+        return out;
+    }
+
+    // "2003" or "2003-05-17", 0 when there is no leading number
+    int32_t parseYear(const std::string &value)
+    {
+        int32_t year = 0;
+        for (size_t i = 0; i < value.size() && i < 4 && value[i] >= '0' && value[i] <= '9'; ++i)
+            year = year * 10 + (value[i] - '0');
+        return year;
+    }
+
+    bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    // Written as straight loops over the column so the compiler can vectorise them
+    template <typename T>
+    void compareColumn(uint8_t *mask, const T *column, size_t count, LibraryQuery::Op op, T value)
+    {
+        using Op = LibraryQuery::Op;
+        switch (op)
+        {
+        case Op::EQUAL:
+            for (size_t i = 0; i < count; ++i)
+                mask[i] &= column[i] == value;
+            break;
+        case Op::NOT_EQUAL:
+            for (size_t i = 0; i < count; ++i)
+                mask[i] &= column[i] != value;
+            break;
+        case Op::LESS:
+            for (size_t i = 0; i < count; ++i)
+                mask[i] &= column[i] < value;
+            break;
+        case Op::LESS_EQUAL:
+            for (size_t i = 0; i < count; ++i)
+                mask[i] &= column[i] <= value;
+            break;
+        case Op::GREATER:
+            for (size_t i = 0; i < count; ++i)
+                mask[i] &= column[i] > value;
+            break;
+        case Op::GREATER_EQUAL:
+            for (size_t i = 0; i < count; ++i)
+                mask[i] &= column[i] >= value;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+uint32_t LibraryColumns::Dictionary::encode(const std::string &value)
+{
+    auto [it, created] = codes.try_emplace(value, static_cast<uint32_t>(values.size()));
+    if (created)
+        values.push_back(value);
+    return it->second;
+}
+
+LibraryColumns::LibraryColumns() : generation(nextGeneration())
+{
+}
+
+void LibraryColumns::add(const std::shared_ptr<MediaFileModel> &file, const LibraryColumns *previous)
+{
+    auto it = ids.find(file.get());
+    const LibraryColumns *source = nullptr;
+    uint32_t sourceRow = 0;
+    if (!file->isMetadataLoaded() && file->getAllMetadata().empty())
+    {
+        // Tags evicted from memory, keep the values stored before
+        if (it != ids.end())
+            return;
+        if (previous)
+        {
+            auto old = previous->ids.find(file.get());
+            if (old != previous->ids.end())
+            {
+                source = previous;
+                sourceRow = old->second;
+            }
+        }
+    }
+
+    uint32_t row;
+    if (it != ids.end())
+    {
+        row = it->second;
+    }
+    else
+    {
+        row = static_cast<uint32_t>(files.size());
+        files.push_back(file);
+        live.push_back(1);
+        durations.push_back(0);
+        years.push_back(0);
+        types.push_back(0);
+        names.push_back(fold(file->getFilename()));
+        for (auto &column : codes)
+            column.push_back(0);
+        ids[file.get()] = row;
+    }
+
+    durations[row] = file->getDuration();
+    types[row] = static_cast<uint8_t>(file->getType());
+    if (source)
+    {
+        years[row] = source->years[sourceRow];
+        for (size_t c = 0; c < textColumnCount; ++c)
+            codes[c][row] = dictionaries[c].encode(source->dictionaries[c].values[source->codes[c][sourceRow]]);
+    }
+    else
+    {
+        years[row] = parseYear(file->getMetadata(MetadataField::YEAR));
+        for (size_t c = 0; c < textColumnCount; ++c)
+            codes[c][row] = dictionaries[c].encode(fold(file->getMetadata(textFields[c])));
+    }
+}
+
+void LibraryColumns::remove(const MediaFileModel *file)
+{
+    auto it = ids.find(file);
+    if (it == ids.end())
+        return;
+
+    // Blanked until the next compaction, the mask skips it
+    uint32_t row = it->second;
+    files[row].reset();
+    live[row] = 0;
+    names[row] = std::string();
+    ids.erase(it);
+    ++removedCount;
+
+    if (removedCount > 1024 && removedCount * 2 > files.size())
+        compact();
+}
+
+void LibraryColumns::compact()
+{
+    LibraryColumns compacted;
+    for (uint32_t row = 0; row < files.size(); ++row)
+    {
+        if (!live[row])
+            continue;
+        uint32_t to = static_cast<uint32_t>(compacted.files.size());
+        compacted.files.push_back(std::move(files[row]));
+        compacted.live.push_back(1);
+        compacted.durations.push_back(durations[row]);
+        compacted.years.push_back(years[row]);
+        compacted.types.push_back(types[row]);
+        compacted.names.push_back(std::move(names[row]));
+        for (size_t c = 0; c < textColumnCount; ++c)
+            compacted.codes[c].push_back(compacted.dictionaries[c].encode(dictionaries[c].values[codes[c][row]]));
+        compacted.ids[compacted.files.back().get()] = to;
+    }
+    swap(compacted);
+}
+
+void LibraryColumns::clear()
+{
+    LibraryColumns empty;
+    swap(empty);
+}
+
+void LibraryColumns::swap(LibraryColumns &other)
+{
+    files.swap(other.files);
+    live.swap(other.live);
+    durations.swap(other.durations);
+    years.swap(other.years);
+    types.swap(other.types);
+    names.swap(other.names);
+    codes.swap(other.codes);
+    dictionaries.swap(other.dictionaries);
+    ids.swap(other.ids);
+    std::swap(removedCount, other.removedCount);
+    std::swap(generation, other.generation);
+}
+
+size_t LibraryColumns::size() const
+{
+    return ids.size();
+}
+
+uint64_t LibraryColumns::getGeneration() const
+{
+    return generation;
+}
+
+std::shared_ptr<MediaFileModel> LibraryColumns::getFile(uint32_t row) const
+{
+    return row < files.size() ? files[row] : nullptr;
+}
+
+bool LibraryQuery::parse(const std::string &text)
+{
+    static const std::pair<const char *, Field> fieldNames[] = {
+        {"artist", Field::ARTIST}, {"album", Field::ALBUM}, {"genre", Field::GENRE}, {"title", Field::TITLE},
+        {"year", Field::YEAR}, {"duration", Field::DURATION}, {"type", Field::TYPE}};
+    // Longest first, so "<=" is not read as "<"
+    static const std::pair<const char *, Op> opNames[] = {
+        {"<=", Op::LESS_EQUAL}, {">=", Op::GREATER_EQUAL}, {"!=", Op::NOT_EQUAL}, {"<", Op::LESS},
+        {">", Op::GREATER}, {"=", Op::EQUAL}, {":", Op::CONTAINS}};
+
+    std::vector<Predicate> parsed;
+    size_t pos = 0;
+    while (true)
+    {
+        while (pos < text.size() && isSpace(text[pos]))
+            ++pos;
+        if (pos == text.size())
+            break;
+
+        bool negate = false;
+        if (text[pos] == '-' && pos + 1 < text.size() && !isSpace(text[pos + 1]))
+        {
+            negate = true;
+            ++pos;
+        }
+
+        Predicate predicate;
+        predicate.field = Field::ANY;
+        predicate.op = Op::CONTAINS;
+
+        size_t nameEnd = pos;
+        while (nameEnd < text.size() && std::isalpha(static_cast<unsigned char>(text[nameEnd])))
+            ++nameEnd;
+        if (nameEnd > pos && nameEnd < text.size() && std::strchr(":=!<>", text[nameEnd]))
+        {
+            std::string name = fold(text.substr(pos, nameEnd - pos));
+            auto field = std::find_if(std::begin(fieldNames), std::end(fieldNames),
+                                      [&name](const auto &entry)
+                                      { return name == entry.first; });
+            if (field == std::end(fieldNames))
+            {
+                std::cerr << "Query: unknown field " << name << std::endl;
+                return false;
+            }
+            predicate.field = field->second;
+
+            pos = nameEnd;
+            auto op = std::find_if(std::begin(opNames), std::end(opNames),
+                                   [&](const auto &entry)
+                                   { return text.compare(pos, std::strlen(entry.first), entry.first) == 0; });
+            if (op == std::end(opNames))
+            {
+                std::cerr << "Query: expected an operator after " << name << std::endl;
+                return false;
+            }
+            predicate.op = op->second;
+            pos += std::strlen(op->first);
+        }
+
+        std::string value;
+        if (pos < text.size() && text[pos] == '"')
+        {
+            size_t close = text.find('"', pos + 1);
+            if (close == std::string::npos)
+            {
+                std::cerr << "Query: missing closing quote" << std::endl;
+                return false;
+            }
+            value = text.substr(pos + 1, close - pos - 1);
+            pos = close + 1;
+        }
+        else
+        {
+            size_t end = pos;
+            while (end < text.size() && !isSpace(text[end]))
+                ++end;
+            value = text.substr(pos, end - pos);
+            pos = end;
+            if (value.empty())
+            {
+                std::cerr << "Query: missing value" << std::endl;
+                return false;
+            }
+        }
+
+        bool ordered = predicate.op != Op::CONTAINS && predicate.op != Op::EQUAL && predicate.op != Op::NOT_EQUAL;
+        switch (predicate.field)
+        {
+        case Field::YEAR:
+        case Field::DURATION:
+        {
+            if (predicate.op == Op::CONTAINS)
+                predicate.op = Op::EQUAL;
+            // Plain seconds, or m:ss and h:mm:ss for durations
+            int64_t number = 0;
+            int64_t part = 0;
+            bool valid = !value.empty() && value.front() != ':' && value.back() != ':';
+            for (char c : value)
+            {
+                if (c == ':' && predicate.field == Field::DURATION)
+                {
+                    number = (number + part) * 60;
+                    part = 0;
+                }
+                else if (c >= '0' && c <= '9' && part < 100000000)
+                {
+                    part = part * 10 + (c - '0');
+                }
+                else
+                {
+                    valid = false;
+                }
+            }
+            number += part;
+            if (!valid || number > INT32_MAX)
+            {
+                std::cerr << "Query: " << value << " is not a number" << std::endl;
+                return false;
+            }
+            predicate.number = static_cast<int32_t>(number);
+            break;
+        }
+        case Field::TYPE:
+        {
+            std::string type = fold(value);
+            if (ordered || (type != "audio" && type != "video"))
+            {
+                std::cerr << "Query: type is audio or video" << std::endl;
+                return false;
+            }
+            if (predicate.op == Op::CONTAINS)
+                predicate.op = Op::EQUAL;
+            predicate.number = static_cast<int32_t>(type == "audio" ? MediaType::AUDIO : MediaType::VIDEO);
+            break;
+        }
+        default:
+            if (ordered)
+            {
+                std::cerr << "Query: text fields only compare with : = !=" << std::endl;
+                return false;
+            }
+            predicate.text = fold(value);
+            break;
+        }
+
+        if (negate)
+        {
+            switch (predicate.op)
+            {
+            case Op::EQUAL:
+                predicate.op = Op::NOT_EQUAL;
+                break;
+            case Op::NOT_EQUAL:
+                predicate.op = Op::EQUAL;
+                break;
+            case Op::LESS:
+                predicate.op = Op::GREATER_EQUAL;
+                break;
+            case Op::LESS_EQUAL:
+                predicate.op = Op::GREATER;
+                break;
+            case Op::GREATER:
+                predicate.op = Op::LESS_EQUAL;
+                break;
+            case Op::GREATER_EQUAL:
+                predicate.op = Op::LESS;
+                break;
+            case Op::CONTAINS:
+                predicate.op = Op::NOT_CONTAINS;
+                break;
+            case Op::NOT_CONTAINS:
+                predicate.op = Op::CONTAINS;
+                break;
+            }
+        }
+        parsed.push_back(std::move(predicate));
+    }
+
+    predicates.swap(parsed);
+    return true;
+}
+
+bool LibraryQuery::empty() const
+{
+    return predicates.empty();
+}
+
+QueryResult LibraryQuery::run(const LibraryColumns &columns) const
+{
+    // One stage per predicate. Text predicates are resolved against the
+    // dictionaries here, so rows are only tested by code.
+    struct Stage
+    {
+        const Predicate *predicate;
+        const std::vector<int32_t> *numbers = nullptr;
+        std::array<std::vector<uint8_t>, LibraryColumns::textColumnCount> matches; // by code
+        int cost;
+    };
+
+    std::vector<Stage> stages;
+    for (const auto &predicate : predicates)
+    {
+        Stage stage;
+        stage.predicate = &predicate;
+        switch (predicate.field)
+        {
+        case Field::YEAR:
+            stage.numbers = &columns.years;
+            stage.cost = 0;
+            break;
+        case Field::DURATION:
+            stage.numbers = &columns.durations;
+            stage.cost = 0;
+            break;
+        case Field::TYPE:
+            stage.cost = 0;
+            break;
+        default:
+        {
+            // A bare word tests all four dictionaries and the filename
+            bool any = predicate.field == Field::ANY;
+            for (size_t c = 0; c < LibraryColumns::textColumnCount; ++c)
+            {
+                if (!any && c != static_cast<size_t>(predicate.field))
+                    continue;
+                const auto &values = columns.dictionaries[c].values;
+                auto &match = stage.matches[c];
+                match.resize(values.size());
+                for (size_t code = 0; code < values.size(); ++code)
+                {
+                    bool hit = predicate.op == Op::EQUAL || predicate.op == Op::NOT_EQUAL
+                                   ? values[code] == predicate.text
+                                   : values[code].find(predicate.text) != std::string::npos;
+                    // Negation is folded into the table, except for bare words which also look at the name
+                    match[code] = (any || (predicate.op != Op::NOT_EQUAL && predicate.op != Op::NOT_CONTAINS)) ? hit : !hit;
+                }
+            }
+            stage.cost = any ? 2 : 1;
+            break;
+        }
+        }
+        stages.push_back(std::move(stage));
+    }
+    // Cheap comparisons first, the filename scan of bare words last
+    std::stable_sort(stages.begin(), stages.end(),
+                     [](const Stage &a, const Stage &b)
+                     { return a.cost < b.cost; });
+
+    QueryResult result;
+    result.generation = columns.generation;
+    const size_t rowCount = columns.files.size();
+    std::vector<uint8_t> mask(blockRows);
+    for (size_t first = 0; first < rowCount; first += blockRows)
+    {
+        const size_t count = std::min(blockRows, rowCount - first);
+        std::memcpy(mask.data(), columns.live.data() + first, count);
+
+        for (const auto &stage : stages)
+        {
+            const Predicate &predicate = *stage.predicate;
+            if (stage.numbers)
+            {
+                // 0 is a year or duration not read yet, it matches no comparison
+                const int32_t *numbers = stage.numbers->data() + first;
+                for (size_t i = 0; i < count; ++i)
+                    mask[i] &= numbers[i] != 0;
+                compareColumn(mask.data(), stage.numbers->data() + first, count, predicate.op, predicate.number);
+            }
+            else if (predicate.field == Field::TYPE)
+            {
+                compareColumn(mask.data(), columns.types.data() + first, count, predicate.op,
+                              static_cast<uint8_t>(predicate.number));
+            }
+            else if (predicate.field != Field::ANY)
+            {
+                const uint32_t *codes = columns.codes[static_cast<size_t>(predicate.field)].data() + first;
+                const uint8_t *match = stage.matches[static_cast<size_t>(predicate.field)].data();
+                for (size_t i = 0; i < count; ++i)
+                    mask[i] &= match[codes[i]];
+            }
+            else
+            {
+                bool wanted = predicate.op == Op::CONTAINS;
+                for (size_t i = 0; i < count; ++i)
+                {
+                    if (!mask[i])
+                        continue;
+                    bool hit = columns.names[first + i].find(predicate.text) != std::string::npos;
+                    for (size_t c = 0; c < LibraryColumns::textColumnCount && !hit; ++c)
+                        hit = stage.matches[c][columns.codes[c][first + i]];
+                    mask[i] = hit == wanted;
+                }
+            }
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (mask[i])
+                result.rows.push_back(static_cast<uint32_t>(first + i));
+        }
+    }
+
+    // Rows follow path order when the store was built from the sorted library
+    auto byPath = [&columns](uint32_t a, uint32_t b)
+    {
+        return columns.files[a]->getFilepath() < columns.files[b]->getFilepath();
+    };
+    if (!std::is_sorted(result.rows.begin(), result.rows.end(), byPath))
+        std::sort(result.rows.begin(), result.rows.end(), byPath);
+    return result;
+}
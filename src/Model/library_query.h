@@ -0,0 +1,131 @@
+#ifndef LIBRARY_QUERY_H
+#define LIBRARY_QUERY_H
+
+#include "media.h"
+
+#include <array>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <unordered_map>
+
+// Rows matched by a query, in path order. Only valid against the columns of
+// the same generation: a compaction renumbers the rows.
+struct QueryResult
+{
+    std::vector<uint32_t> rows;
+    uint64_t generation = 0;
+};
+
+// Column-wise copy of what structured queries filter on: duration, year and
+// type as plain arrays, artist, album, genre and title as codes into a
+// dictionary of the distinct lowercased values of each column. A file keeps
+// its row when re-added; removed rows are blanked and dropped by a compaction
+// once they make up half of the store. Not thread-safe, MediaLibrary guards it
+// with its lock.
+class LibraryColumns
+{
+private:
+    static constexpr size_t textColumnCount = 4;
+
+    struct Dictionary
+    {
+        std::vector<std::string> values{std::string()}; // code 0 is the missing value
+        std::unordered_map<std::string, uint32_t> codes{{std::string(), 0}};
+
+        uint32_t encode(const std::string &value);
+    };
+
+    std::vector<std::shared_ptr<MediaFileModel>> files; // nullptr once removed
+    std::vector<uint8_t> live;
+    std::vector<int32_t> durations; // seconds
+    std::vector<int32_t> years;     // 0 when unknown
+    std::vector<uint8_t> types;     // MediaType
+    std::vector<std::string> names; // lowercased filenames
+    std::array<std::vector<uint32_t>, textColumnCount> codes;
+    std::array<Dictionary, textColumnCount> dictionaries;
+    std::unordered_map<const MediaFileModel *, uint32_t> ids;
+    size_t removedCount = 0;
+    uint64_t generation;
+
+    void compact();
+
+    friend class LibraryQuery;
+
+public:
+    LibraryColumns();
+
+    // Store the row of file, in place if it has one. A file whose tags were
+    // dropped to save memory keeps the values it was stored with, here or in previous.
+    void add(const std::shared_ptr<MediaFileModel> &file, const LibraryColumns *previous = nullptr);
+    void remove(const MediaFileModel *file);
+    void clear();
+    void swap(LibraryColumns &other);
+    size_t size() const;
+
+    uint64_t getGeneration() const;
+    // nullptr for a removed row or one out of range
+    std::shared_ptr<MediaFileModel> getFile(uint32_t row) const;
+};
+
+// Structured library query such as
+//     artist:"Daft Punk" year>=2000 duration<300 type:audio
+// Terms are separated by spaces and must all match; a leading '-' negates one.
+//   artist, album, genre, title   ':' contains, '=' equals, '!=' differs (ignoring case)
+//   year, duration                ':' '=' '!=' '<' '<=' '>' '>=', duration in seconds or m:ss;
+//                                 files whose year or duration is unknown match none of them
+//   type                          audio or video
+// A bare word matches files whose filename or one of those four tags contains it.
+// Values holding spaces are quoted.
+class LibraryQuery
+{
+public:
+    enum class Op
+    {
+        EQUAL,
+        NOT_EQUAL,
+        LESS,
+        LESS_EQUAL,
+        GREATER,
+        GREATER_EQUAL,
+        CONTAINS,
+        NOT_CONTAINS
+    };
+
+private:
+    // Text fields first, in column order
+    enum class Field
+    {
+        ARTIST,
+        ALBUM,
+        GENRE,
+        TITLE,
+        YEAR,
+        DURATION,
+        TYPE,
+        ANY
+    };
+
+    struct Predicate
+    {
+        Field field;
+        Op op;
+        int32_t number = 0;
+        std::string text; // lowercased
+    };
+
+    std::vector<Predicate> predicates;
+
+public:
+    // Replace the query with text; on a syntax error it is reported on std::cerr
+    // and the query is left unchanged
+    bool parse(const std::string &text);
+    bool empty() const;
+
+    // Compile the predicates against the dictionaries of columns into a filter
+    // pipeline and run it over the column arrays a block of rows at a time
+    QueryResult run(const LibraryColumns &columns) const;
+};
+
+#endif // LIBRARY_QUERY_H
@@ -1,9 +1,12 @@
 #include "manager.h"
+#include "binary_io.h"
 
 #include <mutex>
 #include <filesystem>
 #include <exception>
 #include <iostream>
+#include <unordered_map>
+#include <unordered_set>
 #include <sys/stat.h>
 
 #include <taglib/fileref.h>
@@ -11,7 +14,6 @@
 #include <taglib/mpegfile.h>
 #include <taglib/mp4file.h>
 #include <taglib/flacfile.h>
-#include <taglib/vorbisfile.h>
 #include <taglib/wavfile.h>
 
 #ifdef _WIN32
@@ -33,15 +35,68 @@ std::wstring utf8_to_wstring(const std::string &str)
 using json = nlohmann::json;
 namespace fs = std::filesystem;
 
-// MetadataManager implementations
-bool MetadataManager::loadMetadata(std::shared_ptr<MediaFileModel> mediaFile)
+// Open with the parser matching the sniffed container, so a file with a wrong
+// extension is still read and TagLib does not have to guess the format again.
+// Ogg may hold Vorbis, Opus, FLAC or Theora, FileRef tells them apart.
+static TagLib::FileRef openTagFile(const std::shared_ptr<MediaFileModel> &mediaFile)
 {
 #ifdef _WIN32
-    TagLib::FileRef f(utf8_to_wstring(mediaFile->getFilepath()).c_str());
+    std::wstring path = utf8_to_wstring(mediaFile->getFilepath());
 #else
-    TagLib::FileRef f(mediaFile->getFilepath().c_str());
+    const std::string &path = mediaFile->getFilepath();
 #endif
 
+    switch (mediaFile->getContainer())
+    {
+    case ContainerFormat::MPEG_AUDIO:
+        return TagLib::FileRef(new TagLib::MPEG::File(path.c_str()));
+    case ContainerFormat::FLAC:
+        return TagLib::FileRef(new TagLib::FLAC::File(path.c_str()));
+    case ContainerFormat::WAV:
+        return TagLib::FileRef(new TagLib::RIFF::WAV::File(path.c_str()));
+    case ContainerFormat::MP4:
+        return TagLib::FileRef(new TagLib::MP4::File(path.c_str()));
+    default:
+        return TagLib::FileRef(path.c_str());
+    }
+}
+
+// Same fields and formatting as readTagLibMetadata
+static void applyNativeTags(MediaFileModel &mediaFile, const NativeTags &tags)
+{
+    mediaFile.setMetadata(MetadataField::TITLE, tags.title);
+    mediaFile.setMetadata(MetadataField::ARTIST, tags.artist);
+    mediaFile.setMetadata(MetadataField::ALBUM, tags.album);
+    mediaFile.setMetadata(MetadataField::COMMENT, tags.comment);
+    mediaFile.setMetadata(MetadataField::GENRE, tags.genre);
+    mediaFile.setMetadata(MetadataField::YEAR, std::to_string(tags.year));
+    mediaFile.setMetadata(MetadataField::TRACK, std::to_string(tags.track));
+
+    mediaFile.setDuration(tags.duration);
+    mediaFile.setMetadata(MetadataField::BITRATE, std::to_string(tags.bitrate) + " kbps");
+    mediaFile.setMetadata(MetadataField::CHANNELS, std::to_string(tags.channels));
+    mediaFile.setMetadata(MetadataField::SAMPLE_RATE, std::to_string(tags.sampleRate) + " Hz");
+}
+
+// TagLib knows little about video containers beyond MP4, the probe fills what the views show
+static void applyContainerInfo(MediaFileModel &mediaFile, const ContainerInfo &info)
+{
+    if (!info.title.empty())
+        mediaFile.setMetadata(MetadataField::TITLE, info.title);
+    mediaFile.setDuration(info.duration);
+    mediaFile.setMetadata(MetadataField::BITRATE, std::to_string(info.bitrate) + " kbps");
+    mediaFile.setMetadata(MetadataField::CODEC, info.codec);
+    if (info.channels > 0)
+    {
+        mediaFile.setMetadata(MetadataField::CHANNELS, std::to_string(info.channels));
+        mediaFile.setMetadata(MetadataField::SAMPLE_RATE, std::to_string(info.sampleRate) + " Hz");
+    }
+}
+
+static bool readTagLibMetadata(const std::shared_ptr<MediaFileModel> &mediaFile)
+{
+    TagLib::FileRef f = openTagFile(mediaFile);
+
     if (f.isNull())
         return false;
 
@@ -49,34 +104,65 @@ bool MetadataManager::loadMetadata(std::shared_ptr<MediaFileModel> mediaFile)
     {
         TagLib::Tag *tag = f.tag();
 
-        mediaFile->setMetadata("Title", tag->title().to8Bit(true));
-        mediaFile->setMetadata("Artist", tag->artist().to8Bit(true));
-        mediaFile->setMetadata("Album", tag->album().to8Bit(true));
-        mediaFile->setMetadata("Comment", tag->comment().to8Bit(true));
-        mediaFile->setMetadata("Genre", tag->genre().to8Bit(true));
-        mediaFile->setMetadata("Year", std::to_string(tag->year()));
-        mediaFile->setMetadata("Track", std::to_string(tag->track()));
+        mediaFile->setMetadata(MetadataField::TITLE, tag->title().to8Bit(true));
+        mediaFile->setMetadata(MetadataField::ARTIST, tag->artist().to8Bit(true));
+        mediaFile->setMetadata(MetadataField::ALBUM, tag->album().to8Bit(true));
+        mediaFile->setMetadata(MetadataField::COMMENT, tag->comment().to8Bit(true));
+        mediaFile->setMetadata(MetadataField::GENRE, tag->genre().to8Bit(true));
+        mediaFile->setMetadata(MetadataField::YEAR, std::to_string(tag->year()));
+        mediaFile->setMetadata(MetadataField::TRACK, std::to_string(tag->track()));
     }
 
     if (f.audioProperties())
     {
         TagLib::AudioProperties *props = f.audioProperties();
         mediaFile->setDuration(props->lengthInSeconds());
-        mediaFile->setMetadata("Bitrate", std::to_string(props->bitrate()) + " kbps");
-        mediaFile->setMetadata("Channels", std::to_string(props->channels()));
-        mediaFile->setMetadata("Sample Rate", std::to_string(props->sampleRate()) + " Hz");
+        mediaFile->setMetadata(MetadataField::BITRATE, std::to_string(props->bitrate()) + " kbps");
+        mediaFile->setMetadata(MetadataField::CHANNELS, std::to_string(props->channels()));
+        mediaFile->setMetadata(MetadataField::SAMPLE_RATE, std::to_string(props->sampleRate()) + " Hz");
     }
-
     return true;
 }
 
-bool MetadataManager::saveMetadata(std::shared_ptr<MediaFileModel> mediaFile)
+// Number stored in a tag field, 0 when the text is not one
+static unsigned int parseTagNumber(const std::string &text)
 {
-#ifdef _WIN32
-    TagLib::FileRef f(utf8_to_wstring(mediaFile->getFilepath()).c_str());
-#else
-    TagLib::FileRef f(mediaFile->getFilepath().c_str());
-#endif
+    unsigned int value = 0;
+    for (char c : text)
+    {
+        if (c < '0' || c > '9')
+            return 0;
+        value = value * 10 + (c - '0');
+    }
+    return value;
+}
+
+// The edited tag fields of mediaFile; empty ones are left as they are in the file
+static NativeTags tagsToWrite(const MediaFileModel &mediaFile)
+{
+    NativeTags tags;
+    tags.title = mediaFile.getMetadata(MetadataField::TITLE);
+    tags.artist = mediaFile.getMetadata(MetadataField::ARTIST);
+    tags.album = mediaFile.getMetadata(MetadataField::ALBUM);
+    tags.comment = mediaFile.getMetadata(MetadataField::COMMENT);
+    tags.genre = mediaFile.getMetadata(MetadataField::GENRE);
+    tags.year = parseTagNumber(mediaFile.getMetadata(MetadataField::YEAR));
+    tags.track = parseTagNumber(mediaFile.getMetadata(MetadataField::TRACK));
+    return tags;
+}
+
+// Bytes of tag text a save writes
+static size_t tagTextSize(const NativeTags &tags)
+{
+    return tags.title.size() + tags.artist.size() + tags.album.size() + tags.comment.size() + tags.genre.size() +
+           (tags.year ? std::to_string(tags.year).size() : 0) + (tags.track ? std::to_string(tags.track).size() : 0);
+}
+
+static bool setTagLibFields(const std::string &path, ContainerFormat container, const NativeTags &tags)
+{
+    auto target = std::make_shared<MediaFileModel>(path);
+    target->setContainer(container);
+    TagLib::FileRef f = openTagFile(target);
 
     if (f.isNull())
         return false;
@@ -85,24 +171,152 @@ bool MetadataManager::saveMetadata(std::shared_ptr<MediaFileModel> mediaFile)
     if (!tag)
         return false;
 
-    if (!mediaFile->getMetadata("Title").empty())
-        tag->setTitle(TagLib::String(mediaFile->getMetadata("Title"), TagLib::String::UTF8));
-    if (!mediaFile->getMetadata("Artist").empty())
-        tag->setArtist(TagLib::String(mediaFile->getMetadata("Artist"), TagLib::String::UTF8));
-    if (!mediaFile->getMetadata("Album").empty())
-        tag->setAlbum(TagLib::String(mediaFile->getMetadata("Album"), TagLib::String::UTF8));
-    if (!mediaFile->getMetadata("Comment").empty())
-        tag->setComment(TagLib::String(mediaFile->getMetadata("Comment"), TagLib::String::UTF8));
-    if (!mediaFile->getMetadata("Genre").empty())
-        tag->setGenre(TagLib::String(mediaFile->getMetadata("Genre"), TagLib::String::UTF8));
-    if (!mediaFile->getMetadata("Year").empty())
-        tag->setYear(std::stoi(mediaFile->getMetadata("Year")));
-    if (!mediaFile->getMetadata("Track").empty())
-        tag->setTrack(std::stoi(mediaFile->getMetadata("Track")));
+    if (!tags.title.empty())
+        tag->setTitle(TagLib::String(tags.title, TagLib::String::UTF8));
+    if (!tags.artist.empty())
+        tag->setArtist(TagLib::String(tags.artist, TagLib::String::UTF8));
+    if (!tags.album.empty())
+        tag->setAlbum(TagLib::String(tags.album, TagLib::String::UTF8));
+    if (!tags.comment.empty())
+        tag->setComment(TagLib::String(tags.comment, TagLib::String::UTF8));
+    if (!tags.genre.empty())
+        tag->setGenre(TagLib::String(tags.genre, TagLib::String::UTF8));
+    if (tags.year)
+        tag->setYear(tags.year);
+    if (tags.track)
+        tag->setTrack(tags.track);
 
     return f.save();
 }
 
+// Formats writeNativeTags does not handle. Tags that fit in the current ones are saved
+// in place by TagLib; larger ones on a copy that replaces the file by rename, so a crash
+// mid-write cannot leave a truncated file behind.
+static bool saveWithTagLib(const std::shared_ptr<MediaFileModel> &mediaFile, const NativeTags &tags, TagWriteStats &stats)
+{
+    const std::string &path = mediaFile->getFilepath();
+    NativeTags current;
+    bool grows = !readNativeTags(path, current) || tagTextSize(tags) > tagTextSize(current);
+    if (!grows)
+        return setTagLibFields(path, mediaFile->getContainer(), tags);
+
+    std::string target = path + ".tagtmp";
+    std::error_code ec;
+    fs::copy_file(fs::u8path(path), fs::u8path(target), fs::copy_options::overwrite_existing, ec);
+    if (ec)
+    {
+        std::cerr << "Failed to copy " << path << " for writing tags: " << ec.message() << "\n";
+        return false;
+    }
+
+    if (!setTagLibFields(target, mediaFile->getContainer(), tags))
+    {
+        fs::remove(fs::u8path(target), ec);
+        return false;
+    }
+    if (!syncFile(target))
+        std::cerr << "Failed to flush " << target << "\n";
+    uint64_t size = fs::file_size(fs::u8path(target), ec);
+    fs::rename(fs::u8path(target), fs::u8path(path), ec);
+    if (ec)
+    {
+        std::cerr << "Failed to replace " << path << ": " << ec.message() << "\n";
+        fs::remove(fs::u8path(target), ec);
+        return false;
+    }
+    stats.bytesWritten = size;
+    stats.rewroteFile = true;
+    return true;
+}
+
+// MetadataManager implementations
+void MetadataManager::setNativeTagReader(bool enabled)
+{
+    nativeTagReader = enabled;
+}
+
+void MetadataManager::setNativeTagWriter(bool enabled)
+{
+    nativeTagWriter = enabled;
+}
+
+void MetadataManager::setTagPadding(size_t bytes)
+{
+    tagPadding = bytes;
+}
+
+void MetadataManager::setCache(std::shared_ptr<MetadataCache> metadataCache)
+{
+    cache = metadataCache;
+}
+
+bool MetadataManager::loadMetadata(std::shared_ptr<MediaFileModel> mediaFile)
+{
+    // A stale entry (same inode, new size or mtime) falls through and is re-parsed
+    MetadataCacheKey key;
+    bool cacheable = cache && MetadataCache::readKey(mediaFile->getFilepath(), key);
+    if (cacheable)
+    {
+        int duration = 0;
+        std::map<std::string, std::string> metadata;
+        if (cache->lookup(key, duration, metadata) == MetadataCache::LookupResult::HIT)
+        {
+            mediaFile->setDuration(duration);
+            for (const auto &[name, value] : metadata)
+                mediaFile->setMetadata(name, value);
+            mediaFile->setMetadataLoaded(true);
+            return true;
+        }
+    }
+
+    NativeTags tags;
+    ContainerInfo container;
+    if (nativeTagReader && readNativeTags(mediaFile->getFilepath(), tags))
+        applyNativeTags(*mediaFile, tags);
+    else if (nativeTagReader && mediaFile->getType() == MediaType::VIDEO && probeContainer(mediaFile->getFilepath(), container))
+        applyContainerInfo(*mediaFile, container);
+    else if (!readTagLibMetadata(mediaFile))
+        return false;
+
+    mediaFile->setMetadataLoaded(true);
+    if (cacheable)
+        cache->store(key, mediaFile->getDuration(), mediaFile->getAllMetadata());
+    return true;
+}
+
+bool MetadataManager::saveMetadata(std::shared_ptr<MediaFileModel> mediaFile, TagWriteStats *stats)
+{
+    TagWriteStats localStats;
+    TagWriteStats &written = stats ? *stats : localStats;
+    written = TagWriteStats();
+
+    NativeTags tags = tagsToWrite(*mediaFile);
+    TagWriteResult result = TagWriteResult::UNSUPPORTED;
+    if (nativeTagWriter)
+        result = writeNativeTags(mediaFile->getFilepath(), tags, tagPadding, written);
+    if (result == TagWriteResult::FAILED)
+        return false;
+    if (result == TagWriteResult::UNSUPPORTED)
+    {
+        written = TagWriteStats();
+        if (!saveWithTagLib(mediaFile, tags, written))
+            return false;
+    }
+
+    // The save changed the mtime; record the new tags so they are not parsed again.
+    // A model holding only some of the tags (e.g. a batch edit's changes) would
+    // hide the others from later reads, the file is parsed again instead.
+    MetadataCacheKey key;
+    if (cache && MetadataCache::readKey(mediaFile->getFilepath(), key))
+    {
+        if (mediaFile->isMetadataLoaded())
+            cache->store(key, mediaFile->getDuration(), mediaFile->getAllMetadata());
+        else
+            cache->remove(key);
+    }
+    return true;
+}
+
 bool PlaylistsManager::createPlaylist(const std::string &name)
 {
     std::lock_guard<std::mutex> lock(playlistsMutex);
@@ -235,133 +449,798 @@ void PlaylistsManager::loadPlaylistFromJson(json &js)
 
 // MediaLibrary implementation
 
-bool MediaLibrary::isAudioFile(std::filesystem::path &path)
+// filepath lies below directory dir
+static bool isBelowPath(const std::string &filepath, const std::string &dir)
 {
-    std::string u8path = path.u8string();
-    std::string ext = u8path.substr(u8path.find_last_of(".") + 1);
-    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
-    return std::find(supportedAudioExtensions.begin(), supportedAudioExtensions.end(), ext) != supportedAudioExtensions.end();
+    return filepath.size() > dir.size() && filepath.compare(0, dir.size(), dir) == 0 &&
+           (filepath[dir.size()] == '/' || filepath[dir.size()] == '\\');
 }
 
-bool MediaLibrary::isVideoFile(std::filesystem::path &path)
+// filepath lies on one of the mounted devices
+static bool isOnDevice(const std::string &filepath, const std::vector<std::string> &devices)
 {
-    std::string u8path = path.u8string();
-    std::string ext = u8path.substr(u8path.find_last_of(".") + 1);
-    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
-    return std::find(supportedVideoExtensions.begin(), supportedVideoExtensions.end(), ext) != supportedVideoExtensions.end();
+    for (const auto &device : devices)
+    {
+        if (isBelowPath(filepath, device))
+            return true;
+    }
+    return false;
+}
+
+std::shared_ptr<MediaFileModel> MediaLibrary::createMediaFile(const ScanEntry &entry, const KnownFiles &known,
+                                                              const LibraryIndex &index)
+{
+    // Files whose size and mtime did not change keep their already extracted tags
+    auto it = known.find(entry.filepath);
+    if (it != known.end() && it->second.size == entry.size && it->second.mtime == entry.mtime)
+        return it->second.file;
+
+    if (const LibraryIndexRecord *record = index.findUnchanged(entry.filepath, entry.size, entry.mtime))
+        return LibraryIndex::createMediaFile(*record);
+
+    std::shared_ptr<MediaFileModel> media;
+    if (entry.type == MediaType::AUDIO)
+        media = std::make_shared<AudioFileModel>(entry.filepath);
+    else
+        media = std::make_shared<VideoFileModel>(entry.filepath);
+    media->setContainer(entry.container);
+    media->setFileStat(entry.size, entry.mtime);
+    return media;
+}
+
+// Registers a job for cancelScan for as long as its scan runs
+class MediaLibrary::ActiveJob
+{
+private:
+    MediaLibrary &library;
+    std::shared_ptr<ScanJob> job;
+
+public:
+    ActiveJob(MediaLibrary &library, std::shared_ptr<ScanJob> job) : library(library), job(std::move(job))
+    {
+        std::lock_guard<std::mutex> lock(library.activeJobsMutex);
+        library.activeJobs.push_back(this->job);
+    }
+
+    ~ActiveJob()
+    {
+        std::lock_guard<std::mutex> lock(library.activeJobsMutex);
+        auto &jobs = library.activeJobs;
+        jobs.erase(std::find(jobs.begin(), jobs.end(), job));
+    }
+};
+
+MediaLibrary::~MediaLibrary()
+{
+    cancelScan();
 }
 
 void MediaLibrary::scanDirectory(fs::path &path)
 {
-    std::lock_guard<std::mutex> lock(libraryMutex);
-    mediaFiles.clear();
-    try
+    scanDirectory(path, nullptr);
+}
+
+void MediaLibrary::scanDirectory(fs::path &path, ScanChunkCallback onChunk, std::shared_ptr<ScanJob> job)
+{
+    if (!job)
+        job = std::make_shared<ScanJob>();
+    ActiveJob active(*this, job);
+
+    KnownFiles known;
+    std::shared_ptr<const LibraryIndex> index;
+    std::vector<std::shared_ptr<MediaFileModel>> previousFiles;
+    SearchIndex previousIndex;
+    FacetIndex previousFacets;
+    LibraryColumns previousColumns;
+    fs::path previousRoot;
+    std::vector<std::string> previousDevices;
+    const std::string root = path.u8string();
     {
-        for (const auto &entry : fs::recursive_directory_iterator(path))
+        std::lock_guard<std::mutex> lock(libraryMutex);
+        index = libraryIndex;
+        for (const auto &file : mediaFiles)
+            known.emplace(file->getFilepath(), KnownFile{file, file->getFileSize(), file->getModifiedTime()});
+
+        if (onChunk)
         {
-            if (entry.is_regular_file())
+            previousFiles.swap(mediaFiles);
+            previousIndex.swap(searchIndex);
+            previousFacets.swap(facetIndex);
+            previousColumns.swap(columns);
+            previousRoot = rootDirectory;
+            previousDevices = devicePaths;
+            rootDirectory = path;
+
+            // Devices stay in the library, only the root is scanned again
+            for (const auto &file : previousFiles)
             {
-                fs::path filepath = entry.path();
-#ifdef _WIN32
-                if (isAudioFile(filepath))
-                {
-                    mediaFiles.push_back(std::make_shared<AudioFileModel>(wstring_to_utf8(filepath.wstring())));
-                }
-                else if (isVideoFile(filepath))
-                {
-                    mediaFiles.push_back(std::make_shared<VideoFileModel>(wstring_to_utf8(filepath.wstring())));
-                }
-#else
-                if (isAudioFile(filepath))
-                {
-                    mediaFiles.push_back(std::make_shared<AudioFileModel>(filepath.string()));
-                }
-                else if (isVideoFile(filepath))
+                if (isOnDevice(file->getFilepath(), devicePaths) && !isBelowPath(file->getFilepath(), root))
                 {
-                    mediaFiles.push_back(std::make_shared<VideoFileModel>(filepath.string()));
+                    mediaFiles.push_back(file);
+                    indexFile(file, &previousIndex, &previousFacets, &previousColumns);
                 }
-#endif
             }
+            rebuildFileLookup();
+            // Delivered as the first chunk, so the rows of a listing built from the
+            // chunks follow mediaFiles
+            if (!mediaFiles.empty())
+                onChunk(mediaFiles);
         }
     }
-    catch (const fs::filesystem_error &e)
+
+    if (onChunk)
     {
-        std::cerr << "Filesystem error: " << e.what() << std::endl;
+        scanner.scan(
+            path, classifyMediaFile,
+            [&](std::vector<ScanEntry> &&chunk)
+            {
+                std::vector<std::shared_ptr<MediaFileModel>> found;
+                found.reserve(chunk.size());
+                for (const auto &entry : chunk)
+                    found.push_back(createMediaFile(entry, known, *index));
+
+                std::lock_guard<std::mutex> lock(libraryMutex);
+                mediaFiles.insert(mediaFiles.end(), found.begin(), found.end());
+                for (const auto &file : found)
+                    indexFile(file, &previousIndex, &previousFacets, &previousColumns);
+                onChunk(found);
+            },
+            job);
+
+        std::lock_guard<std::mutex> lock(libraryMutex);
+        if (job->isCancelled())
+        {
+            auto byPath = [](const std::shared_ptr<MediaFileModel> &a, const std::shared_ptr<MediaFileModel> &b)
+            {
+                return a->getFilepath() < b->getFilepath();
+            };
+
+            // Back to the previous root files, with the devices as they are now:
+            // one may have been added or removed while scanning
+            std::vector<std::shared_ptr<MediaFileModel>> rootFiles;
+            std::vector<std::shared_ptr<MediaFileModel>> deviceFiles;
+            for (const auto &file : previousFiles)
+            {
+                if (!isOnDevice(file->getFilepath(), previousDevices) && !isOnDevice(file->getFilepath(), devicePaths))
+                    rootFiles.push_back(file);
+            }
+            for (const auto &file : mediaFiles)
+            {
+                if (isOnDevice(file->getFilepath(), devicePaths))
+                    deviceFiles.push_back(file);
+            }
+            std::sort(deviceFiles.begin(), deviceFiles.end(), byPath);
+            std::vector<std::shared_ptr<MediaFileModel>> restored;
+            restored.reserve(rootFiles.size() + deviceFiles.size());
+            std::merge(rootFiles.begin(), rootFiles.end(), deviceFiles.begin(), deviceFiles.end(),
+                       std::back_inserter(restored), byPath);
+
+            mediaFiles.swap(restored);
+            searchIndex.swap(previousIndex);
+            facetIndex.swap(previousFacets);
+            columns.swap(previousColumns);
+            rootDirectory = previousRoot;
+            if (mediaFiles == previousFiles)
+                rebuildFileLookup();
+            else
+                rebuildIndexes();
+            return;
+        }
+        std::sort(mediaFiles.begin(), mediaFiles.end(),
+                  [](const std::shared_ptr<MediaFileModel> &a, const std::shared_ptr<MediaFileModel> &b)
+                  {
+                      return a->getFilepath() < b->getFilepath();
+                  });
+        return;
     }
+
+    // Walk the tree without holding the library lock, then publish in one step
+    std::vector<ScanEntry> entries = scanner.scan(path, classifyMediaFile, nullptr, job);
+    if (job->isCancelled())
+        return;
+
+    std::vector<std::shared_ptr<MediaFileModel>> scanned;
+    scanned.reserve(entries.size());
+    for (const auto &entry : entries)
+        scanned.push_back(createMediaFile(entry, known, *index));
+
+    std::lock_guard<std::mutex> lock(libraryMutex);
+    // Devices stay in the library, only the root is replaced
+    std::vector<std::shared_ptr<MediaFileModel>> deviceFiles;
+    for (const auto &file : mediaFiles)
+    {
+        if (isOnDevice(file->getFilepath(), devicePaths) && !isBelowPath(file->getFilepath(), root))
+            deviceFiles.push_back(file);
+    }
+    mediaFiles.clear();
+    mediaFiles.reserve(scanned.size() + deviceFiles.size());
+    std::merge(scanned.begin(), scanned.end(), deviceFiles.begin(), deviceFiles.end(), std::back_inserter(mediaFiles),
+               [](const std::shared_ptr<MediaFileModel> &a, const std::shared_ptr<MediaFileModel> &b)
+               {
+                   return a->getFilepath() < b->getFilepath();
+               });
+    rootDirectory = path;
+    rebuildIndexes();
 }
 
-void MediaLibrary::scanUSBDevice(fs::path &mountPoint)
+std::shared_ptr<ScanJob> MediaLibrary::startScan(const fs::path &path, ScanChunkCallback onChunk,
+                                                  ScanFinishedCallback onFinished)
 {
-    scanDirectory(mountPoint);
+    // Only the previous background scan, a device scan must finish or its files are lost
+    cancelBackgroundScan();
+
+    auto job = std::make_shared<ScanJob>();
+    scanJob = job;
+
+    scanThread = std::thread(
+        [this, path, onChunk, onFinished, job]()
+        {
+            fs::path dir = path;
+            scanDirectory(dir, onChunk, job);
+            if (onFinished)
+                onFinished(!job->isCancelled());
+        });
+    return job;
 }
 
-std::shared_ptr<MediaFileModel> MediaLibrary::getMediaFile(int index) const
+void MediaLibrary::cancelBackgroundScan()
 {
-    return mediaFiles[index];
+    if (scanJob)
+    {
+        scanJob->cancel();
+        scanJob.reset();
+    }
+    if (scanThread.joinable())
+    {
+        scanThread.join();
+    }
 }
-std::vector<std::shared_ptr<MediaFileModel>> MediaLibrary::getMediaFiles() const
+
+void MediaLibrary::cancelScan()
 {
-    return mediaFiles;
+    {
+        std::lock_guard<std::mutex> lock(activeJobsMutex);
+        for (const auto &job : activeJobs)
+            job->cancel();
+    }
+    cancelBackgroundScan();
 }
 
-std::vector<std::shared_ptr<MediaFileModel>> MediaLibrary::searchMedia(const std::string &keyword) const
+void MediaLibrary::setScanIdleIoPriority(bool enabled)
 {
-    std::vector<std::shared_ptr<MediaFileModel>> result;
-    std::string lowerKeyword = keyword;
-    std::transform(lowerKeyword.begin(), lowerKeyword.end(), lowerKeyword.begin(), ::tolower);
+    scanner.setIdleIoPriority(enabled);
+}
+
+void MediaLibrary::setScanReadLimit(unsigned int directoryReadsPerSecond)
+{
+    scanner.setDirectoryReadLimit(directoryReadsPerSecond);
+}
 
+void MediaLibrary::setScanThreadCount(unsigned int threads)
+{
+    scanner.setThreadCount(threads);
+}
+
+unsigned int MediaLibrary::getScanThreadCount() const
+{
+    return scanner.getThreadCount();
+}
+
+void MediaLibrary::setScanBackend(ScanBackend backend)
+{
+    scanner.setBackend(backend);
+}
+
+void MediaLibrary::setContentSniffing(bool enabled)
+{
+    scanner.setContentSniffing(enabled);
+}
+
+bool MediaLibrary::loadIndex(const std::string &indexPath)
+{
+    auto index = std::make_shared<LibraryIndex>();
+    if (!index->load(indexPath))
+        return false;
+
+    std::vector<std::shared_ptr<MediaFileModel>> restored;
+    restored.reserve(index->getRecords().size());
+    for (const auto &record : index->getRecords())
+    {
+        // Only a stat per file; tags are re-read only for files that changed
+        uint64_t size;
+        int64_t mtime;
+        if (!readFileStat(record.filepath, size, mtime))
+            continue; // removed since the index was written
+
+        auto media = LibraryIndex::createMediaFile(record);
+        if (size != record.size || mtime != record.mtime)
+        {
+            media->setFileStat(size, mtime);
+            media->setMetadataLoaded(false);
+        }
+        restored.push_back(media);
+    }
+
+    std::lock_guard<std::mutex> lock(libraryMutex);
+    mediaFiles.swap(restored);
+    rootDirectory = fs::u8path(index->getRootDirectory());
+    libraryIndex = index;
+    rebuildIndexes();
+    return true;
+}
+
+bool MediaLibrary::saveIndex(const std::string &indexPath)
+{
+    auto index = std::make_shared<LibraryIndex>();
+    {
+        std::lock_guard<std::mutex> lock(libraryMutex);
+        index->assign(mediaFiles, *libraryIndex);
+        index->setRootDirectory(rootDirectory.u8string());
+        libraryIndex = index;
+    }
+    return index->save(indexPath);
+}
+
+fs::path MediaLibrary::getRootDirectory() const
+{
+    std::lock_guard<std::mutex> lock(libraryMutex);
+    return rootDirectory;
+}
+
+bool MediaLibrary::updateFiles(const std::vector<std::string> &changedFiles, const std::vector<std::string> &removedPaths)
+{
+    // Stat and build the new models before taking the lock
+    std::unordered_map<std::string, std::shared_ptr<MediaFileModel>> changed;
+    for (const auto &path : changedFiles)
+    {
+        MediaType type = classifyMediaFile(path);
+        ContainerFormat container = ContainerFormat::UNKNOWN;
+        if (type == MediaType::UNKNOWN && scanner.isContentSniffing())
+        {
+            uint8_t header[sniffHeaderSize];
+            long length = readFileHeader(path, header);
+            SniffResult sniffed = sniffMediaHeader(header, length > 0 ? length : 0);
+            type = sniffed.type;
+            container = sniffed.container;
+        }
+        if (type == MediaType::UNKNOWN)
+            continue;
+
+        uint64_t size;
+        int64_t mtime;
+        if (!readFileStat(path, size, mtime))
+            continue;
+
+        std::shared_ptr<MediaFileModel> media;
+        if (type == MediaType::AUDIO)
+            media = std::make_shared<AudioFileModel>(path);
+        else
+            media = std::make_shared<VideoFileModel>(path);
+        media->setContainer(container);
+        media->setFileStat(size, mtime);
+        changed[path] = media;
+    }
+
+    std::unordered_set<std::string> removed(removedPaths.begin(), removedPaths.end());
+    auto isRemoved = [&removed](const std::string &filepath)
+    {
+        if (removed.empty())
+            return false;
+        // The file itself or any of its parent directories
+        for (size_t end = filepath.size(); end != std::string::npos && end > 0; end = filepath.find_last_of("/\\", end - 1))
+        {
+            if (removed.count(filepath.substr(0, end)))
+                return true;
+        }
+        return false;
+    };
+
+    std::lock_guard<std::mutex> lock(libraryMutex);
+
+    bool modified = false;
+    std::vector<std::shared_ptr<MediaFileModel>> kept;
+    kept.reserve(mediaFiles.size() + changed.size());
     for (const auto &file : mediaFiles)
     {
-        std::string filename = file->getFilename();
-        std::transform(filename.begin(), filename.end(), filename.begin(), ::tolower);
+        const std::string &filepath = file->getFilepath();
+        auto it = changed.find(filepath);
+        if (it != changed.end())
+        {
+            if (it->second->getFileSize() == file->getFileSize() &&
+                it->second->getModifiedTime() == file->getModifiedTime())
+            {
+                // Same content, keep the model and its tags
+                changed.erase(it);
+                kept.push_back(file);
+            }
+            else
+            {
+                unindexFile(file);
+                modified = true;
+            }
+            continue;
+        }
 
-        if (filename.find(lowerKeyword) != std::string::npos)
+        if (isRemoved(filepath))
         {
-            result.push_back(file);
+            unindexFile(file);
+            modified = true;
+            continue;
         }
+        kept.push_back(file);
+    }
+
+    std::vector<std::shared_ptr<MediaFileModel>> added;
+    added.reserve(changed.size());
+    for (auto &[path, media] : changed)
+    {
+        added.push_back(media);
+        indexFile(media);
+    }
+
+    if (added.empty() && !modified)
+        return false;
+
+    auto byPath = [](const std::shared_ptr<MediaFileModel> &a, const std::shared_ptr<MediaFileModel> &b)
+    {
+        return a->getFilepath() < b->getFilepath();
+    };
+    std::sort(added.begin(), added.end(), byPath);
+
+    mediaFiles.clear();
+    mediaFiles.reserve(kept.size() + added.size());
+    std::merge(kept.begin(), kept.end(), added.begin(), added.end(), std::back_inserter(mediaFiles), byPath);
+    return true;
+}
+
+void MediaLibrary::scanUSBDevice(fs::path &mountPoint)
+{
+    // The device is added next to the current library instead of replacing it
+    KnownFiles known;
+    std::shared_ptr<const LibraryIndex> index;
+    {
+        std::lock_guard<std::mutex> lock(libraryMutex);
+        index = libraryIndex;
+        for (const auto &file : mediaFiles)
+            known.emplace(file->getFilepath(), KnownFile{file, file->getFileSize(), file->getModifiedTime()});
+    }
+
+    // Entries come back sorted by path
+    auto job = std::make_shared<ScanJob>();
+    ActiveJob active(*this, job);
+    std::vector<ScanEntry> entries = scanner.scan(mountPoint, classifyMediaFile, nullptr, job);
+    if (job->isCancelled())
+        return;
+    std::vector<std::shared_ptr<MediaFileModel>> added;
+    added.reserve(entries.size());
+    for (const auto &entry : entries)
+        added.push_back(createMediaFile(entry, known, *index));
+
+    const std::string device = mountPoint.u8string();
+    std::lock_guard<std::mutex> lock(libraryMutex);
+    if (std::find(devicePaths.begin(), devicePaths.end(), device) == devicePaths.end())
+        devicePaths.push_back(device);
+
+    std::vector<std::shared_ptr<MediaFileModel>> kept;
+    kept.reserve(mediaFiles.size());
+    std::unordered_set<const MediaFileModel *> rescanned;
+    for (const auto &file : added)
+        rescanned.insert(file.get());
+    // Unindex the replaced models first, their lookup entries share paths with the new ones
+    std::unordered_set<const MediaFileModel *> listed;
+    for (const auto &file : mediaFiles)
+    {
+        if (!isBelowPath(file->getFilepath(), device))
+            kept.push_back(file);
+        else if (rescanned.count(file.get()))
+            listed.insert(file.get());
         else
+            unindexFile(file);
+    }
+    // Models kept from a previous scan of the device keep their index entry
+    for (const auto &file : added)
+    {
+        if (!listed.count(file.get()))
+            indexFile(file);
+    }
+
+    mediaFiles.clear();
+    mediaFiles.reserve(kept.size() + added.size());
+    std::merge(kept.begin(), kept.end(), added.begin(), added.end(), std::back_inserter(mediaFiles),
+               [](const std::shared_ptr<MediaFileModel> &a, const std::shared_ptr<MediaFileModel> &b)
+               {
+                   return a->getFilepath() < b->getFilepath();
+               });
+}
+
+bool MediaLibrary::removeUSBDevice(fs::path &mountPoint)
+{
+    {
+        std::lock_guard<std::mutex> lock(libraryMutex);
+        devicePaths.erase(std::remove(devicePaths.begin(), devicePaths.end(), mountPoint.u8string()), devicePaths.end());
+    }
+    return updateFiles({}, {mountPoint.u8string()});
+}
+
+void MediaLibrary::detectDuplicates(std::function<void()> onFinished)
+{
+    std::vector<DuplicateDetector::Candidate> candidates;
+    {
+        std::lock_guard<std::mutex> lock(libraryMutex);
+        candidates.reserve(mediaFiles.size());
+        for (const auto &file : mediaFiles)
+            candidates.push_back({file, file->getFileSize(), file->getModifiedTime(), file->getContentHash()});
+    }
+
+    duplicateDetector.start(
+        std::move(candidates),
+        [this, onFinished](std::vector<std::pair<DuplicateDetector::Candidate, uint64_t>> &&computed,
+                           std::vector<DuplicateDetector::Group> &&groups)
         {
-            // Search in metadata
-            auto metadata = file->getAllMetadata();
-            for (const auto &[key, value] : metadata)
             {
-                std::string lowerValue = value;
-                std::transform(lowerValue.begin(), lowerValue.end(), lowerValue.begin(), ::tolower);
+                std::lock_guard<std::mutex> lock(libraryMutex);
+                // Cached in the index with the file, so the next run only hashes new files.
+                // A file rewritten while hashing keeps no hash, it belongs to the old content.
+                for (const auto &[candidate, hash] : computed)
+                {
+                    const auto &media = candidate.file;
+                    if (media->getFileSize() == candidate.size && media->getModifiedTime() == candidate.modifiedTime)
+                        media->setContentHash(hash);
+                }
 
-                if (lowerValue.find(lowerKeyword) != std::string::npos)
+                // Files removed while hashing must not show up in a group
+                std::unordered_set<const MediaFileModel *> present;
+                for (const auto &file : mediaFiles)
+                    present.insert(file.get());
+
+                duplicateGroups.clear();
+                for (auto &group : groups)
                 {
-                    result.push_back(file);
-                    break;
+                    group.erase(std::remove_if(group.begin(), group.end(),
+                                               [&present](const std::shared_ptr<MediaFileModel> &media)
+                                               {
+                                                   return !present.count(media.get());
+                                               }),
+                                group.end());
+                    if (group.size() >= 2)
+                        duplicateGroups.push_back(std::move(group));
                 }
             }
-        }
+
+            if (onFinished)
+                onFinished();
+        });
+}
+
+std::vector<DuplicateDetector::Group> MediaLibrary::getDuplicateGroups() const
+{
+    std::lock_guard<std::mutex> lock(libraryMutex);
+    return duplicateGroups;
+}
+
+std::shared_ptr<MediaFileModel> MediaLibrary::getMediaFile(int index) const
+{
+    std::lock_guard<std::mutex> lock(libraryMutex);
+    if (index < 0 || index >= static_cast<int>(mediaFiles.size()))
+        return nullptr;
+    return mediaFiles[index];
+}
+std::vector<std::shared_ptr<MediaFileModel>> MediaLibrary::getMediaFiles() const
+{
+    std::lock_guard<std::mutex> lock(libraryMutex);
+    return mediaFiles;
+}
+
+std::vector<std::shared_ptr<MediaFileModel>> MediaLibrary::getMediaFiles(size_t first, size_t count) const
+{
+    std::lock_guard<std::mutex> lock(libraryMutex);
+    if (first >= mediaFiles.size())
+        return {};
+    size_t last = first + std::min(count, mediaFiles.size() - first);
+    return std::vector<std::shared_ptr<MediaFileModel>>(mediaFiles.begin() + first, mediaFiles.begin() + last);
+}
+
+std::vector<std::shared_ptr<MediaFileModel>> MediaLibrary::searchMedia(const std::string &keyword,
+                                                                       const SearchIndex::CancelCheck &cancelled) const
+{
+    std::lock_guard<std::mutex> lock(libraryMutex);
+    return searchIndex.search(keyword, cancelled);
+}
+
+std::vector<std::shared_ptr<MediaFileModel>> MediaLibrary::refineSearch(
+    const std::vector<std::shared_ptr<MediaFileModel>> &files, const std::string &keyword,
+    const SearchIndex::CancelCheck &cancelled) const
+{
+    std::lock_guard<std::mutex> lock(libraryMutex);
+    return searchIndex.refine(files, keyword, cancelled);
+}
+
+uint64_t MediaLibrary::getSearchRevision() const
+{
+    std::lock_guard<std::mutex> lock(libraryMutex);
+    return searchIndex.getRevision();
+}
+
+void MediaLibrary::updateFileIndexes(const std::shared_ptr<MediaFileModel> &file)
+{
+    std::lock_guard<std::mutex> lock(libraryMutex);
+    if (searchIndex.contains(file.get()))
+    {
+        searchIndex.add(file);
+        facetIndex.add(file);
+        columns.add(file);
     }
+}
 
-    return result;
+void MediaLibrary::updateFileStat(const std::shared_ptr<MediaFileModel> &file, uint64_t size, int64_t mtime)
+{
+    std::lock_guard<std::mutex> lock(libraryMutex);
+    file->setFileStat(size, mtime);
+}
+
+void MediaLibrary::modifyFiles(const std::function<void()> &modify)
+{
+    std::lock_guard<std::mutex> lock(libraryMutex);
+    modify();
 }
 
-std::shared_ptr<MediaFileModel> MediaLibrary::getMediaByFilename(const std::string &filename) const
+bool MediaLibrary::queryMedia(const std::string &query, QueryResult &result) const
 {
+    LibraryQuery compiled;
+    if (!compiled.parse(query))
+        return false;
+
+    std::lock_guard<std::mutex> lock(libraryMutex);
+    result = compiled.run(columns);
+    return true;
+}
+
+std::vector<std::shared_ptr<MediaFileModel>> MediaLibrary::getQueryFiles(const QueryResult &result, size_t first,
+                                                                         size_t count) const
+{
+    std::vector<std::shared_ptr<MediaFileModel>> files;
+    std::lock_guard<std::mutex> lock(libraryMutex);
+    if (result.generation != columns.getGeneration())
+        return files;
+    for (size_t i = first; i < result.rows.size() && i < first + count; ++i)
+    {
+        if (auto file = columns.getFile(result.rows[i]))
+            files.push_back(file);
+    }
+    return files;
+}
+
+void MediaLibrary::getTagCoverage(size_t &tagged, size_t &total) const
+{
+    std::lock_guard<std::mutex> lock(libraryMutex);
+    total = facetIndex.size();
+    tagged = total - facetIndex.getUnreadCount();
+}
+
+size_t MediaLibrary::getFacetValueCount(Facet facet) const
+{
+    std::lock_guard<std::mutex> lock(libraryMutex);
+    return facetIndex.getValueCount(facet);
+}
+
+std::vector<std::pair<std::string, size_t>> MediaLibrary::getFacetValues(Facet facet, size_t first, size_t count) const
+{
+    std::lock_guard<std::mutex> lock(libraryMutex);
+    return facetIndex.getValues(facet, first, count);
+}
+
+size_t MediaLibrary::getFacetFileCount(Facet facet, const std::string &value) const
+{
+    std::lock_guard<std::mutex> lock(libraryMutex);
+    return facetIndex.getFileCount(facet, value);
+}
+
+std::vector<std::shared_ptr<MediaFileModel>> MediaLibrary::getFacetFiles(Facet facet, const std::string &value,
+                                                                         size_t first, size_t count) const
+{
+    std::lock_guard<std::mutex> lock(libraryMutex);
+    return facetIndex.getFiles(facet, value, first, count);
+}
+
+void MediaLibrary::indexFile(const std::shared_ptr<MediaFileModel> &file, const SearchIndex *previousSearch,
+                             const FacetIndex *previousFacets, const LibraryColumns *previousColumns)
+{
+    searchIndex.add(file, previousSearch);
+    facetIndex.add(file, previousFacets);
+    columns.add(file, previousColumns);
+    // Assigning would keep the key viewing the path of the model replaced
+    filesByPath.erase(file->getFilepath());
+    filesByPath.emplace(file->getFilepath(), file);
+    filesByName.emplace(file->getFilename(), file);
+}
+
+void MediaLibrary::unindexFile(const std::shared_ptr<MediaFileModel> &file)
+{
+    searchIndex.remove(file.get());
+    facetIndex.remove(file.get());
+    columns.remove(file.get());
+
+    auto byPath = filesByPath.find(file->getFilepath());
+    if (byPath != filesByPath.end() && byPath->second == file)
+        filesByPath.erase(byPath);
+
+    auto [first, last] = filesByName.equal_range(file->getFilename());
+    for (auto it = first; it != last; ++it)
+    {
+        if (it->second == file)
+        {
+            filesByName.erase(it);
+            break;
+        }
+    }
+}
+
+void MediaLibrary::rebuildFileLookup()
+{
+    filesByPath.clear();
+    filesByName.clear();
+    filesByPath.reserve(mediaFiles.size());
+    filesByName.reserve(mediaFiles.size());
     for (const auto &file : mediaFiles)
     {
-        if (file->getFilename() == filename)
-            return file;
+        filesByPath.erase(file->getFilepath());
+        filesByPath.emplace(file->getFilepath(), file);
+        filesByName.emplace(file->getFilename(), file);
     }
-    return nullptr;
 }
 
-std::shared_ptr<MediaFileModel> MediaLibrary::getMediaByFilepath(const std::string &filepath) const
+void MediaLibrary::rebuildIndexes()
 {
+    // Built in path order, so search results, facet buckets and query rows need no sorting
+    SearchIndex previous;
+    FacetIndex previousFacets;
+    LibraryColumns previousColumns;
+    previous.swap(searchIndex);
+    previousFacets.swap(facetIndex);
+    previousColumns.swap(columns);
     for (const auto &file : mediaFiles)
     {
-        if (file->getFilepath() == filepath)
-            return file;
+        searchIndex.add(file, &previous);
+        facetIndex.add(file, &previousFacets);
+        columns.add(file, &previousColumns);
     }
-    return nullptr;
+    rebuildFileLookup();
+}
+
+std::vector<std::shared_ptr<MediaFileModel>> MediaLibrary::getMediaByFilename(const std::string &filename) const
+{
+    std::vector<std::shared_ptr<MediaFileModel>> result;
+    {
+        std::lock_guard<std::mutex> lock(libraryMutex);
+        auto [first, last] = filesByName.equal_range(filename);
+        for (auto it = first; it != last; ++it)
+            result.push_back(it->second);
+    }
+    std::sort(result.begin(), result.end(),
+              [](const std::shared_ptr<MediaFileModel> &a, const std::shared_ptr<MediaFileModel> &b)
+              {
+                  return a->getFilepath() < b->getFilepath();
+              });
+    return result;
+}
+
+std::shared_ptr<MediaFileModel> MediaLibrary::getMediaByFilepath(const std::string &filepath) const
+{
+    std::lock_guard<std::mutex> lock(libraryMutex);
+    auto it = filesByPath.find(filepath);
+    return it != filesByPath.end() ? it->second : nullptr;
 }
 
 void MediaLibrary::clear()
 {
     std::lock_guard<std::mutex> lock(libraryMutex);
     mediaFiles.clear();
+    searchIndex.clear();
+    facetIndex.clear();
+    columns.clear();
+    filesByPath.clear();
+    filesByName.clear();
+    duplicateGroups.clear();
+    rootDirectory.clear();
+    devicePaths.clear();
 }
\ No newline at end of file
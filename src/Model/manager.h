@@ -2,48 +2,219 @@
 #define MANAGEMENT_CONTROLLER_H
 
 #include "playlist.h"
+#include "scanner.h"
+#include "library_index.h"
+#include "media_format.h"
+#include "sniffer.h"
+#include "duplicates.h"
+#include "metadata_cache.h"
+#include "tag_reader.h"
+#include "tag_writer.h"
+#include "container_probe.h"
+#include "search_index.h"
+#include "facet_index.h"
+#include "library_query.h"
 
 #include <mutex>
+#include <thread>
+#include <functional>
+#include <string_view>
+#include <unordered_map>
 #include <nlohmann/json.hpp>
 
 class MetadataManager
 {
+private:
+    std::shared_ptr<MetadataCache> cache;
+    bool nativeTagReader = true;
+    bool nativeTagWriter = true;
+    size_t tagPadding = 8 * 1024;
+
 public:
+    // Read MP3, FLAC and Ogg Vorbis tags with readNativeTags, and the stream headers
+    // of MP4/MOV, Matroska and AVI videos with probeContainer, before trying TagLib
+    void setNativeTagReader(bool enabled);
+
+    // Write MP3 and FLAC tags with writeNativeTags before trying TagLib
+    void setNativeTagWriter(bool enabled);
+
+    // Padding reserved behind the tag whenever a save has to rewrite the whole file,
+    // so later edits that grow the tag can still be written in place
+    void setTagPadding(size_t bytes);
+
+    // loadMetadata answers unchanged files from the cache and stores what it parses;
+    // set before the manager is used from other threads
+    void setCache(std::shared_ptr<MetadataCache> metadataCache);
 
     bool loadMetadata(std::shared_ptr<MediaFileModel> mediaFile);
 
-    bool saveMetadata(std::shared_ptr<MediaFileModel> mediaFile);
+    // stats, when given, reports how many bytes the save wrote. The cache takes the
+    // saved tags only from a model with all of them loaded.
+    bool saveMetadata(std::shared_ptr<MediaFileModel> mediaFile, TagWriteStats *stats = nullptr);
 };
 
 class MediaLibrary
 {
 private:
     std::vector<std::shared_ptr<MediaFileModel>> mediaFiles;
-    std::mutex libraryMutex;
-
-    std::vector<std::string> supportedAudioExtensions = {
-        "mp3", "wav", "ogg", "flac"};
-
-    std::vector<std::string> supportedVideoExtensions = {
-        "mp4", "avi", "mkv", "mov"};
-
-    bool isAudioFile(std::filesystem::path &path);
-
-    bool isVideoFile(std::filesystem::path &path);
+    mutable std::mutex libraryMutex;
+    // Always hold exactly the files of mediaFiles. The lookup keys view the
+    // models' own path and name strings, which never change.
+    SearchIndex searchIndex;
+    FacetIndex facetIndex;
+    LibraryColumns columns;
+    std::unordered_map<std::string_view, std::shared_ptr<MediaFileModel>> filesByPath;
+    std::unordered_multimap<std::string_view, std::shared_ptr<MediaFileModel>> filesByName;
+
+    void indexFile(const std::shared_ptr<MediaFileModel> &file, const SearchIndex *previousSearch = nullptr,
+                   const FacetIndex *previousFacets = nullptr, const LibraryColumns *previousColumns = nullptr);
+    void unindexFile(const std::shared_ptr<MediaFileModel> &file);
+    void rebuildFileLookup();
+    void rebuildIndexes();
+
+    DirectoryScanner scanner;
+    // Replaced as a whole by loadIndex and saveIndex, never modified in place, so a
+    // scan keeps using the one it copied under the lock when it started
+    std::shared_ptr<const LibraryIndex> libraryIndex = std::make_shared<LibraryIndex>();
+    std::filesystem::path rootDirectory;
+    // Mount points of the devices added by scanUSBDevice; their files are kept
+    // when the root directory is scanned again
+    std::vector<std::string> devicePaths;
+
+    // Background scan started by startScan; only one runs at a time. Started and
+    // cancelled from a single (UI) thread.
+    std::thread scanThread;
+    std::shared_ptr<ScanJob> scanJob;
+    // Jobs of every scan in progress on any thread (the background scan, device
+    // scans, rescans of the watcher), so cancelScan reaches them all
+    std::mutex activeJobsMutex;
+    std::vector<std::shared_ptr<ScanJob>> activeJobs;
+
+    class ActiveJob;
+
+    // Declared last so a running detection stops before the list goes away
+    std::vector<DuplicateDetector::Group> duplicateGroups;
+    DuplicateDetector duplicateDetector;
+
+    // Library files by path with their size and mtime, copied under the lock
+    struct KnownFile
+    {
+        std::shared_ptr<MediaFileModel> file;
+        uint64_t size;
+        int64_t mtime;
+    };
+    using KnownFiles = std::unordered_map<std::string, KnownFile>;
+
+    static std::shared_ptr<MediaFileModel> createMediaFile(const ScanEntry &entry, const KnownFiles &known,
+                                                           const LibraryIndex &index);
 
 public:
+    // Receives each batch of newly appended files during a streaming scan
+    using ScanChunkCallback = std::function<void(const std::vector<std::shared_ptr<MediaFileModel>> &)>;
+    // Called on the scan thread when a background scan ends, completed is false if it was cancelled
+    using ScanFinishedCallback = std::function<void(bool completed)>;
+
     MediaLibrary() {}
+    ~MediaLibrary();
 
     void scanDirectory(std::filesystem::path &path);
 
+    // Streaming scan: files are appended to the library as they are found and
+    // onChunk is called under the library lock (it must not call back into the
+    // library). Files kept from mounted devices come first, as the first chunk. The
+    // list is sorted by path once the walk is complete. If job is cancelled, the
+    // library goes back to its content before the scan.
+    void scanDirectory(std::filesystem::path &path, ScanChunkCallback onChunk, std::shared_ptr<ScanJob> job = nullptr);
+
+    // Run a streaming scan on a background thread. A background scan still running
+    // is cancelled first. The returned job reports progress and can cancel the scan.
+    std::shared_ptr<ScanJob> startScan(const std::filesystem::path &path, ScanChunkCallback onChunk,
+                                       ScanFinishedCallback onFinished);
+    // Cancel the scan started by startScan and wait for its thread. Device scans and
+    // rescans keep running.
+    void cancelBackgroundScan();
+    // Cancel every scan in progress, including device scans and rescans started from
+    // other threads, and wait for the background scan's thread. For shutdown.
+    void cancelScan();
+
+    // Throttling of background scans, see DirectoryScanner
+    void setScanIdleIoPriority(bool enabled);
+    void setScanReadLimit(unsigned int directoryReadsPerSecond);
+
+    // Number of worker threads used by scanDirectory, 0 = hardware concurrency
+    void setScanThreadCount(unsigned int threads);
+    unsigned int getScanThreadCount() const;
+    void setScanBackend(ScanBackend backend);
+
+    // Detect media files with a wrong or missing extension from their first bytes
+    void setContentSniffing(bool enabled);
+
+    // Persistent library index: restore the last scan without touching the tree
+    bool loadIndex(const std::string &indexPath);
+    bool saveIndex(const std::string &indexPath);
+    // A copy, a scan on another thread may replace it
+    std::filesystem::path getRootDirectory() const;
+
+    // Incremental update without a rescan: re-stat changedFiles (new or modified),
+    // drop removedPaths and everything below them. Returns true if the list changed.
+    bool updateFiles(const std::vector<std::string> &changedFiles, const std::vector<std::string> &removedPaths);
+
+    // Add the media of a mounted device to the library, or drop it again once the
+    // device is gone (returns true if the list changed). A device scan stopped by
+    // cancelScan leaves the library unchanged.
     void scanUSBDevice(std::filesystem::path &mountPoint);
+    bool removeUSBDevice(std::filesystem::path &mountPoint);
+
+    // Look for files with identical content in the background. onFinished runs on
+    // the detector thread once getDuplicateGroups reflects the new result.
+    void detectDuplicates(std::function<void()> onFinished = nullptr);
+    std::vector<DuplicateDetector::Group> getDuplicateGroups() const;
 
     std::shared_ptr<MediaFileModel> getMediaFile(int index) const;
     std::vector<std::shared_ptr<MediaFileModel>> getMediaFiles() const;
-
-    std::vector<std::shared_ptr<MediaFileModel>> searchMedia(const std::string &keyword) const;
-
-    std::shared_ptr<MediaFileModel> getMediaByFilename(const std::string &filename) const;
+    // Files [first, first + count) of the list, clamped to its size
+    std::vector<std::shared_ptr<MediaFileModel>> getMediaFiles(size_t first, size_t count) const;
+
+    // Substring search over filenames and tag values through the trigram index
+    std::vector<std::shared_ptr<MediaFileModel>> searchMedia(const std::string &keyword,
+                                                             const SearchIndex::CancelCheck &cancelled = nullptr) const;
+    // Narrow an earlier search result to the files matching keyword, see SearchIndex::refine
+    std::vector<std::shared_ptr<MediaFileModel>> refineSearch(const std::vector<std::shared_ptr<MediaFileModel>> &files,
+                                                              const std::string &keyword,
+                                                              const SearchIndex::CancelCheck &cancelled = nullptr) const;
+    // Changes whenever search results may have changed
+    uint64_t getSearchRevision() const;
+    // Structured query such as artist:"Daft Punk" year>=2000 duration<300 type:audio,
+    // see LibraryQuery. Returns false on a syntax error. The matching rows are
+    // read a page at a time with getQueryFiles.
+    bool queryMedia(const std::string &query, QueryResult &result) const;
+    // Files of rows [first, first + count) of result; rows removed since are skipped,
+    // and nothing is returned once the library was compacted or rebuilt
+    std::vector<std::shared_ptr<MediaFileModel>> getQueryFiles(const QueryResult &result, size_t first,
+                                                               size_t count) const;
+
+    // Re-index file for search and browsing after its tags were loaded or edited;
+    // ignored for files not in the library
+    void updateFileIndexes(const std::shared_ptr<MediaFileModel> &file);
+    // Size and mtime of file after its tags were written, so scans keep the model
+    void updateFileStat(const std::shared_ptr<MediaFileModel> &file, uint64_t size, int64_t mtime);
+    // Run modify under the library lock. Tags of the listed models are changed
+    // through it, the indexes read them on the scan, watcher and device threads.
+    void modifyFiles(const std::function<void()> &modify);
+
+    // Faceted browsing by artist, album, genre or year, a page at a time: the
+    // values of a facet with their file counts, and the files listed under one
+    size_t getFacetValueCount(Facet facet) const;
+    std::vector<std::pair<std::string, size_t>> getFacetValues(Facet facet, size_t first, size_t count) const;
+    size_t getFacetFileCount(Facet facet, const std::string &value) const;
+    std::vector<std::shared_ptr<MediaFileModel>> getFacetFiles(Facet facet, const std::string &value, size_t first,
+                                                               size_t count) const;
+    // Files whose tags were read, out of all files. Facets and queries only know
+    // the tags read so far, the rest are listed as their tags load.
+    void getTagCoverage(size_t &tagged, size_t &total) const;
+
+    // Every file named filename, in any directory, sorted by path
+    std::vector<std::shared_ptr<MediaFileModel>> getMediaByFilename(const std::string &filename) const;
 
     std::shared_ptr<MediaFileModel> getMediaByFilepath(const std::string &filepath) const;
 
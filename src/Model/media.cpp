@@ -5,32 +5,167 @@ const std::string &MediaFileModel::getFilename() const { return filename; }
 const std::string &MediaFileModel::getFilepath() const { return filepath; }
 int MediaFileModel::getDuration() const { return duration; }
 MediaType MediaFileModel::getType() const { return type; }
+ContainerFormat MediaFileModel::getContainer() const { return container; }
+uint64_t MediaFileModel::getFileSize() const { return fileSize; }
+int64_t MediaFileModel::getModifiedTime() const { return modifiedTime; }
+uint64_t MediaFileModel::getContentHash() const { return contentHash; }
+bool MediaFileModel::isMetadataLoaded() const { return metadataLoaded; }
 
 void MediaFileModel::setDuration(int dur) { duration = dur; }
 void MediaFileModel::setType(MediaType t) { type = t; }
+void MediaFileModel::setContainer(ContainerFormat c) { container = c; }
+void MediaFileModel::setFileStat(uint64_t size, int64_t mtime)
+{
+    // The cached content hash belongs to the previous version of the file
+    if (size != fileSize || mtime != modifiedTime)
+        contentHash = 0;
+    fileSize = size;
+    modifiedTime = mtime;
+}
+void MediaFileModel::setContentHash(uint64_t hash) { contentHash = hash; }
+void MediaFileModel::setMetadataLoaded(bool loaded) { metadataLoaded = loaded; }
 
 void MediaFileModel::setMetadata(const std::string &key, const std::string &value)
 {
-    metadata[key] = value;
+    MetadataField field = metadataFieldFromName(key);
+    if (field != MetadataField::COUNT)
+    {
+        setMetadata(field, value);
+        return;
+    }
+
+    for (auto &[customKey, customValue] : customFields)
+    {
+        if (customKey.str() == key)
+        {
+            customValue = InternedString::intern(value);
+            return;
+        }
+    }
+    customFields.emplace_back(InternedString::intern(key), InternedString::intern(value));
+}
+
+void MediaFileModel::setMetadata(MetadataField field, const std::string &value)
+{
+    fields[static_cast<size_t>(field)] = InternedString::intern(value);
+}
+
+void MediaFileModel::clearMetadata()
+{
+    for (auto &field : fields)
+        field = InternedString();
+    customFields.clear();
+    customFields.shrink_to_fit();
+    metadataLoaded = false;
 }
 
 const std::string MediaFileModel::getMetadata(const std::string &key) const
 {
-    if (metadata.empty())
-        return "";
+    MetadataField field = metadataFieldFromName(key);
+    if (field != MetadataField::COUNT)
+        return getMetadata(field);
 
-    auto it = metadata.find(key);
-    if (it != metadata.end())
-        return it->second;
+    for (const auto &[customKey, customValue] : customFields)
+    {
+        if (customKey.str() == key)
+            return customValue.str();
+    }
     return "";
 }
 
-const std::map<std::string, std::string> &MediaFileModel::getAllMetadata() const
+const std::string &MediaFileModel::getMetadata(MetadataField field) const
 {
-    return metadata;
+    return fields[static_cast<size_t>(field)].str();
+}
+
+MetadataMapView MediaFileModel::getAllMetadata() const
+{
+    return MetadataMapView(this);
 }
 
 const std::map<std::string, std::string> &MediaFileModel::getAllAddMetadata() const
 {
-    return addMetadata;
-}
\ No newline at end of file
+    // Nothing sets additional keys; kept for the playlist file format
+    static const std::map<std::string, std::string> none;
+    return none;
+}
+
+// Metadata fields
+static const std::string metadataFieldNames[] = {
+    "Album", "Artist", "Bitrate", "Channels", "Codec", "Comment", "Genre", "Sample Rate", "Title", "Track", "Year"};
+static_assert(sizeof(metadataFieldNames) / sizeof(metadataFieldNames[0]) == static_cast<size_t>(MetadataField::COUNT),
+              "one name per MetadataField");
+
+const std::string &metadataFieldName(MetadataField field)
+{
+    return metadataFieldNames[static_cast<size_t>(field)];
+}
+
+MetadataField metadataFieldFromName(const std::string &name)
+{
+    for (size_t i = 0; i < static_cast<size_t>(MetadataField::COUNT); ++i)
+    {
+        if (metadataFieldNames[i] == name)
+            return static_cast<MetadataField>(i);
+    }
+    return MetadataField::COUNT;
+}
+
+// MetadataMapView
+static const size_t fieldCount = static_cast<size_t>(MetadataField::COUNT);
+
+void MetadataMapView::iterator::skipUnset()
+{
+    while (position < fieldCount && !media->fields[position].isSet())
+        position++;
+}
+
+MetadataMapView::iterator::value_type MetadataMapView::iterator::operator*() const
+{
+    if (position < fieldCount)
+        return {metadataFieldNames[position], media->fields[position].str()};
+
+    const auto &custom = media->customFields[position - fieldCount];
+    return {custom.first.str(), custom.second.str()};
+}
+
+MetadataMapView::iterator &MetadataMapView::iterator::operator++()
+{
+    position++;
+    skipUnset();
+    return *this;
+}
+
+MetadataMapView::iterator MetadataMapView::begin() const
+{
+    return iterator(media, 0);
+}
+
+MetadataMapView::iterator MetadataMapView::end() const
+{
+    return iterator(media, fieldCount + media->customFields.size());
+}
+
+size_t MetadataMapView::size() const
+{
+    size_t count = media->customFields.size();
+    for (const auto &field : media->fields)
+    {
+        if (field.isSet())
+            count++;
+    }
+    return count;
+}
+
+bool MetadataMapView::empty() const
+{
+    return size() == 0;
+}
+
+MetadataMapView::operator std::map<std::string, std::string>() const
+{
+    std::map<std::string, std::string> metadata;
+    for (const auto &[key, value] : *this)
+        metadata.emplace(key, value);
+    return metadata;
+}
@@ -1,8 +1,14 @@
 #ifndef MEDIA_H
 #define MEDIA_H
 
+#include "interned_string.h"
+
 #include <string>
 #include <map>
+#include <array>
+#include <vector>
+#include <utility>
+#include <cstdint>
 
 
 // Enum for media types
@@ -13,6 +19,84 @@ enum class MediaType
     UNKNOWN
 };
 
+// Container detected from the file content. UNKNOWN means the extension is trusted.
+// Only this result of sniffing reaches tag extraction, which picks its parser by it;
+// the sniffed bytes are not kept, the readers' own first read covers them.
+enum class ContainerFormat
+{
+    UNKNOWN,
+    MPEG_AUDIO, // ID3v2 tag or MPEG/ADTS frame sync
+    FLAC,
+    OGG,
+    WAV,
+    MP4,
+    MATROSKA,
+    AVI
+};
+
+// Tags every file gets from MetadataManager, stored in a fixed slot instead of
+// under a string key. Sorted like their names, so iteration order matches a map.
+enum class MetadataField
+{
+    ALBUM,
+    ARTIST,
+    BITRATE,
+    CHANNELS,
+    CODEC,
+    COMMENT,
+    GENRE,
+    SAMPLE_RATE,
+    TITLE,
+    TRACK,
+    YEAR,
+    COUNT
+};
+
+// "Title", "Sample Rate", ... as used in the metadata map
+const std::string &metadataFieldName(MetadataField field);
+// MetadataField::COUNT if name is not a well-known tag
+MetadataField metadataFieldFromName(const std::string &name);
+
+class MediaFileModel;
+
+// Read-only view of a file's tags with the interface of the former
+// std::map<std::string, std::string>: iterates (key, value) pairs in key order
+// for well-known tags, followed by custom tags. Converts to a std::map copy.
+class MetadataMapView
+{
+private:
+    const MediaFileModel *media;
+
+public:
+    class iterator
+    {
+    private:
+        const MediaFileModel *media;
+        size_t position; // field slot, then index into the custom tags + COUNT
+
+        void skipUnset();
+
+    public:
+        using value_type = std::pair<const std::string &, const std::string &>;
+
+        iterator(const MediaFileModel *m, size_t pos) : media(m), position(pos) { skipUnset(); }
+
+        value_type operator*() const;
+        iterator &operator++();
+        bool operator==(const iterator &other) const { return position == other.position; }
+        bool operator!=(const iterator &other) const { return position != other.position; }
+    };
+
+    MetadataMapView(const MediaFileModel *m) : media(m) {}
+
+    iterator begin() const;
+    iterator end() const;
+    size_t size() const;
+    bool empty() const;
+
+    operator std::map<std::string, std::string>() const;
+};
+
 class MediaFileModel
 {
 private:
@@ -20,8 +104,18 @@ private:
     std::string filepath;
     int duration; // in seconds
     MediaType type;
-    std::map<std::string, std::string> metadata;
-    std::map<std::string, std::string> addMetadata;
+    ContainerFormat container = ContainerFormat::UNKNOWN;
+    uint64_t fileSize = 0;
+    int64_t modifiedTime = 0; // ns since the Unix epoch
+    uint64_t contentHash = 0; // sampled content hash, 0 = not computed yet
+    bool metadataLoaded = false;
+
+    // Tag values are interned, so repeated artists, albums and genres are stored
+    // once; rare custom tags go to a small flat list
+    std::array<InternedString, static_cast<size_t>(MetadataField::COUNT)> fields;
+    std::vector<std::pair<InternedString, InternedString>> customFields;
+
+    friend class MetadataMapView;
 
 public:
     MediaFileModel() {};
@@ -40,15 +134,28 @@ public:
     const std::string &getFilepath() const;
     int getDuration() const;
     MediaType getType() const;
+    ContainerFormat getContainer() const;
+    uint64_t getFileSize() const;
+    int64_t getModifiedTime() const;
+    uint64_t getContentHash() const;
+    bool isMetadataLoaded() const;
 
     void setDuration(int dur);
     void setType(MediaType t);
+    void setContainer(ContainerFormat c);
+    void setFileStat(uint64_t size, int64_t mtime);
+    void setContentHash(uint64_t hash);
+    void setMetadataLoaded(bool loaded);
 
     void setMetadata(const std::string &key, const std::string &value);
+    void setMetadata(MetadataField field, const std::string &value);
+    // Drop the extracted tags to save memory; they are read again when needed
+    void clearMetadata();
 
     const std::string getMetadata(const std::string &key) const;
+    const std::string &getMetadata(MetadataField field) const;
 
-    const std::map<std::string, std::string> &getAllMetadata() const;
+    MetadataMapView getAllMetadata() const;
 
     const std::map<std::string, std::string> &getAllAddMetadata() const;
 
@@ -0,0 +1,140 @@
+#ifndef MEDIA_FORMAT_H
+#define MEDIA_FORMAT_H
+
+#include "media.h"
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+// Recognised file extensions (lowercase). Add a line here to support a new format.
+struct MediaFormat
+{
+    std::string_view extension;
+    MediaType type;
+};
+
+inline constexpr MediaFormat supportedMediaFormats[] = {
+    // Audio
+    {"mp3", MediaType::AUDIO},
+    {"wav", MediaType::AUDIO},
+    {"ogg", MediaType::AUDIO},
+    {"flac", MediaType::AUDIO},
+    {"opus", MediaType::AUDIO},
+    {"m4a", MediaType::AUDIO},
+    {"aac", MediaType::AUDIO},
+    {"wma", MediaType::AUDIO},
+    // Video
+    {"mp4", MediaType::VIDEO},
+    {"avi", MediaType::VIDEO},
+    {"mkv", MediaType::VIDEO},
+    {"mov", MediaType::VIDEO},
+    {"webm", MediaType::VIDEO},
+};
+
+// Perfect hash over the extensions above, built at compile time: the seed is
+// searched until every extension lands in its own slot.
+namespace media_format_detail
+{
+    constexpr size_t maxExtensionLength = 8;
+    constexpr size_t tableSize = 64; // power of two, keep well above the number of formats
+
+    struct Slot
+    {
+        char extension[maxExtensionLength] = {};
+        uint8_t length = 0;
+        MediaType type = MediaType::UNKNOWN;
+    };
+
+    constexpr uint32_t hashExtension(const char *ext, size_t length, uint32_t seed)
+    {
+        uint32_t hash = seed;
+        for (size_t i = 0; i < length; ++i)
+            hash = (hash ^ static_cast<unsigned char>(ext[i])) * 16777619u; // FNV-1a
+        return hash;
+    }
+
+    constexpr uint32_t findSeed()
+    {
+        for (uint32_t seed = 2166136261u;; ++seed)
+        {
+            bool used[tableSize] = {};
+            bool collision = false;
+            for (const auto &format : supportedMediaFormats)
+            {
+                size_t slot = hashExtension(format.extension.data(), format.extension.size(), seed) & (tableSize - 1);
+                if (used[slot])
+                {
+                    collision = true;
+                    break;
+                }
+                used[slot] = true;
+            }
+            if (!collision)
+                return seed;
+        }
+    }
+
+    constexpr uint32_t seed = findSeed();
+
+    constexpr std::array<Slot, tableSize> buildTable()
+    {
+        std::array<Slot, tableSize> table = {};
+        for (const auto &format : supportedMediaFormats)
+        {
+            Slot &slot = table[hashExtension(format.extension.data(), format.extension.size(), seed) & (tableSize - 1)];
+            for (size_t i = 0; i < format.extension.size(); ++i)
+                slot.extension[i] = format.extension[i];
+            slot.length = static_cast<uint8_t>(format.extension.size());
+            slot.type = format.type;
+        }
+        return table;
+    }
+
+    constexpr std::array<Slot, tableSize> table = buildTable();
+
+    constexpr bool extensionsFit()
+    {
+        for (const auto &format : supportedMediaFormats)
+        {
+            if (format.extension.empty() || format.extension.size() > maxExtensionLength)
+                return false;
+        }
+        return sizeof(supportedMediaFormats) / sizeof(MediaFormat) <= tableSize / 2;
+    }
+    static_assert(extensionsFit(), "media extension too long or table too small");
+}
+
+// Media type of a file name or path, from its extension (case-insensitive).
+// Works on the caller's buffer, no allocation.
+constexpr MediaType classifyMediaFile(std::string_view filepath)
+{
+    using namespace media_format_detail;
+
+    size_t nameStart = filepath.find_last_of("/\\");
+    std::string_view filename = nameStart == std::string_view::npos ? filepath : filepath.substr(nameStart + 1);
+
+    size_t dot = filename.find_last_of('.');
+    if (dot == std::string_view::npos)
+        return MediaType::UNKNOWN;
+
+    std::string_view ext = filename.substr(dot + 1);
+    if (ext.empty() || ext.size() > maxExtensionLength)
+        return MediaType::UNKNOWN;
+
+    char lower[maxExtensionLength] = {};
+    for (size_t i = 0; i < ext.size(); ++i)
+        lower[i] = (ext[i] >= 'A' && ext[i] <= 'Z') ? static_cast<char>(ext[i] - 'A' + 'a') : ext[i];
+
+    const Slot &slot = table[hashExtension(lower, ext.size(), seed) & (tableSize - 1)];
+    if (slot.length != ext.size())
+        return MediaType::UNKNOWN;
+    for (size_t i = 0; i < ext.size(); ++i)
+    {
+        if (slot.extension[i] != lower[i])
+            return MediaType::UNKNOWN;
+    }
+    return slot.type;
+}
+
+#endif // MEDIA_FORMAT_H
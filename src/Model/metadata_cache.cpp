@@ -0,0 +1,382 @@
+#include "metadata_cache.h"
+#include "binary_io.h"
+
+#include <chrono>
+#include <iostream>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <functional>
+extern std::wstring utf8_to_wstring(const std::string &str);
+#endif
+
+// File layout (host byte order):
+//   magic "MPMC", u32 version, u32 rows, u32 fields, fields * string name,
+//   rows * u64 device, rows * u64 inode, rows * u64 size, rows * i64 mtime, rows * i32 duration,
+//   rows * i32 last used, fields * (rows * u32 string id), u32 strings, strings * string
+//   string: u32 length + bytes
+static const char cacheMagic[4] = {'M', 'P', 'M', 'C'};
+static const uint32_t cacheVersion = 3; // 2: video files carry Codec, 3: last used day
+static const uint32_t oldestReadableVersion = 2;
+
+static int32_t currentDay()
+{
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    return static_cast<int32_t>(std::chrono::duration_cast<std::chrono::hours>(now).count() / 24);
+}
+
+// MetadataCache implementation
+MetadataCache::MetadataCache() : dirty(false)
+{
+}
+
+bool MetadataCache::readKey(const std::string &filepath, MetadataCacheKey &key)
+{
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_wstat64(utf8_to_wstring(filepath).c_str(), &st) != 0 || !(st.st_mode & _S_IFREG))
+        return false;
+    // No inode numbers from stat on Windows, the path stands in for one
+    key.device = st.st_dev;
+    key.inode = std::hash<std::string>()(filepath);
+    key.size = st.st_size;
+    key.mtime = static_cast<int64_t>(st.st_mtime) * 1000000000;
+#else
+    struct stat st;
+    if (stat(filepath.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        return false;
+    key.device = st.st_dev;
+    key.inode = st.st_ino;
+    key.size = st.st_size;
+    key.mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    return true;
+}
+
+uint32_t MetadataCache::internString(const std::string &str)
+{
+    auto [it, inserted] = stringIds.emplace(str, static_cast<uint32_t>(strings.size()));
+    if (inserted)
+        strings.push_back(str);
+    return it->second;
+}
+
+size_t MetadataCache::fieldColumn(const std::string &name)
+{
+    for (size_t i = 0; i < fieldNames.size(); ++i)
+    {
+        if (fieldNames[i] == name)
+            return i;
+    }
+    fieldNames.push_back(name);
+    fieldColumns.emplace_back(devices.size(), noString);
+    return fieldNames.size() - 1;
+}
+
+MetadataCache::LookupResult MetadataCache::lookup(const MetadataCacheKey &key, int &duration,
+                                                  std::map<std::string, std::string> &metadata) const
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+
+    auto it = rowById.find({key.device, key.inode});
+    if (it == rowById.end())
+        return LookupResult::MISS;
+
+    uint32_t row = it->second;
+    if (sizes[row] != key.size || mtimes[row] != key.mtime)
+        return LookupResult::STALE;
+
+    int32_t today = currentDay();
+    if (lastUsed[row] != today)
+    {
+        lastUsed[row] = today;
+        dirty = true;
+    }
+
+    duration = durations[row];
+    metadata.clear();
+    for (size_t field = 0; field < fieldNames.size(); ++field)
+    {
+        uint32_t id = fieldColumns[field][row];
+        if (id != noString)
+            metadata.emplace(fieldNames[field], strings[id]);
+    }
+    return LookupResult::HIT;
+}
+
+void MetadataCache::store(const MetadataCacheKey &key, int duration, const std::map<std::string, std::string> &metadata)
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+
+    auto [it, inserted] = rowById.emplace(FileId{key.device, key.inode}, static_cast<uint32_t>(devices.size()));
+    uint32_t row = it->second;
+    if (inserted)
+    {
+        devices.push_back(key.device);
+        inodes.push_back(key.inode);
+        sizes.push_back(key.size);
+        mtimes.push_back(key.mtime);
+        durations.push_back(duration);
+        lastUsed.push_back(currentDay());
+        for (auto &column : fieldColumns)
+            column.push_back(noString);
+    }
+    else
+    {
+        sizes[row] = key.size;
+        mtimes[row] = key.mtime;
+        durations[row] = duration;
+        lastUsed[row] = currentDay();
+        for (auto &column : fieldColumns)
+            column[row] = noString;
+    }
+
+    for (const auto &[name, value] : metadata)
+    {
+        size_t field = fieldColumn(name);
+        fieldColumns[field][row] = internString(value);
+    }
+    dirty = true;
+}
+
+void MetadataCache::remove(const MetadataCacheKey &key)
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+
+    auto it = rowById.find({key.device, key.inode});
+    if (it == rowById.end())
+        return;
+
+    // Moved into the freed row, the last row goes away
+    uint32_t row = it->second;
+    uint32_t last = static_cast<uint32_t>(devices.size() - 1);
+    rowById.erase(it);
+    if (row != last)
+    {
+        devices[row] = devices[last];
+        inodes[row] = inodes[last];
+        sizes[row] = sizes[last];
+        mtimes[row] = mtimes[last];
+        durations[row] = durations[last];
+        lastUsed[row] = lastUsed[last];
+        for (auto &column : fieldColumns)
+            column[row] = column[last];
+        rowById[{devices[row], inodes[row]}] = row;
+    }
+    devices.pop_back();
+    inodes.pop_back();
+    sizes.pop_back();
+    mtimes.pop_back();
+    durations.pop_back();
+    lastUsed.pop_back();
+    for (auto &column : fieldColumns)
+        column.pop_back();
+    dirty = true;
+}
+
+bool MetadataCache::load(const std::string &cachePath)
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+
+    std::string buffer;
+    if (!readBinaryFile(cachePath, buffer))
+        return false;
+
+    BinaryReader reader(buffer);
+    uint32_t version = 0, rows = 0, nFields = 0, nStrings = 0;
+    if (!reader.getMagic(cacheMagic) || !reader.get(version) || version < oldestReadableVersion ||
+        version > cacheVersion)
+    {
+        std::cerr << "Metadata cache " << cachePath << " has an unknown format, ignoring it\n";
+        return false;
+    }
+
+    std::vector<std::string> names;
+    std::vector<uint64_t> devs, inos, szs;
+    std::vector<int64_t> mts;
+    std::vector<int32_t> durs, used;
+    std::vector<std::vector<uint32_t>> columns;
+    std::vector<std::string> pool;
+
+    if (!reader.get(rows) || !reader.get(nFields))
+    {
+        std::cerr << "Metadata cache " << cachePath << " is truncated\n";
+        return false;
+    }
+    // A field name takes at least its length, a row its key, stat and duration
+    const size_t minRowSize = 3 * sizeof(uint64_t) + sizeof(int64_t) + sizeof(int32_t);
+    if (nFields > reader.remaining() / sizeof(uint32_t) || rows > reader.remaining() / minRowSize)
+    {
+        std::cerr << "Metadata cache " << cachePath << " is corrupt\n";
+        return false;
+    }
+
+    bool complete = true;
+    for (uint32_t i = 0; complete && i < nFields; ++i)
+    {
+        names.emplace_back();
+        complete = reader.getString(names.back());
+    }
+    complete = complete && reader.getArray(devs, rows) && reader.getArray(inos, rows) && reader.getArray(szs, rows) &&
+               reader.getArray(mts, rows) && reader.getArray(durs, rows);
+    // Rows of an older cache count as used today
+    if (version >= 3)
+        complete = complete && reader.getArray(used, rows);
+    else
+        used.assign(rows, currentDay());
+    columns.resize(nFields);
+    for (uint32_t i = 0; complete && i < nFields; ++i)
+        complete = reader.getArray(columns[i], rows);
+    complete = complete && reader.get(nStrings);
+    for (uint32_t i = 0; complete && i < nStrings; ++i)
+    {
+        pool.emplace_back();
+        complete = reader.getString(pool.back());
+    }
+    if (!complete)
+    {
+        std::cerr << "Metadata cache " << cachePath << " is truncated\n";
+        return false;
+    }
+
+    for (const auto &column : columns)
+    {
+        for (uint32_t id : column)
+        {
+            if (id != noString && id >= nStrings)
+            {
+                std::cerr << "Metadata cache " << cachePath << " is corrupt\n";
+                return false;
+            }
+        }
+    }
+
+    rowById.clear();
+    for (uint32_t row = 0; row < rows; ++row)
+        rowById[{devs[row], inos[row]}] = row;
+    devices.swap(devs);
+    inodes.swap(inos);
+    sizes.swap(szs);
+    mtimes.swap(mts);
+    durations.swap(durs);
+    lastUsed.swap(used);
+    fieldNames.swap(names);
+    fieldColumns.swap(columns);
+    strings.swap(pool);
+    stringIds.clear();
+    for (uint32_t i = 0; i < strings.size(); ++i)
+        stringIds.emplace(strings[i], i);
+    dirty = false;
+    return true;
+}
+
+bool MetadataCache::save(const std::string &cachePath)
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if (!dirty)
+        return true;
+
+    prune(currentDay());
+
+    // Values replaced by store are still pooled, only write the referenced ones
+    std::vector<uint32_t> remap(strings.size(), noString);
+    std::vector<const std::string *> used;
+    std::vector<std::vector<uint32_t>> columns(fieldColumns.size());
+    for (size_t field = 0; field < fieldColumns.size(); ++field)
+    {
+        columns[field].reserve(fieldColumns[field].size());
+        for (uint32_t id : fieldColumns[field])
+        {
+            if (id != noString && remap[id] == noString)
+            {
+                remap[id] = static_cast<uint32_t>(used.size());
+                used.push_back(&strings[id]);
+            }
+            columns[field].push_back(id != noString ? remap[id] : noString);
+        }
+    }
+
+    BinaryWriter writer;
+    writer.putMagic(cacheMagic);
+    writer.put<uint32_t>(cacheVersion);
+    writer.put<uint32_t>(static_cast<uint32_t>(devices.size()));
+    writer.put<uint32_t>(static_cast<uint32_t>(fieldNames.size()));
+    for (const auto &name : fieldNames)
+        writer.putString(name);
+    writer.putArray(devices);
+    writer.putArray(inodes);
+    writer.putArray(sizes);
+    writer.putArray(mtimes);
+    writer.putArray(durations);
+    writer.putArray(lastUsed);
+    for (const auto &column : columns)
+        writer.putArray(column);
+    writer.put<uint32_t>(static_cast<uint32_t>(used.size()));
+    for (const std::string *str : used)
+        writer.putString(*str);
+
+    if (!writeBinaryFile(cachePath, writer.data()))
+        return false;
+    dirty = false;
+    return true;
+}
+
+void MetadataCache::prune(int32_t today)
+{
+    // Compact the columns in place, keeping the order of the rows left
+    uint32_t kept = 0;
+    for (uint32_t row = 0; row < devices.size(); ++row)
+    {
+        if (today - lastUsed[row] > pruneAfterDays)
+            continue;
+        if (kept != row)
+        {
+            devices[kept] = devices[row];
+            inodes[kept] = inodes[row];
+            sizes[kept] = sizes[row];
+            mtimes[kept] = mtimes[row];
+            durations[kept] = durations[row];
+            lastUsed[kept] = lastUsed[row];
+            for (auto &column : fieldColumns)
+                column[kept] = column[row];
+        }
+        ++kept;
+    }
+    if (kept == devices.size())
+        return;
+
+    devices.resize(kept);
+    inodes.resize(kept);
+    sizes.resize(kept);
+    mtimes.resize(kept);
+    durations.resize(kept);
+    lastUsed.resize(kept);
+    for (auto &column : fieldColumns)
+        column.resize(kept);
+    rowById.clear();
+    for (uint32_t row = 0; row < kept; ++row)
+        rowById[{devices[row], inodes[row]}] = row;
+}
+
+size_t MetadataCache::size() const
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    return devices.size();
+}
+
+void MetadataCache::clear()
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    rowById.clear();
+    devices.clear();
+    inodes.clear();
+    sizes.clear();
+    mtimes.clear();
+    durations.clear();
+    lastUsed.clear();
+    fieldNames.clear();
+    fieldColumns.clear();
+    strings.clear();
+    stringIds.clear();
+    dirty = true;
+}
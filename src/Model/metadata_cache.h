@@ -0,0 +1,96 @@
+#ifndef METADATA_CACHE_H
+#define METADATA_CACHE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <cstdint>
+
+// Identity of a file's content as seen by stat: the same inode with the same
+// size and mtime is assumed to still hold the same tags, wherever it was moved
+struct MetadataCacheKey
+{
+    uint64_t device = 0;
+    uint64_t inode = 0;
+    uint64_t size = 0;
+    int64_t mtime = 0; // ns since the Unix epoch
+};
+
+// Persistent cache of parsed tags and durations, so unchanged files are never
+// opened with TagLib again. Stored column by column: the fixed-size columns are
+// written as flat arrays and every tag value is an index into a string pool,
+// which keeps repeated artists, albums and genres small. Rows of files not read
+// for pruneAfterDays (deleted, or gone with their drive) are dropped on save.
+// Thread-safe.
+class MetadataCache
+{
+public:
+    enum class LookupResult
+    {
+        HIT,
+        STALE, // the inode is known but its size or mtime changed
+        MISS
+    };
+
+private:
+    struct FileId
+    {
+        uint64_t device;
+        uint64_t inode;
+        bool operator==(const FileId &other) const { return device == other.device && inode == other.inode; }
+    };
+    struct FileIdHash
+    {
+        size_t operator()(const FileId &id) const { return std::hash<uint64_t>()(id.inode * 31 + id.device); }
+    };
+
+    static constexpr uint32_t noString = UINT32_MAX;
+    static constexpr int32_t pruneAfterDays = 90;
+
+    mutable std::mutex cacheMutex;
+    std::unordered_map<FileId, uint32_t, FileIdHash> rowById;
+
+    // One entry per row
+    std::vector<uint64_t> devices;
+    std::vector<uint64_t> inodes;
+    std::vector<uint64_t> sizes;
+    std::vector<int64_t> mtimes;
+    std::vector<int32_t> durations;
+    mutable std::vector<int32_t> lastUsed; // days since the Unix epoch of the last lookup or store
+
+    // One column per tag name, holding a string id (or noString) per row
+    std::vector<std::string> fieldNames;
+    std::vector<std::vector<uint32_t>> fieldColumns;
+
+    std::vector<std::string> strings;
+    std::unordered_map<std::string, uint32_t> stringIds;
+
+    mutable bool dirty;
+
+    uint32_t internString(const std::string &str);
+    size_t fieldColumn(const std::string &name);
+    void prune(int32_t today);
+
+public:
+    MetadataCache();
+
+    bool load(const std::string &cachePath);
+    // Writes only if something changed since the last load or save
+    bool save(const std::string &cachePath);
+
+    // Stat filepath into a cache key
+    static bool readKey(const std::string &filepath, MetadataCacheKey &key);
+
+    // On HIT, fills duration and metadata with the cached values
+    LookupResult lookup(const MetadataCacheKey &key, int &duration, std::map<std::string, std::string> &metadata) const;
+    void store(const MetadataCacheKey &key, int duration, const std::map<std::string, std::string> &metadata);
+    // Forget the file, its next read parses it again
+    void remove(const MetadataCacheKey &key);
+
+    size_t size() const;
+    void clear();
+};
+
+#endif // METADATA_CACHE_H
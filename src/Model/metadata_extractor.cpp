@@ -0,0 +1,153 @@
+#include "metadata_extractor.h"
+
+#include <algorithm>
+
+// MetadataExtractor implementation
+MetadataExtractor::MetadataExtractor(unsigned int threads) : stopping(false)
+{
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    threads = std::max(1u, threads);
+
+    for (unsigned int i = 0; i < threads; ++i)
+        workers.emplace_back(&MetadataExtractor::workerFunc, this);
+}
+
+MetadataExtractor::~MetadataExtractor()
+{
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+    }
+    queueCondition.notify_all();
+
+    for (auto &worker : workers)
+    {
+        if (worker.joinable())
+            worker.join();
+    }
+}
+
+void MetadataExtractor::setCache(std::shared_ptr<MetadataCache> cache)
+{
+    metadataManager.setCache(cache);
+}
+
+void MetadataExtractor::enqueue(const std::shared_ptr<MediaFileModel> &file, Priority priority)
+{
+    enqueue(std::vector<std::shared_ptr<MediaFileModel>>{file}, priority);
+}
+
+void MetadataExtractor::enqueue(const std::vector<std::shared_ptr<MediaFileModel>> &files, Priority priority)
+{
+    size_t added = 0;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        for (const auto &file : files)
+        {
+            if (!file)
+                continue;
+
+            // A lower priority entry left behind is skipped as stale once this one is taken
+            bool alreadyQueued = !queuedFiles.insert(file.get()).second;
+            if (alreadyQueued && priority == Priority::PREFETCH)
+                continue;
+
+            queues[static_cast<int>(priority)].push_back(file);
+            added++;
+        }
+    }
+
+    if (added == 1)
+        queueCondition.notify_one();
+    else if (added > 1)
+        queueCondition.notify_all();
+}
+
+void MetadataExtractor::clearPending()
+{
+    std::lock_guard<std::mutex> lock(queueMutex);
+    for (auto &queue : queues)
+        queue.clear();
+    queuedFiles.clear();
+}
+
+void MetadataExtractor::clearPending(Priority priority)
+{
+    std::lock_guard<std::mutex> lock(queueMutex);
+    queues[static_cast<int>(priority)].clear();
+
+    // A file may also wait in another queue, keep it marked there
+    queuedFiles.clear();
+    for (const auto &queue : queues)
+    {
+        for (const auto &file : queue)
+            queuedFiles.insert(file.get());
+    }
+}
+
+size_t MetadataExtractor::getPendingCount()
+{
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return queuedFiles.size();
+}
+
+std::vector<MetadataExtractor::Result> MetadataExtractor::takeResults()
+{
+    std::vector<Result> completed;
+    std::lock_guard<std::mutex> lock(resultMutex);
+    completed.swap(results);
+    return completed;
+}
+
+void MetadataExtractor::applyResult(const Result &result)
+{
+    if (!result.success)
+        return;
+
+    result.file->setDuration(result.extracted->getDuration());
+    for (const auto &[key, value] : result.extracted->getAllMetadata())
+        result.file->setMetadata(key, value);
+    result.file->setMetadataLoaded(true);
+}
+
+void MetadataExtractor::workerFunc()
+{
+    while (true)
+    {
+        std::shared_ptr<MediaFileModel> file;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            // Highest priority first
+            auto next = [this]() -> std::deque<std::shared_ptr<MediaFileModel>> *
+            {
+                for (auto &queue : queues)
+                {
+                    if (!queue.empty())
+                        return &queue;
+                }
+                return nullptr;
+            };
+            queueCondition.wait(lock, [this, &next]()
+                                { return stopping || next(); });
+            if (stopping)
+                return;
+
+            auto &queue = *next();
+            file = std::move(queue.front());
+            queue.pop_front();
+            if (queuedFiles.erase(file.get()) == 0)
+                continue; // already taken through another queue
+        }
+
+        // Read into a scratch model, the queued one may be in use on the UI thread
+        auto extracted = std::make_shared<MediaFileModel>(file->getFilepath());
+        // MetadataManager picks the reader by type, videos go to the container probe
+        extracted->setType(file->getType());
+        extracted->setContainer(file->getContainer());
+        bool success = metadataManager.loadMetadata(extracted);
+
+        std::lock_guard<std::mutex> lock(resultMutex);
+        results.push_back({file, extracted, success});
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef METADATA_EXTRACTOR_H
+#define METADATA_EXTRACTOR_H
+
+#include "manager.h"
+
+#include <deque>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_set>
+
+// Fixed pool of threads reading tags with MetadataManager. Workers fill a scratch
+// model; results wait until the owner collects them with takeResults, so the
+// queued models themselves are only modified on the collecting thread.
+class MetadataExtractor
+{
+public:
+    enum class Priority
+    {
+        HIGH,     // served first, e.g. the track about to play
+        NORMAL,   // rows on screen
+        UPCOMING, // tracks queued to play next
+        PREFETCH, // neighbouring pages
+        COUNT
+    };
+
+    struct Result
+    {
+        std::shared_ptr<MediaFileModel> file;      // model that was queued
+        std::shared_ptr<MediaFileModel> extracted; // tags and duration read from disk
+        bool success;
+    };
+
+private:
+    MetadataManager metadataManager;
+    std::vector<std::thread> workers;
+
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    std::deque<std::shared_ptr<MediaFileModel>> queues[static_cast<int>(Priority::COUNT)]; // indexed by Priority
+    // Files waiting in a queue; an entry popped for a file no longer in here is stale
+    std::unordered_set<const MediaFileModel *> queuedFiles;
+    bool stopping;
+
+    std::mutex resultMutex;
+    std::vector<Result> results;
+
+    void workerFunc();
+
+public:
+    // threads == 0 picks the hardware concurrency
+    MetadataExtractor(unsigned int threads = 0);
+    ~MetadataExtractor();
+
+    // Share a persistent tag cache with the workers; set before queuing work
+    void setCache(std::shared_ptr<MetadataCache> cache);
+
+    // Queue files for extraction; never waits for I/O. Queuing a waiting file again
+    // with a higher priority moves it ahead.
+    void enqueue(const std::shared_ptr<MediaFileModel> &file, Priority priority = Priority::NORMAL);
+    void enqueue(const std::vector<std::shared_ptr<MediaFileModel>> &files, Priority priority = Priority::NORMAL);
+
+    // Drop everything not started yet, or only the work queued with one priority
+    void clearPending();
+    void clearPending(Priority priority);
+    size_t getPendingCount();
+
+    // Results completed since the last call, in completion order
+    std::vector<Result> takeResults();
+
+    // Copy the extracted tags and duration onto the queued model
+    static void applyResult(const Result &result);
+};
+
+#endif // METADATA_EXTRACTOR_H
@@ -0,0 +1,121 @@
+#include "metadata_writer.h"
+
+// MetadataWriter implementation
+MetadataWriter::MetadataWriter() : writing(nullptr), stopping(false), bytesWritten(0)
+{
+    writerThread = std::thread(&MetadataWriter::writerFunc, this);
+}
+
+MetadataWriter::~MetadataWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+    }
+    queueCondition.notify_all();
+
+    if (writerThread.joinable())
+        writerThread.join();
+}
+
+void MetadataWriter::setCache(std::shared_ptr<MetadataCache> cache)
+{
+    metadataManager.setCache(cache);
+}
+
+void MetadataWriter::setTagPadding(size_t bytes)
+{
+    metadataManager.setTagPadding(bytes);
+}
+
+void MetadataWriter::enqueue(const std::shared_ptr<MediaFileModel> &file, const std::map<std::string, std::string> &metadata)
+{
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        auto [it, inserted] = pending.try_emplace(file.get());
+        it->second.file = file;
+        it->second.metadata = metadata;
+        it->second.duration = file->getDuration();
+        it->second.metadataLoaded = file->isMetadataLoaded();
+        if (inserted)
+            order.push_back(file.get());
+    }
+    queueCondition.notify_one();
+}
+
+bool MetadataWriter::isPending(const MediaFileModel *file)
+{
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return writing == file || pending.count(file) > 0;
+}
+
+size_t MetadataWriter::getPendingCount()
+{
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return pending.size() + (writing ? 1 : 0);
+}
+
+std::vector<MetadataWriter::Result> MetadataWriter::takeResults()
+{
+    std::vector<Result> completed;
+    std::lock_guard<std::mutex> lock(resultMutex);
+    completed.swap(results);
+    return completed;
+}
+
+uint64_t MetadataWriter::getBytesWritten() const
+{
+    return bytesWritten;
+}
+
+bool MetadataWriter::writeFile(const PendingWrite &write, TagWriteStats &stats)
+{
+    // Saved from a scratch model, the queued one stays with the UI thread
+    auto scratch = std::make_shared<MediaFileModel>(write.file->getFilepath());
+    scratch->setContainer(write.file->getContainer());
+    // Stored in the metadata cache with the tags once written
+    scratch->setDuration(write.duration);
+    for (const auto &[key, value] : write.metadata)
+        scratch->setMetadata(key, value);
+    scratch->setMetadataLoaded(write.metadataLoaded);
+
+    if (!metadataManager.saveMetadata(scratch, &stats))
+        return false;
+    bytesWritten += stats.bytesWritten;
+    return true;
+}
+
+void MetadataWriter::writerFunc()
+{
+    while (true)
+    {
+        PendingWrite write;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            writing = nullptr;
+            queueCondition.wait(lock, [this]()
+                                { return stopping || !order.empty(); });
+            if (order.empty())
+                return; // stopping with nothing left to write
+
+            const MediaFileModel *file = order.front();
+            order.pop_front();
+            auto it = pending.find(file);
+            write = std::move(it->second);
+            pending.erase(it);
+            writing = file;
+        }
+
+        TagWriteStats stats;
+        bool success = writeFile(write, stats);
+
+        // The write changed the mtime, and the size when the file was rewritten
+        uint64_t size = 0;
+        int64_t mtime = 0;
+        if (success && !readFileStat(write.file->getFilepath(), size, mtime))
+            size = mtime = 0;
+
+        std::lock_guard<std::mutex> lock(resultMutex);
+        results.push_back({write.file, std::move(write.metadata), success, stats, size, mtime});
+    }
+}
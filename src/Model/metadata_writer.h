@@ -0,0 +1,85 @@
+#ifndef METADATA_WRITER_H
+#define METADATA_WRITER_H
+
+#include "manager.h"
+
+#include <map>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+
+// Writes edited tags back to the files on a background thread, one file at a
+// time. Edits to a file still waiting are merged into its pending write, so
+// only the latest values hit the disk. See MetadataManager::saveMetadata for
+// how a file is written (in place in its tag padding, or as a renamed copy).
+class MetadataWriter
+{
+public:
+    struct Result
+    {
+        std::shared_ptr<MediaFileModel> file;
+        std::map<std::string, std::string> metadata; // values that were written
+        bool success;
+        TagWriteStats stats;
+        uint64_t fileSize = 0;    // stat of the file after a successful write
+        int64_t modifiedTime = 0;
+    };
+
+private:
+    struct PendingWrite
+    {
+        std::shared_ptr<MediaFileModel> file;
+        std::map<std::string, std::string> metadata;
+        // Of the model when queued, the writer thread never reads it
+        int duration;
+        bool metadataLoaded; // metadata holds every tag of the file
+    };
+
+    MetadataManager metadataManager;
+    std::thread writerThread;
+
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    std::deque<const MediaFileModel *> order;
+    std::unordered_map<const MediaFileModel *, PendingWrite> pending;
+    const MediaFileModel *writing; // taken from the queue, being written
+    bool stopping;
+
+    std::mutex resultMutex;
+    std::vector<Result> results;
+    std::atomic<uint64_t> bytesWritten;
+
+    void writerFunc();
+    bool writeFile(const PendingWrite &write, TagWriteStats &stats);
+
+public:
+    MetadataWriter();
+    // Finishes the queued writes before returning
+    ~MetadataWriter();
+
+    // Share the persistent tag cache, so written files are not parsed again; set before queuing work
+    void setCache(std::shared_ptr<MetadataCache> cache);
+
+    // Padding reserved when a file has to be rewritten; set before queuing work
+    void setTagPadding(size_t bytes);
+
+    // Queue writing metadata to file, replacing a write of the same file not started yet
+    void enqueue(const std::shared_ptr<MediaFileModel> &file, const std::map<std::string, std::string> &metadata);
+
+    // True while file has a write queued or in progress
+    bool isPending(const MediaFileModel *file);
+    size_t getPendingCount();
+
+    // Results completed since the last call, in completion order
+    std::vector<Result> takeResults();
+
+    // Bytes written to files by all saves so far
+    uint64_t getBytesWritten() const;
+};
+
+#endif // METADATA_WRITER_H
@@ -0,0 +1,533 @@
+#include "scanner.h"
+#include "sniffer.h"
+
+#include <algorithm>
+#include <thread>
+#include <iostream>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/syscall.h>
+
+// From linux/ioprio.h, which older kernel headers do not ship
+static const int ioprioWhoProcess = 1; // with id 0: the calling thread
+static const int ioprioClassIdle = 3;
+static const int ioprioClassShift = 13;
+#endif
+
+#ifdef _WIN32
+extern std::string wstring_to_utf8(const std::wstring &wstr);
+extern std::wstring utf8_to_wstring(const std::string &str);
+#endif
+
+namespace fs = std::filesystem;
+
+static std::string pathToUtf8(const fs::path &path)
+{
+#ifdef _WIN32
+    return wstring_to_utf8(path.wstring());
+#else
+    return path.string();
+#endif
+}
+
+bool readFileStat(const std::string &filepath, uint64_t &size, int64_t &mtime)
+{
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_wstat64(utf8_to_wstring(filepath).c_str(), &st) != 0 || !(st.st_mode & _S_IFREG))
+        return false;
+    size = st.st_size;
+    mtime = static_cast<int64_t>(st.st_mtime) * 1000000000;
+#else
+    struct stat st;
+    if (stat(filepath.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        return false;
+    size = st.st_size;
+    mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    return true;
+}
+
+// ScanJob implementation
+void ScanJob::cancel()
+{
+    cancelled = true;
+}
+
+bool ScanJob::isCancelled() const
+{
+    return cancelled;
+}
+
+size_t ScanJob::getDirectoriesScanned() const
+{
+    return directoriesScanned;
+}
+
+size_t ScanJob::getFilesFound() const
+{
+    return filesFound;
+}
+
+void ScanJob::addProgress(size_t directories, size_t files)
+{
+    directoriesScanned += directories;
+    filesFound += files;
+}
+
+// DirectoryScanner implementation
+DirectoryScanner::DirectoryScanner(unsigned int threads)
+    : contentSniffing(false), idleIoPriority(true), directoryReadLimit(0), throttleTokens(0),
+      currentJob(nullptr), pendingDirectories(0)
+{
+    setThreadCount(threads);
+#ifdef __linux__
+    backend = ScanBackend::GETDENTS;
+#else
+    backend = ScanBackend::FILESYSTEM;
+#endif
+}
+
+void DirectoryScanner::setThreadCount(unsigned int threads)
+{
+    std::lock_guard<std::mutex> lock(scanMutex);
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    threadCount = std::max(1u, threads);
+}
+
+unsigned int DirectoryScanner::getThreadCount() const
+{
+    return threadCount;
+}
+
+void DirectoryScanner::setBackend(ScanBackend scanBackend)
+{
+    std::lock_guard<std::mutex> lock(scanMutex);
+#ifdef __linux__
+    backend = scanBackend;
+#else
+    (void)scanBackend;
+#endif
+}
+
+ScanBackend DirectoryScanner::getBackend() const
+{
+    return backend;
+}
+
+void DirectoryScanner::setContentSniffing(bool enabled)
+{
+    std::lock_guard<std::mutex> lock(scanMutex);
+    contentSniffing = enabled;
+}
+
+bool DirectoryScanner::isContentSniffing() const
+{
+    return contentSniffing;
+}
+
+void DirectoryScanner::setIdleIoPriority(bool enabled)
+{
+    std::lock_guard<std::mutex> lock(scanMutex);
+    idleIoPriority = enabled;
+}
+
+void DirectoryScanner::setDirectoryReadLimit(unsigned int readsPerSecond)
+{
+    std::lock_guard<std::mutex> lock(scanMutex);
+    directoryReadLimit = readsPerSecond;
+}
+
+bool DirectoryScanner::waitForReadToken()
+{
+    if (directoryReadLimit == 0)
+        return true;
+
+    // Allow bursts of a tenth of a second worth of reads
+    const double burst = std::max(1.0, directoryReadLimit / 10.0);
+    while (!currentJob->isCancelled())
+    {
+        double missing;
+        {
+            std::lock_guard<std::mutex> lock(throttleMutex);
+            auto now = std::chrono::steady_clock::now();
+            double elapsed = std::chrono::duration<double>(now - throttleRefill).count();
+            throttleRefill = now;
+            throttleTokens = std::min(burst, throttleTokens + elapsed * directoryReadLimit);
+            if (throttleTokens >= 1.0)
+            {
+                throttleTokens -= 1.0;
+                return true;
+            }
+            missing = 1.0 - throttleTokens;
+        }
+
+        // Sleep in short steps so cancellation stays responsive
+        auto wait = std::chrono::duration<double>(missing / directoryReadLimit);
+        std::this_thread::sleep_for(std::min<std::chrono::duration<double>>(wait, std::chrono::milliseconds(20)));
+    }
+    return false;
+}
+
+void DirectoryScanner::pushDirectory(size_t worker, std::string dir)
+{
+    pendingDirectories++;
+    std::lock_guard<std::mutex> lock(queues[worker]->mutex);
+    queues[worker]->directories.push_back(std::move(dir));
+}
+
+bool DirectoryScanner::popDirectory(size_t worker, std::string &dir)
+{
+    std::lock_guard<std::mutex> lock(queues[worker]->mutex);
+    auto &own = queues[worker]->directories;
+    if (own.empty())
+        return false;
+
+    dir = std::move(own.back());
+    own.pop_back();
+    return true;
+}
+
+bool DirectoryScanner::stealDirectory(size_t worker, std::string &dir)
+{
+    for (size_t i = 1; i < queues.size(); ++i)
+    {
+        auto &victim = *queues[(worker + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.directories.empty())
+        {
+            // Take the oldest entry: it is closest to the root and holds the most work
+            dir = std::move(victim.directories.front());
+            victim.directories.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void DirectoryScanner::publishChunk(const ChunkCallback &onChunk, WorkerState &state)
+{
+    state.lastPublish = std::chrono::steady_clock::now();
+    if (state.results.empty())
+        return;
+
+    std::vector<ScanEntry> chunk;
+    chunk.swap(state.results);
+    std::lock_guard<std::mutex> lock(chunkMutex);
+    onChunk(std::move(chunk));
+}
+
+void DirectoryScanner::maybePublishChunk(const ChunkCallback &onChunk, WorkerState &state)
+{
+    if (onChunk && (state.results.size() >= chunkSize ||
+                    std::chrono::steady_clock::now() - state.lastPublish >= std::chrono::milliseconds(chunkIntervalMs)))
+    {
+        publishChunk(onChunk, state);
+    }
+}
+
+void DirectoryScanner::scanWithFilesystem(size_t worker, const std::string &dir, const Classifier &classify,
+                                          const ChunkCallback &onChunk, WorkerState &state)
+{
+    std::error_code ec;
+    fs::directory_iterator it(fs::u8path(dir), fs::directory_options::skip_permission_denied, ec);
+    if (ec)
+    {
+        std::cerr << "Filesystem error: " << dir << ": " << ec.message() << std::endl;
+        return;
+    }
+
+    for (; it != fs::directory_iterator() && !currentJob->isCancelled(); it.increment(ec))
+    {
+        if (ec)
+        {
+            std::cerr << "Filesystem error: " << ec.message() << std::endl;
+            break;
+        }
+
+        const fs::directory_entry &entry = *it;
+        std::error_code typeEc;
+
+        // Like recursive_directory_iterator, do not descend into directory symlinks
+        if (entry.is_directory(typeEc) && !entry.is_symlink(typeEc))
+        {
+            pushDirectory(worker, pathToUtf8(entry.path()));
+        }
+        else if (entry.is_regular_file(typeEc))
+        {
+            std::string filename = pathToUtf8(entry.path().filename());
+            ScanEntry result{pathToUtf8(entry.path()), classify(filename), 0, 0};
+            if (result.type == MediaType::UNKNOWN)
+            {
+                if (!contentSniffing)
+                    continue;
+
+                uint8_t header[sniffHeaderSize];
+                long length = readFileHeader(result.filepath, header);
+                SniffResult sniffed = sniffMediaHeader(header, length > 0 ? length : 0);
+                if (sniffed.type == MediaType::UNKNOWN)
+                    continue;
+                result.type = sniffed.type;
+                result.container = sniffed.container;
+            }
+
+            if (!readFileStat(result.filepath, result.size, result.mtime))
+                continue;
+            state.results.push_back(std::move(result));
+            state.found++;
+            maybePublishChunk(onChunk, state);
+        }
+    }
+}
+
+#ifdef __linux__
+// Kernel record returned by getdents64
+struct LinuxDirent64
+{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+#endif
+
+void DirectoryScanner::scanWithGetdents(size_t worker, const std::string &dir, const Classifier &classify,
+                                        const ChunkCallback &onChunk, WorkerState &state)
+{
+#ifdef __linux__
+    int dirFd = openat(AT_FDCWD, dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd < 0)
+    {
+        if (errno != EACCES)
+            std::cerr << "Filesystem error: " << dir << ": cannot open directory" << std::endl;
+        return;
+    }
+
+    // Child paths are built by appending names to a reused prefix
+    std::string &path = state.pathBuffer;
+    path.assign(dir);
+    if (path.empty() || path.back() != '/')
+        path.push_back('/');
+    const size_t prefixLength = path.size();
+
+    if (state.direntBuffer.empty())
+        state.direntBuffer.resize(64 * 1024);
+
+    while (!currentJob->isCancelled())
+    {
+        long nread = syscall(SYS_getdents64, dirFd, state.direntBuffer.data(), state.direntBuffer.size());
+        if (nread < 0)
+        {
+            std::cerr << "Filesystem error: " << dir << ": getdents64 failed" << std::endl;
+            break;
+        }
+        if (nread == 0)
+            break;
+
+        for (long offset = 0; offset < nread;)
+        {
+            const LinuxDirent64 *dirent = reinterpret_cast<const LinuxDirent64 *>(state.direntBuffer.data() + offset);
+            offset += dirent->d_reclen;
+
+            const char *name = dirent->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+                continue;
+
+            unsigned char type = dirent->d_type;
+            struct stat st;
+            bool haveStat = false;
+
+            // Some filesystems do not fill d_type, only then pay for an lstat
+            if (type == DT_UNKNOWN)
+            {
+                if (fstatat(dirFd, name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+                    continue;
+                if (S_ISDIR(st.st_mode))
+                    type = DT_DIR;
+                else if (S_ISREG(st.st_mode))
+                    type = DT_REG;
+                else if (S_ISLNK(st.st_mode))
+                    type = DT_LNK;
+                else
+                    continue;
+                haveStat = type == DT_REG;
+            }
+
+            if (type == DT_DIR)
+            {
+                path.resize(prefixLength);
+                path.append(name);
+                pushDirectory(worker, path);
+                continue;
+            }
+            // Symlinks to regular files count, symlinks to directories are not followed
+            if (type != DT_REG && type != DT_LNK)
+                continue;
+
+            MediaType mediaType = classify(std::string_view(name));
+            if (mediaType == MediaType::UNKNOWN)
+            {
+                if (contentSniffing)
+                    state.sniffCandidates.push_back(name);
+                continue;
+            }
+
+            if (!haveStat && (fstatat(dirFd, name, &st, 0) != 0 || !S_ISREG(st.st_mode)))
+                continue;
+
+            path.resize(prefixLength);
+            path.append(name);
+            state.results.push_back({path, mediaType, static_cast<uint64_t>(st.st_size),
+                                     static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec});
+            state.found++;
+            maybePublishChunk(onChunk, state);
+        }
+    }
+
+    if (!state.sniffCandidates.empty() && !currentJob->isCancelled())
+        sniffCandidates(dirFd, onChunk, state);
+
+    close(dirFd);
+#else
+    scanWithFilesystem(worker, dir, classify, onChunk, state);
+#endif
+}
+
+void DirectoryScanner::sniffCandidates(int dirFd, const ChunkCallback &onChunk, WorkerState &state)
+{
+#ifdef __linux__
+    // Header reads for one directory are batched after its listing, each a
+    // single pread relative to the already open directory
+    const size_t prefixLength = state.pathBuffer.find_last_of('/') + 1;
+    uint8_t header[sniffHeaderSize];
+
+    for (const auto &name : state.sniffCandidates)
+    {
+        int fd = openat(dirFd, name.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+        if (fd < 0)
+            continue;
+
+        struct stat st;
+        ssize_t length = -1;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+            length = pread(fd, header, sizeof(header), 0);
+        close(fd);
+        if (length <= 0)
+            continue;
+
+        SniffResult sniffed = sniffMediaHeader(header, length);
+        if (sniffed.type == MediaType::UNKNOWN)
+            continue;
+
+        state.pathBuffer.resize(prefixLength);
+        state.pathBuffer.append(name);
+        ScanEntry result{state.pathBuffer, sniffed.type, static_cast<uint64_t>(st.st_size),
+                         static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec,
+                         sniffed.container};
+        state.results.push_back(std::move(result));
+        state.found++;
+        maybePublishChunk(onChunk, state);
+    }
+#else
+    (void)dirFd;
+    (void)onChunk;
+#endif
+    state.sniffCandidates.clear();
+}
+
+void DirectoryScanner::workerFunc(size_t worker, const Classifier &classify, const ChunkCallback &onChunk, WorkerState &state)
+{
+#ifdef __linux__
+    // ioprio applies per thread; worker 0 is the caller's thread, so restore it afterwards
+    long previousIoPriority = -1;
+    if (idleIoPriority)
+    {
+        previousIoPriority = syscall(SYS_ioprio_get, ioprioWhoProcess, 0);
+        syscall(SYS_ioprio_set, ioprioWhoProcess, 0, ioprioClassIdle << ioprioClassShift);
+    }
+#endif
+
+    std::string dir;
+    state.lastPublish = std::chrono::steady_clock::now();
+    while (pendingDirectories > 0 && !currentJob->isCancelled())
+    {
+        if (popDirectory(worker, dir) || stealDirectory(worker, dir))
+        {
+            if (waitForReadToken())
+            {
+                if (backend == ScanBackend::GETDENTS)
+                    scanWithGetdents(worker, dir, classify, onChunk, state);
+                else
+                    scanWithFilesystem(worker, dir, classify, onChunk, state);
+                currentJob->addProgress(1, state.found);
+                state.found = 0;
+            }
+            pendingDirectories--;
+        }
+        else
+        {
+            // Other workers are still expanding directories
+            std::this_thread::yield();
+        }
+    }
+
+    if (onChunk && !currentJob->isCancelled())
+        publishChunk(onChunk, state);
+
+#ifdef __linux__
+    if (previousIoPriority >= 0)
+        syscall(SYS_ioprio_set, ioprioWhoProcess, 0, previousIoPriority);
+#endif
+}
+
+std::vector<ScanEntry> DirectoryScanner::scan(const fs::path &root, const Classifier &classify,
+                                              const ChunkCallback &onChunk, std::shared_ptr<ScanJob> job)
+{
+    std::lock_guard<std::mutex> lock(scanMutex);
+
+    if (!job)
+        job = std::make_shared<ScanJob>();
+    currentJob = job.get();
+    throttleTokens = 0;
+    throttleRefill = std::chrono::steady_clock::now();
+
+    queues.clear();
+    for (unsigned int i = 0; i < threadCount; ++i)
+        queues.push_back(std::make_unique<WorkQueue>());
+
+    std::vector<WorkerState> states(threadCount);
+    pendingDirectories = 0;
+    pushDirectory(0, pathToUtf8(root));
+
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < threadCount; ++i)
+        workers.emplace_back(&DirectoryScanner::workerFunc, this, i, std::cref(classify), std::cref(onChunk), std::ref(states[i]));
+    workerFunc(0, classify, onChunk, states[0]);
+
+    for (auto &worker : workers)
+        worker.join();
+    queues.clear();
+    currentJob = nullptr;
+
+    // Merge per-worker results; sort so output does not depend on scheduling
+    std::vector<ScanEntry> results;
+    size_t total = 0;
+    for (const auto &state : states)
+        total += state.results.size();
+    results.reserve(total);
+    for (auto &state : states)
+        std::move(state.results.begin(), state.results.end(), std::back_inserter(results));
+
+    std::sort(results.begin(), results.end(),
+              [](const ScanEntry &a, const ScanEntry &b)
+              {
+                  return a.filepath < b.filepath;
+              });
+    return results;
+}
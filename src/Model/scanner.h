@@ -0,0 +1,150 @@
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include "media.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <filesystem>
+
+// Media file found by a directory scan
+struct ScanEntry
+{
+    std::string filepath;
+    MediaType type;
+    uint64_t size;
+    int64_t mtime; // nanoseconds since the Unix epoch
+    ContainerFormat container = ContainerFormat::UNKNOWN; // set when found by content sniffing
+};
+
+// Size and modification time (ns since the Unix epoch) of a UTF-8 path.
+// Scan backends and the library index all go through this so values compare equal.
+bool readFileStat(const std::string &filepath, uint64_t &size, int64_t &mtime);
+
+// Handle on a running scan: cancellation token and progress counters, shared
+// between the caller and the scanner workers
+class ScanJob
+{
+private:
+    std::atomic<bool> cancelled{false};
+    std::atomic<size_t> directoriesScanned{0};
+    std::atomic<size_t> filesFound{0};
+
+public:
+    void cancel();
+    bool isCancelled() const;
+
+    size_t getDirectoriesScanned() const;
+    size_t getFilesFound() const;
+
+    // Called by the scanner after each directory
+    void addProgress(size_t directories, size_t files);
+};
+
+// How directories are enumerated
+enum class ScanBackend
+{
+    FILESYSTEM, // std::filesystem::directory_iterator, portable
+    GETDENTS    // Linux only: openat + getdents64, trusts d_type and only stats media files
+};
+
+// Parallel directory walker. Every subdirectory is a unit of work; each worker
+// owns a deque, pops its own work LIFO and steals FIFO from the others.
+class DirectoryScanner
+{
+private:
+    struct WorkQueue
+    {
+        std::deque<std::string> directories; // UTF-8 paths
+        std::mutex mutex;
+    };
+
+    // The classifier only sees the file name
+    using Classifier = std::function<MediaType(std::string_view)>;
+    using ChunkCallback = std::function<void(std::vector<ScanEntry> &&)>;
+
+    // Streaming mode hands results out in chunks of this many files or after this delay
+    static constexpr size_t chunkSize = 500;
+    static constexpr int chunkIntervalMs = 50;
+
+    unsigned int threadCount;
+    ScanBackend backend;
+    bool contentSniffing;
+    std::mutex scanMutex;
+    std::mutex chunkMutex;
+
+    // Background I/O settings, see setIdleIoPriority and setDirectoryReadLimit
+    bool idleIoPriority;
+    unsigned int directoryReadLimit; // directory reads per second, 0 = unlimited
+    std::mutex throttleMutex;
+    double throttleTokens;
+    std::chrono::steady_clock::time_point throttleRefill;
+
+    ScanJob *currentJob;
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::atomic<size_t> pendingDirectories;
+
+    void pushDirectory(size_t worker, std::string dir);
+    bool popDirectory(size_t worker, std::string &dir);
+    bool stealDirectory(size_t worker, std::string &dir);
+
+    struct WorkerState
+    {
+        std::vector<ScanEntry> results;
+        std::chrono::steady_clock::time_point lastPublish;
+        std::string pathBuffer;         // reused to build child paths
+        std::vector<char> direntBuffer; // getdents64 records
+        std::vector<std::string> sniffCandidates; // names in the current directory
+        size_t found = 0;                          // files found since the last progress update
+    };
+
+    void workerFunc(size_t worker, const Classifier &classify, const ChunkCallback &onChunk, WorkerState &state);
+    void scanWithFilesystem(size_t worker, const std::string &dir, const Classifier &classify,
+                            const ChunkCallback &onChunk, WorkerState &state);
+    void scanWithGetdents(size_t worker, const std::string &dir, const Classifier &classify,
+                          const ChunkCallback &onChunk, WorkerState &state);
+    void sniffCandidates(int dirFd, const ChunkCallback &onChunk, WorkerState &state);
+    bool waitForReadToken();
+    void maybePublishChunk(const ChunkCallback &onChunk, WorkerState &state);
+    void publishChunk(const ChunkCallback &onChunk, WorkerState &state);
+
+public:
+    // threads == 0 picks the hardware concurrency
+    DirectoryScanner(unsigned int threads = 0);
+
+    void setThreadCount(unsigned int threads);
+    unsigned int getThreadCount() const;
+
+    // GETDENTS is ignored where it is not available
+    void setBackend(ScanBackend scanBackend);
+    ScanBackend getBackend() const;
+
+    // Also read the header of files the classifier rejects and keep those whose
+    // content is a known media container (wrong or missing extension)
+    void setContentSniffing(bool enabled);
+    bool isContentSniffing() const;
+
+    // Keep scans from starving playback on the same device: run the workers in the
+    // idle I/O class (Linux ioprio_set, only honoured by the BFQ/CFQ schedulers)
+    // and/or cap directory reads per second with a token bucket (0 = no limit)
+    void setIdleIoPriority(bool enabled);
+    void setDirectoryReadLimit(unsigned int readsPerSecond);
+
+    // Walk root recursively, returning every file the classifier accepts sorted by path.
+    // With onChunk set, entries are instead handed out in discovery order as the walk
+    // progresses (from worker threads, one call at a time) and the result is empty.
+    // Cancelling job stops the workers within the directory they are reading; the
+    // result is then incomplete.
+    std::vector<ScanEntry> scan(const std::filesystem::path &root, const Classifier &classify,
+                                const ChunkCallback &onChunk = nullptr, std::shared_ptr<ScanJob> job = nullptr);
+};
+
+#endif // SCANNER_H
@@ -0,0 +1,277 @@
+#include "search_index.h"
+
+#include <atomic>
+#include <algorithm>
+
+namespace
+{
+    // Checked for cancellation once per this many entries
+    const size_t cancelCheckInterval = 4096;
+
+    uint64_t nextRevision()
+    {
+        static std::atomic<uint64_t> counter{0};
+        return ++counter;
+    }
+
+    // Same folding as the linear search it replaces: ASCII letters only, UTF-8 bytes are kept
+    void appendLower(std::string &out, const std::string &value)
+    {
+        for (char c : value)
+            out += (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+    }
+
+    uint32_t trigramAt(const std::string &text, size_t pos)
+    {
+        return (uint32_t(uint8_t(text[pos])) << 16) | (uint32_t(uint8_t(text[pos + 1])) << 8) | uint8_t(text[pos + 2]);
+    }
+
+    // Distinct trigrams of text, none spanning a line break
+    std::vector<uint32_t> trigrams(const std::string &text)
+    {
+        std::vector<uint32_t> grams;
+        grams.reserve(text.size());
+        for (size_t pos = 0; pos + 3 <= text.size(); ++pos)
+        {
+            if (text[pos] == '\n' || text[pos + 1] == '\n')
+                continue;
+            if (text[pos + 2] == '\n')
+            {
+                pos += 2;
+                continue;
+            }
+            grams.push_back(trigramAt(text, pos));
+        }
+        std::sort(grams.begin(), grams.end());
+        grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+        return grams;
+    }
+}
+
+SearchIndex::SearchIndex() : revision(nextRevision())
+{
+}
+
+std::string SearchIndex::indexText(const MediaFileModel &file)
+{
+    std::string text;
+    appendLower(text, file.getFilename());
+    for (const auto &[key, value] : file.getAllMetadata())
+    {
+        text += '\n';
+        appendLower(text, value);
+    }
+    return text;
+}
+
+void SearchIndex::insert(const std::shared_ptr<MediaFileModel> &file, std::string text)
+{
+    uint32_t id = static_cast<uint32_t>(entries.size());
+    for (uint32_t gram : trigrams(text))
+        postings[gram].push_back(id); // ids only grow, lists stay sorted
+    entries.push_back({file, std::move(text)});
+    ids[file.get()] = id;
+    revision = nextRevision();
+}
+
+void SearchIndex::add(const std::shared_ptr<MediaFileModel> &file, const SearchIndex *previous)
+{
+    if (!file->isMetadataLoaded() && file->getAllMetadata().empty())
+    {
+        // Tags evicted from memory, still searchable by what was indexed before
+        auto it = ids.find(file.get());
+        if (it != ids.end())
+            return;
+        if (previous)
+        {
+            auto old = previous->ids.find(file.get());
+            if (old != previous->ids.end())
+            {
+                insert(file, previous->entries[old->second].text);
+                return;
+            }
+        }
+    }
+
+    remove(file.get());
+    insert(file, indexText(*file));
+}
+
+void SearchIndex::remove(const MediaFileModel *file)
+{
+    auto it = ids.find(file);
+    if (it == ids.end())
+        return;
+
+    // Left in the posting lists until the next compaction, skipped by search
+    Entry &entry = entries[it->second];
+    entry.file.reset();
+    entry.text = std::string();
+    ids.erase(it);
+    ++removedCount;
+    revision = nextRevision();
+
+    if (removedCount > 1024 && removedCount * 2 > entries.size())
+        compact();
+}
+
+void SearchIndex::compact()
+{
+    std::vector<Entry> live;
+    live.reserve(entries.size() - removedCount);
+    for (auto &entry : entries)
+    {
+        if (entry.file)
+            live.push_back(std::move(entry));
+    }
+
+    entries.clear();
+    ids.clear();
+    postings.clear();
+    removedCount = 0;
+    for (auto &entry : live)
+        insert(entry.file, std::move(entry.text));
+}
+
+bool SearchIndex::contains(const MediaFileModel *file) const
+{
+    return ids.count(file) > 0;
+}
+
+void SearchIndex::clear()
+{
+    entries.clear();
+    ids.clear();
+    postings.clear();
+    removedCount = 0;
+    revision = nextRevision();
+}
+
+void SearchIndex::swap(SearchIndex &other)
+{
+    entries.swap(other.entries);
+    ids.swap(other.ids);
+    postings.swap(other.postings);
+    std::swap(removedCount, other.removedCount);
+    std::swap(revision, other.revision);
+}
+
+size_t SearchIndex::size() const
+{
+    return ids.size();
+}
+
+uint64_t SearchIndex::getRevision() const
+{
+    return revision;
+}
+
+std::vector<std::shared_ptr<MediaFileModel>> SearchIndex::search(const std::string &keyword,
+                                                                 const CancelCheck &cancelled) const
+{
+    std::string lowerKeyword;
+    appendLower(lowerKeyword, keyword);
+
+    std::vector<std::shared_ptr<MediaFileModel>> result;
+    auto check = [&](const Entry &entry)
+    {
+        if (entry.file && entry.text.find(lowerKeyword) != std::string::npos)
+            result.push_back(entry.file);
+    };
+
+    if (lowerKeyword.size() < 3 || lowerKeyword.find('\n') != std::string::npos)
+    {
+        // Too short for a trigram: scan the indexed text, still without touching the models
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            if (cancelled && i % cancelCheckInterval == 0 && cancelled())
+                return {};
+            check(entries[i]);
+        }
+    }
+    else
+    {
+        // Intersect the posting lists, shortest first
+        std::vector<const std::vector<uint32_t> *> lists;
+        for (uint32_t gram : trigrams(lowerKeyword))
+        {
+            auto it = postings.find(gram);
+            if (it == postings.end())
+                return result;
+            lists.push_back(&it->second);
+        }
+        std::sort(lists.begin(), lists.end(),
+                  [](const std::vector<uint32_t> *a, const std::vector<uint32_t> *b)
+                  {
+                      return a->size() < b->size();
+                  });
+
+        std::vector<uint32_t> candidates = *lists.front();
+        for (size_t i = 1; i < lists.size() && !candidates.empty(); ++i)
+        {
+            const std::vector<uint32_t> &list = *lists[i];
+            auto from = list.begin();
+            size_t kept = 0;
+            for (uint32_t id : candidates)
+            {
+                from = std::lower_bound(from, list.end(), id);
+                if (from == list.end())
+                    break;
+                if (*from == id)
+                    candidates[kept++] = id;
+            }
+            candidates.resize(kept);
+        }
+
+        // A file holding every trigram may still not hold them in sequence
+        for (size_t i = 0; i < candidates.size(); ++i)
+        {
+            if (cancelled && i % cancelCheckInterval == 0 && cancelled())
+                return {};
+            check(entries[candidates[i]]);
+        }
+    }
+
+    // Ids follow path order when the index was built from the sorted library
+    auto byPath = [](const std::shared_ptr<MediaFileModel> &a, const std::shared_ptr<MediaFileModel> &b)
+    {
+        return a->getFilepath() < b->getFilepath();
+    };
+    if (!std::is_sorted(result.begin(), result.end(), byPath))
+        std::sort(result.begin(), result.end(), byPath);
+    return result;
+}
+
+std::vector<std::shared_ptr<MediaFileModel>> SearchIndex::refine(const std::vector<std::shared_ptr<MediaFileModel>> &files,
+                                                                 const std::string &keyword,
+                                                                 const CancelCheck &cancelled) const
+{
+    std::string lowerKeyword;
+    appendLower(lowerKeyword, keyword);
+
+    // A file of the earlier result costs a lookup by pointer; once they outnumber
+    // the shortest posting list, or half the entries for a short keyword, the
+    // index is faster
+    size_t searchCost = entries.size() / 2;
+    if (lowerKeyword.size() >= 3 && lowerKeyword.find('\n') == std::string::npos)
+    {
+        for (uint32_t gram : trigrams(lowerKeyword))
+        {
+            auto it = postings.find(gram);
+            searchCost = std::min(searchCost, it != postings.end() ? it->second.size() : 0);
+        }
+    }
+    if (searchCost < files.size())
+        return search(keyword, cancelled);
+
+    std::vector<std::shared_ptr<MediaFileModel>> result;
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        if (cancelled && i % cancelCheckInterval == 0 && cancelled())
+            return {};
+        auto it = ids.find(files[i].get());
+        if (it != ids.end() && entries[it->second].text.find(lowerKeyword) != std::string::npos)
+            result.push_back(files[i]);
+    }
+    return result;
+}
@@ -0,0 +1,66 @@
+#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+#include "media.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+// Trigram inverted index over the filename and tag values of the library, for
+// case-insensitive substring search. A query of three characters or more only
+// looks at the files holding all of its trigrams; each candidate is confirmed
+// against the lowercased text kept in the index, so there are no false hits.
+// Not thread-safe, MediaLibrary guards it with its lock.
+class SearchIndex
+{
+private:
+    struct Entry
+    {
+        std::shared_ptr<MediaFileModel> file; // nullptr once removed
+        std::string text;                     // lowercased filename and values, one per line
+    };
+
+    std::vector<Entry> entries; // by id, ids are never reused until compaction
+    std::unordered_map<const MediaFileModel *, uint32_t> ids;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> postings; // trigram -> ascending ids
+    size_t removedCount = 0;
+    uint64_t revision;
+
+    static std::string indexText(const MediaFileModel &file);
+    void insert(const std::shared_ptr<MediaFileModel> &file, std::string text);
+    void compact();
+
+public:
+    // Polled while searching, a search stops early and returns nothing once it answers true
+    using CancelCheck = std::function<bool()>;
+
+    SearchIndex();
+
+    // Index file, replacing its previous entry. A file whose tags were dropped to
+    // save memory keeps the text it was indexed with, here or in previous.
+    void add(const std::shared_ptr<MediaFileModel> &file, const SearchIndex *previous = nullptr);
+    void remove(const MediaFileModel *file);
+    bool contains(const MediaFileModel *file) const;
+    void clear();
+    void swap(SearchIndex &other);
+    size_t size() const;
+    // Changes whenever the indexed files or their text change, never repeats
+    uint64_t getRevision() const;
+
+    // Files whose filename or one of whose tag values contains keyword, ignoring
+    // ASCII case, sorted by path. An empty keyword matches every file.
+    std::vector<std::shared_ptr<MediaFileModel>> search(const std::string &keyword,
+                                                        const CancelCheck &cancelled = nullptr) const;
+    // Same as search, narrowing files instead when that is cheaper. files must be
+    // the result of searching a keyword contained in this one, with no change to
+    // the index since: every match of keyword is then among them.
+    std::vector<std::shared_ptr<MediaFileModel>> refine(const std::vector<std::shared_ptr<MediaFileModel>> &files,
+                                                        const std::string &keyword,
+                                                        const CancelCheck &cancelled = nullptr) const;
+};
+
+#endif // SEARCH_INDEX_H
@@ -0,0 +1,137 @@
+#include "search_session.h"
+
+#include <algorithm>
+
+namespace
+{
+    // Same folding as the search index, so containment of keywords matches containment of results
+    std::string fold(const std::string &value)
+    {
+        std::string out = value;
+        for (char &c : out)
+        {
+            if (c >= 'A' && c <= 'Z')
+                c = static_cast<char>(c - 'A' + 'a');
+        }
+        return out;
+    }
+}
+
+// SearchSession implementation
+SearchSession::SearchSession(const MediaLibrary *library)
+    : library(library), hasPending(false), stopping(false), requestSerial(0), resultSerial(0), hasResult(false)
+{
+    searchThread = std::thread(&SearchSession::searchFunc, this);
+}
+
+SearchSession::~SearchSession()
+{
+    {
+        std::lock_guard<std::mutex> lock(requestMutex);
+        stopping = true;
+        hasPending = false;
+        ++requestSerial;
+    }
+    requestCondition.notify_all();
+
+    if (searchThread.joinable())
+        searchThread.join();
+}
+
+void SearchSession::update(const std::string &keyword)
+{
+    {
+        std::lock_guard<std::mutex> lock(requestMutex);
+        pending = keyword;
+        hasPending = true;
+        ++requestSerial;
+    }
+    requestCondition.notify_one();
+}
+
+void SearchSession::cancel()
+{
+    std::lock_guard<std::mutex> lock(requestMutex);
+    hasPending = false;
+    ++requestSerial;
+}
+
+bool SearchSession::takeResult(Result &latest)
+{
+    std::lock_guard<std::mutex> lock(resultMutex);
+    if (!hasResult || resultSerial != requestSerial)
+        return false;
+    hasResult = false;
+    latest = std::move(result);
+    return true;
+}
+
+bool SearchSession::search(const std::string &keyword, const SearchIndex::CancelCheck &cancelled,
+                           std::vector<std::shared_ptr<MediaFileModel>> &files)
+{
+    // Read before searching: a change during the search leaves the entry stale, never wrong
+    uint64_t revision = library->getSearchRevision();
+    if (!recent.empty() && recent.front().revision != revision)
+        recent.clear();
+
+    std::string lowerKeyword = fold(keyword);
+    auto base = recent.end();
+    for (auto it = recent.begin(); it != recent.end(); ++it)
+    {
+        if (it->keyword == lowerKeyword)
+        {
+            // Backspaced to a keyword searched before
+            files = it->files;
+            std::rotate(recent.begin(), it, it + 1);
+            return true;
+        }
+        // Every match of keyword is a match of a keyword it contains
+        if (!it->keyword.empty() && lowerKeyword.find(it->keyword) != std::string::npos &&
+            (base == recent.end() || it->keyword.size() > base->keyword.size()))
+            base = it;
+    }
+
+    if (base != recent.end())
+        files = library->refineSearch(base->files, keyword, cancelled);
+    else
+        files = library->searchMedia(keyword, cancelled);
+    if (cancelled())
+        return false;
+
+    recent.push_front({lowerKeyword, files, revision});
+    if (recent.size() > recentCount)
+        recent.pop_back();
+    return true;
+}
+
+void SearchSession::searchFunc()
+{
+    while (true)
+    {
+        std::string keyword;
+        uint64_t serial;
+        {
+            std::unique_lock<std::mutex> lock(requestMutex);
+            requestCondition.wait(lock, [this]()
+                                  { return stopping || hasPending; });
+            if (stopping)
+                return;
+            keyword = std::move(pending);
+            hasPending = false;
+            serial = requestSerial;
+        }
+
+        auto cancelled = [this, serial]()
+        {
+            return requestSerial != serial;
+        };
+        std::vector<std::shared_ptr<MediaFileModel>> files;
+        if (!search(keyword, cancelled, files))
+            continue;
+
+        std::lock_guard<std::mutex> lock(resultMutex);
+        result = {std::move(keyword), std::move(files)};
+        resultSerial = serial;
+        hasResult = true;
+    }
+}
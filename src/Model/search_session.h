@@ -0,0 +1,76 @@
+#ifndef SEARCH_SESSION_H
+#define SEARCH_SESSION_H
+
+#include "manager.h"
+
+#include <deque>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Search-as-you-type over the library on a background thread. Only the latest
+// keystroke is searched: a newer keyword replaces the one waiting and stops the
+// search in progress, so typing never queues up searches. A keyword containing
+// an earlier one narrows that result instead of searching the whole library,
+// and the results of the last few keywords are kept so backspacing is answered
+// from memory. Remembered results are dropped once the search index changes.
+class SearchSession
+{
+public:
+    struct Result
+    {
+        std::string keyword;
+        std::vector<std::shared_ptr<MediaFileModel>> files; // sorted by path
+    };
+
+private:
+    static constexpr size_t recentCount = 8;
+
+    const MediaLibrary *library;
+    std::thread searchThread;
+
+    std::mutex requestMutex;
+    std::condition_variable requestCondition;
+    std::string pending;
+    bool hasPending;
+    bool stopping;
+    std::atomic<uint64_t> requestSerial; // bumped by every request, stale searches stop
+
+    std::mutex resultMutex;
+    Result result;
+    uint64_t resultSerial;
+    bool hasResult;
+
+    // Worker thread only
+    struct Recent
+    {
+        std::string keyword; // lowercased
+        std::vector<std::shared_ptr<MediaFileModel>> files;
+        uint64_t revision;
+    };
+    std::deque<Recent> recent; // most recently used first
+
+    void searchFunc();
+    bool search(const std::string &keyword, const SearchIndex::CancelCheck &cancelled,
+                std::vector<std::shared_ptr<MediaFileModel>> &files);
+
+public:
+    // library must outlive the session
+    explicit SearchSession(const MediaLibrary *library);
+    ~SearchSession();
+
+    // Search for keyword, superseding the previous request
+    void update(const std::string &keyword);
+    // Drop the previous request, its result is never delivered
+    void cancel();
+
+    // Result of the latest request once it is ready; false while searching or
+    // when it was already taken
+    bool takeResult(Result &latest);
+};
+
+#endif // SEARCH_SESSION_H
@@ -0,0 +1,86 @@
+#include "sniffer.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <fstream>
+#include <filesystem>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static bool matchesAt(const uint8_t *header, size_t length, size_t offset, const char *signature, size_t signatureLength)
+{
+    return offset + signatureLength <= length && std::memcmp(header + offset, signature, signatureLength) == 0;
+}
+
+SniffResult sniffMediaHeader(const uint8_t *header, size_t length)
+{
+    if (matchesAt(header, length, 0, "ID3", 3))
+        return {MediaType::AUDIO, ContainerFormat::MPEG_AUDIO};
+
+    if (matchesAt(header, length, 0, "fLaC", 4))
+        return {MediaType::AUDIO, ContainerFormat::FLAC};
+
+    if (matchesAt(header, length, 0, "OggS", 4))
+    {
+        // The first packet follows the 27 byte page header and its segment table
+        if (length > 26 && matchesAt(header, length, 27 + header[26], "\x80theora", 7))
+            return {MediaType::VIDEO, ContainerFormat::OGG};
+        return {MediaType::AUDIO, ContainerFormat::OGG};
+    }
+
+    if (matchesAt(header, length, 0, "RIFF", 4))
+    {
+        if (matchesAt(header, length, 8, "WAVE", 4))
+            return {MediaType::AUDIO, ContainerFormat::WAV};
+        if (matchesAt(header, length, 8, "AVI ", 4))
+            return {MediaType::VIDEO, ContainerFormat::AVI};
+        return {};
+    }
+
+    if (matchesAt(header, length, 4, "ftyp", 4))
+    {
+        // Major brand tells audio-only MP4 apart
+        if (matchesAt(header, length, 8, "M4A ", 4) || matchesAt(header, length, 8, "M4B ", 4))
+            return {MediaType::AUDIO, ContainerFormat::MP4};
+        return {MediaType::VIDEO, ContainerFormat::MP4};
+    }
+
+    if (matchesAt(header, length, 0, "\x1A\x45\xDF\xA3", 4))
+        return {MediaType::VIDEO, ContainerFormat::MATROSKA};
+
+    // Raw MPEG audio frame or AAC ADTS frame: 11 bit sync word
+    if (length >= 4 && header[0] == 0xFF && (header[1] & 0xE0) == 0xE0)
+    {
+        int layer = (header[1] >> 1) & 0x03;
+        int bitrateIndex = header[2] >> 4;
+        int sampleRateIndex = (header[2] >> 2) & 0x03;
+
+        if (layer == 0 && (header[1] & 0xF6) == 0xF0)
+            return {MediaType::AUDIO, ContainerFormat::UNKNOWN}; // ADTS, no specific reader
+        if (layer != 0 && bitrateIndex != 0x0F && sampleRateIndex != 0x03)
+            return {MediaType::AUDIO, ContainerFormat::MPEG_AUDIO};
+    }
+
+    return {};
+}
+
+long readFileHeader(const std::string &filepath, uint8_t *buffer)
+{
+#ifdef _WIN32
+    std::ifstream file(std::filesystem::u8path(filepath), std::ios::binary);
+    if (!file.is_open())
+        return -1;
+    file.read(reinterpret_cast<char *>(buffer), sniffHeaderSize);
+    return static_cast<long>(file.gcount());
+#else
+    int fd = open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    ssize_t nread = pread(fd, buffer, sniffHeaderSize, 0);
+    close(fd);
+    return static_cast<long>(nread);
+#endif
+}
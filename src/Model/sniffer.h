@@ -0,0 +1,27 @@
+#ifndef SNIFFER_H
+#define SNIFFER_H
+
+#include "media.h"
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// Number of leading bytes content sniffing looks at
+constexpr size_t sniffHeaderSize = 64;
+
+struct SniffResult
+{
+    MediaType type = MediaType::UNKNOWN;
+    ContainerFormat container = ContainerFormat::UNKNOWN;
+};
+
+// Recognise a media container from the first bytes of a file (ID3, MPEG/ADTS sync,
+// fLaC, OggS, RIFF/WAVE, RIFF/AVI, ftyp, EBML)
+SniffResult sniffMediaHeader(const uint8_t *header, size_t length);
+
+// Read up to sniffHeaderSize bytes from the start of a UTF-8 path, returns the byte count or -1.
+// The buffer is scan-local, tag extraction reads the header again (see ContainerFormat).
+long readFileHeader(const std::string &filepath, uint8_t *buffer);
+
+#endif // SNIFFER_H
@@ -0,0 +1,629 @@
+#include "tag_reader.h"
+#include "block_reader.h"
+
+#include <vector>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+namespace
+{
+    const size_t maxFrameSize = 64 * 1024;         // longer text frames are cut
+    const size_t maxCommentSize = 16 * 1024 * 1024; // Vorbis comments may embed pictures
+    const size_t mpegSyncWindow = 16 * 1024;        // searched for the first MPEG frame after the tag
+
+    const char *const id3v1Genres[] = {
+        "Blues", "Classic Rock", "Country", "Dance", "Disco", "Funk", "Grunge", "Hip-Hop", "Jazz", "Metal",
+        "New Age", "Oldies", "Other", "Pop", "R&B", "Rap", "Reggae", "Rock", "Techno", "Industrial",
+        "Alternative", "Ska", "Death Metal", "Pranks", "Soundtrack", "Euro-Techno", "Ambient", "Trip-Hop", "Vocal", "Jazz+Funk",
+        "Fusion", "Trance", "Classical", "Instrumental", "Acid", "House", "Game", "Sound Clip", "Gospel", "Noise",
+        "Alternative Rock", "Bass", "Soul", "Punk", "Space", "Meditative", "Instrumental Pop", "Instrumental Rock", "Ethnic", "Gothic",
+        "Darkwave", "Techno-Industrial", "Electronic", "Pop-Folk", "Eurodance", "Dream", "Southern Rock", "Comedy", "Cult", "Gangsta",
+        "Top 40", "Christian Rap", "Pop/Funk", "Jungle", "Native American", "Cabaret", "New Wave", "Psychedelic", "Rave", "Showtunes",
+        "Trailer", "Lo-Fi", "Tribal", "Acid Punk", "Acid Jazz", "Polka", "Retro", "Musical", "Rock & Roll", "Hard Rock",
+        "Folk", "Folk/Rock", "National Folk", "Swing", "Fast-Fusion", "Bebop", "Latin", "Revival", "Celtic", "Bluegrass",
+        "Avantgarde", "Gothic Rock", "Progressive Rock", "Psychedelic Rock", "Symphonic Rock", "Slow Rock", "Big Band", "Chorus", "Easy Listening", "Acoustic",
+        "Humour", "Speech", "Chanson", "Opera", "Chamber Music", "Sonata", "Symphony", "Booty Bass", "Primus", "Porn Groove",
+        "Satire", "Slow Jam", "Club", "Tango", "Samba", "Folklore", "Ballad", "Power Ballad", "Rhythmic Soul", "Freestyle",
+        "Duet", "Punk Rock", "Drum Solo", "A Cappella", "Euro-House", "Dance Hall", "Goa", "Drum & Bass", "Club-House", "Hardcore",
+        "Terror", "Indie", "BritPop", "Afro-Punk", "Polsk Punk", "Beat", "Christian Gangsta Rap", "Heavy Metal", "Black Metal", "Crossover",
+        "Contemporary Christian", "Christian Rock", "Merengue", "Salsa", "Thrash Metal", "Anime", "Jpop", "Synthpop"};
+    const size_t id3v1GenreCount = sizeof(id3v1Genres) / sizeof(id3v1Genres[0]);
+
+    uint32_t readBE32(const uint8_t *p) { return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3]; }
+    uint32_t readBE24(const uint8_t *p) { return (uint32_t(p[0]) << 16) | (uint32_t(p[1]) << 8) | p[2]; }
+    uint32_t readLE32(const uint8_t *p) { return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24); }
+    uint64_t readLE64(const uint8_t *p) { return uint64_t(readLE32(p)) | (uint64_t(readLE32(p + 4)) << 32); }
+    uint32_t readSyncsafe(const uint8_t *p) { return (uint32_t(p[0]) << 21) | (uint32_t(p[1]) << 14) | (uint32_t(p[2]) << 7) | p[3]; }
+    bool isSyncsafe(const uint8_t *p) { return ((p[0] | p[1] | p[2] | p[3]) & 0x80) == 0; }
+
+    void appendUtf8(std::string &out, uint32_t cp)
+    {
+        if (cp < 0x80)
+        {
+            out += static_cast<char>(cp);
+        }
+        else if (cp < 0x800)
+        {
+            out += static_cast<char>(0xC0 | (cp >> 6));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+        else if (cp < 0x10000)
+        {
+            out += static_cast<char>(0xE0 | (cp >> 12));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+        else
+        {
+            out += static_cast<char>(0xF0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
+
+    std::string latin1ToUtf8(const uint8_t *data, size_t length)
+    {
+        std::string out;
+        out.reserve(length);
+        for (size_t i = 0; i < length && data[i] != 0; ++i)
+            appendUtf8(out, data[i]);
+        return out;
+    }
+
+    std::string utf16ToUtf8(const uint8_t *data, size_t length, bool bigEndian)
+    {
+        std::string out;
+        out.reserve(length / 2);
+        for (size_t i = 0; i + 1 < length; i += 2)
+        {
+            uint32_t unit = bigEndian ? (data[i] << 8) | data[i + 1] : data[i] | (data[i + 1] << 8);
+            if (unit == 0)
+                break;
+            if (unit >= 0xD800 && unit < 0xDC00 && i + 3 < length)
+            {
+                uint32_t low = bigEndian ? (data[i + 2] << 8) | data[i + 3] : data[i + 2] | (data[i + 3] << 8);
+                if (low >= 0xDC00 && low < 0xE000)
+                {
+                    appendUtf8(out, 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00));
+                    i += 2;
+                    continue;
+                }
+            }
+            appendUtf8(out, unit);
+        }
+        return out;
+    }
+
+    // First value of an ID3v2 text field with the given encoding byte
+    std::string decodeId3Text(uint8_t encoding, const uint8_t *data, size_t length)
+    {
+        switch (encoding)
+        {
+        case 0:
+            return latin1ToUtf8(data, length);
+        case 1:
+            if (length >= 2 && data[0] == 0xFE && data[1] == 0xFF)
+                return utf16ToUtf8(data + 2, length - 2, true);
+            if (length >= 2 && data[0] == 0xFF && data[1] == 0xFE)
+                return utf16ToUtf8(data + 2, length - 2, false);
+            return utf16ToUtf8(data, length, false);
+        case 2:
+            return utf16ToUtf8(data, length, true);
+        default:
+            return std::string(reinterpret_cast<const char *>(data), strnlen(reinterpret_cast<const char *>(data), length));
+        }
+    }
+
+    unsigned int leadingNumber(const std::string &text)
+    {
+        unsigned int value = 0;
+        for (size_t i = 0; i < text.size() && i < 9 && std::isdigit(static_cast<unsigned char>(text[i])); ++i)
+            value = value * 10 + (text[i] - '0');
+        return value;
+    }
+
+    bool isNumber(const std::string &text)
+    {
+        return !text.empty() && text.size() < 4 &&
+               std::all_of(text.begin(), text.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); });
+    }
+
+    // "17", "(17)" and "(17)Rock" as ID3v1 genre references, like TagLib does
+    std::string resolveGenre(const std::string &genre)
+    {
+        std::string reference = genre;
+        if (genre.size() > 2 && genre[0] == '(')
+        {
+            size_t close = genre.find(')');
+            if (close == std::string::npos)
+                return genre;
+            if (close + 1 < genre.size())
+                return genre.substr(close + 1);
+            reference = genre.substr(1, close - 1);
+        }
+        if (reference == "RX")
+            return "Remix";
+        if (reference == "CR")
+            return "Cover";
+        if (!isNumber(reference))
+            return genre;
+
+        unsigned int index = leadingNumber(reference);
+        return index < id3v1GenreCount ? id3v1Genres[index] : std::string();
+    }
+
+    // Fill what the preferred tag left empty, as TagLib's tag unions do
+    void mergeMissing(NativeTags &into, const NativeTags &from)
+    {
+        if (into.title.empty())
+            into.title = from.title;
+        if (into.artist.empty())
+            into.artist = from.artist;
+        if (into.album.empty())
+            into.album = from.album;
+        if (into.comment.empty())
+            into.comment = from.comment;
+        if (into.genre.empty())
+            into.genre = from.genre;
+        if (into.year == 0)
+            into.year = from.year;
+        if (into.track == 0)
+            into.track = from.track;
+    }
+
+    // Reads the ID3v2 tag at offset, if any, and sets tagEnd past it. False for
+    // tags this reader does not handle.
+    bool readId3v2(BlockReader &reader, uint64_t offset, NativeTags &tags, uint64_t &tagEnd)
+    {
+        tagEnd = offset;
+        const uint8_t *header = reader.get(offset, 10);
+        if (!header || std::memcmp(header, "ID3", 3) != 0)
+            return true;
+
+        uint8_t major = header[3];
+        uint8_t flags = header[5];
+        if ((major != 3 && major != 4) || !isSyncsafe(header + 6) || (flags & 0x80))
+            return false; // ID3v2.2 or unsynchronised
+        uint64_t end = offset + 10 + readSyncsafe(header + 6);
+        tagEnd = end + ((major == 4 && (flags & 0x10)) ? 10 : 0);
+
+        uint64_t pos = offset + 10;
+        if (flags & 0x40)
+        {
+            const uint8_t *ext = reader.get(pos, 4);
+            if (!ext)
+                return false;
+            pos += major == 3 ? 4 + readBE32(ext) : readSyncsafe(ext);
+        }
+
+        bool plainComment = false; // found a COMM frame without a description
+        while (pos + 10 <= end)
+        {
+            const uint8_t *frame = reader.get(pos, 10);
+            if (!frame || frame[0] == 0)
+                break; // padding
+            char id[5] = {char(frame[0]), char(frame[1]), char(frame[2]), char(frame[3]), 0};
+            uint32_t frameSize = major == 4 ? readSyncsafe(frame + 4) : readBE32(frame + 4);
+            uint8_t formatFlags = frame[9];
+            uint64_t body = pos + 10;
+            pos = body + frameSize;
+            if (pos > end)
+                break;
+
+            bool isText = id[0] == 'T' && (!std::strcmp(id, "TIT2") || !std::strcmp(id, "TPE1") || !std::strcmp(id, "TALB") ||
+                                           !std::strcmp(id, "TCON") || !std::strcmp(id, "TRCK") || !std::strcmp(id, "TYER") ||
+                                           !std::strcmp(id, "TDRC"));
+            bool isComment = !std::strcmp(id, "COMM");
+            if ((!isText && !isComment) || frameSize < 1)
+                continue;
+
+            // Compressed, encrypted, grouped or unsynchronised frames are left to TagLib
+            if ((major == 3 && (formatFlags & 0xE0)) || (major == 4 && (formatFlags & 0x4E)))
+                return false;
+            if (major == 4 && (formatFlags & 0x01))
+            {
+                if (frameSize < 5)
+                    continue;
+                body += 4; // data length indicator
+                frameSize -= 4;
+            }
+
+            size_t length = std::min<size_t>(frameSize, maxFrameSize);
+            const uint8_t *data = reader.get(body, length);
+            if (!data)
+                return false;
+            uint8_t encoding = data[0];
+
+            if (isComment)
+            {
+                if (length < 4)
+                    continue;
+                // Language, then a description terminated by a (wide) null
+                size_t textStart = 4;
+                bool wide = encoding == 1 || encoding == 2;
+                bool emptyDescription = wide ? (length >= 6 && data[4] == 0 && data[5] == 0) : data[4] == 0;
+                if (wide)
+                {
+                    while (textStart + 1 < length && (data[textStart] || data[textStart + 1]))
+                        textStart += 2;
+                    textStart += 2;
+                }
+                else
+                {
+                    while (textStart < length && data[textStart])
+                        textStart++;
+                    textStart++;
+                }
+                if (textStart > length || plainComment || (!emptyDescription && !tags.comment.empty()))
+                    continue;
+                tags.comment = decodeId3Text(encoding, data + textStart, length - textStart);
+                plainComment = emptyDescription;
+                continue;
+            }
+
+            std::string text = decodeId3Text(encoding, data + 1, length - 1);
+            if (!std::strcmp(id, "TIT2") && tags.title.empty())
+                tags.title = text;
+            else if (!std::strcmp(id, "TPE1") && tags.artist.empty())
+                tags.artist = text;
+            else if (!std::strcmp(id, "TALB") && tags.album.empty())
+                tags.album = text;
+            else if (!std::strcmp(id, "TCON") && tags.genre.empty())
+                tags.genre = resolveGenre(text);
+            else if (!std::strcmp(id, "TRCK") && tags.track == 0)
+                tags.track = leadingNumber(text);
+            else if ((!std::strcmp(id, "TYER") || !std::strcmp(id, "TDRC")) && tags.year == 0)
+                tags.year = leadingNumber(text.substr(0, 4));
+        }
+        return true;
+    }
+
+    std::string id3v1Field(const uint8_t *data, size_t length)
+    {
+        std::string text = latin1ToUtf8(data, length);
+        while (!text.empty() && text.back() == ' ')
+            text.pop_back();
+        return text;
+    }
+
+    bool readId3v1(BlockReader &reader, NativeTags &tags)
+    {
+        if (reader.size() < 128)
+            return false;
+        const uint8_t *tag = reader.get(reader.size() - 128, 128);
+        if (!tag || std::memcmp(tag, "TAG", 3) != 0)
+            return false;
+
+        tags.title = id3v1Field(tag + 3, 30);
+        tags.artist = id3v1Field(tag + 33, 30);
+        tags.album = id3v1Field(tag + 63, 30);
+        tags.year = leadingNumber(std::string(reinterpret_cast<const char *>(tag + 93), 4));
+        // ID3v1.1 keeps the track in the last comment byte
+        if (tag[125] == 0 && tag[126] != 0)
+        {
+            tags.comment = id3v1Field(tag + 97, 28);
+            tags.track = tag[126];
+        }
+        else
+        {
+            tags.comment = id3v1Field(tag + 97, 30);
+        }
+        if (tag[127] < id3v1GenreCount)
+            tags.genre = id3v1Genres[tag[127]];
+        return true;
+    }
+
+    struct MpegHeader
+    {
+        int bitrate;    // kbps
+        int sampleRate; // Hz
+        int channels;
+        int samplesPerFrame;
+        size_t frameLength;
+        size_t xingOffset; // from the frame start
+    };
+
+    bool parseMpegHeader(const uint8_t *h, MpegHeader &header)
+    {
+        static const int bitrates[2][3][15] = {
+            {{0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448},
+             {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},
+             {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320}},
+            {{0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256},
+             {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},
+             {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160}}};
+        static const int sampleRates[3][3] = {{44100, 48000, 32000}, {22050, 24000, 16000}, {11025, 12000, 8000}};
+
+        if (h[0] != 0xFF || (h[1] & 0xE0) != 0xE0)
+            return false;
+        int versionBits = (h[1] >> 3) & 3; // 0: 2.5, 2: 2, 3: 1
+        int layerBits = (h[1] >> 1) & 3;   // 1: III, 2: II, 3: I
+        int bitrateIndex = h[2] >> 4;
+        int rateIndex = (h[2] >> 2) & 3;
+        if (versionBits == 1 || layerBits == 0 || bitrateIndex == 0 || bitrateIndex == 15 || rateIndex == 3)
+            return false;
+
+        int version = versionBits == 3 ? 0 : versionBits == 2 ? 1 : 2;
+        int layer = 3 - layerBits; // 0: I, 1: II, 2: III
+        bool mono = (h[3] >> 6) == 3;
+        int padding = (h[2] >> 1) & 1;
+
+        header.bitrate = bitrates[version == 0 ? 0 : 1][layer][bitrateIndex];
+        header.sampleRate = sampleRates[version][rateIndex];
+        header.channels = mono ? 1 : 2;
+        header.samplesPerFrame = layer == 0 ? 384 : (layer == 2 && version != 0) ? 576 : 1152;
+        if (layer == 0)
+            header.frameLength = (12 * header.bitrate * 1000 / header.sampleRate + padding) * 4;
+        else
+            header.frameLength = header.samplesPerFrame / 8 * header.bitrate * 1000 / header.sampleRate + padding;
+        header.xingOffset = 4 + (version == 0 ? (mono ? 17 : 32) : (mono ? 9 : 17));
+        return header.frameLength > 4;
+    }
+
+    bool readMpegProperties(BlockReader &reader, uint64_t audioStart, uint64_t audioEnd, uint64_t syncWindow, NativeTags &tags)
+    {
+        // The first frame, confirmed by the one after it
+        uint64_t limit = std::min(audioEnd, audioStart + syncWindow + 3);
+        MpegHeader header;
+        uint64_t frameStart = 0;
+        bool found = false;
+        for (uint64_t pos = audioStart; pos + 4 <= limit && !found; ++pos)
+        {
+            const uint8_t *h = reader.get(pos, 4);
+            if (!h)
+                return false;
+            if (h[0] != 0xFF || !parseMpegHeader(h, header))
+                continue;
+
+            MpegHeader next;
+            const uint8_t *n = reader.get(pos + header.frameLength, 4);
+            if (pos + header.frameLength + 4 > audioEnd || (n && parseMpegHeader(n, next) && next.sampleRate == header.sampleRate))
+            {
+                frameStart = pos;
+                found = true;
+            }
+        }
+        if (!found)
+            return false;
+
+        tags.sampleRate = header.sampleRate;
+        tags.channels = header.channels;
+        tags.bitrate = header.bitrate;
+
+        // VBR files carry the frame count in a Xing/Info or VBRI header
+        uint32_t frames = 0;
+        uint32_t bytes = 0;
+        const uint8_t *xing = reader.get(frameStart + header.xingOffset, 16);
+        if (xing && (!std::memcmp(xing, "Xing", 4) || !std::memcmp(xing, "Info", 4)))
+        {
+            uint32_t flags = readBE32(xing + 4);
+            if (flags & 1)
+                frames = readBE32(xing + 8);
+            if ((flags & 3) == 3)
+                bytes = readBE32(xing + 12);
+        }
+        else
+        {
+            const uint8_t *vbri = reader.get(frameStart + 36, 18);
+            if (vbri && !std::memcmp(vbri, "VBRI", 4))
+            {
+                bytes = readBE32(vbri + 10);
+                frames = readBE32(vbri + 14);
+            }
+        }
+
+        if (frames > 0)
+        {
+            double length = double(frames) * header.samplesPerFrame / header.sampleRate;
+            tags.duration = static_cast<int>(length);
+            if (bytes > 0 && length > 0)
+                tags.bitrate = static_cast<int>(bytes * 8.0 / length / 1000.0 + 0.5);
+        }
+        else
+        {
+            uint64_t streamLength = audioEnd - frameStart;
+            tags.duration = static_cast<int>(streamLength * 8 / (uint64_t(header.bitrate) * 1000));
+        }
+        return true;
+    }
+
+    // Vorbis comment list, shared by FLAC and Ogg Vorbis
+    bool parseVorbisComment(const uint8_t *data, size_t length, NativeTags &tags)
+    {
+        if (length < 8)
+            return false;
+        uint64_t pos = 4 + uint64_t(readLE32(data));
+        if (pos + 4 > length)
+            return false;
+        uint32_t count = readLE32(data + pos);
+        pos += 4;
+
+        for (uint32_t i = 0; i < count && pos + 4 <= length; ++i)
+        {
+            uint32_t entryLength = readLE32(data + pos);
+            pos += 4;
+            if (pos + entryLength > length)
+                return false;
+            const char *entry = reinterpret_cast<const char *>(data + pos);
+            pos += entryLength;
+
+            const char *equals = static_cast<const char *>(std::memchr(entry, '=', entryLength));
+            if (!equals)
+                continue;
+            std::string key(entry, equals);
+            std::string value(equals + 1, entry + entryLength);
+            std::transform(key.begin(), key.end(), key.begin(), [](char c) { return std::toupper(static_cast<unsigned char>(c)); });
+
+            if (key == "TITLE" && tags.title.empty())
+                tags.title = value;
+            else if (key == "ARTIST" && tags.artist.empty())
+                tags.artist = value;
+            else if (key == "ALBUM" && tags.album.empty())
+                tags.album = value;
+            else if ((key == "COMMENT" || key == "DESCRIPTION") && tags.comment.empty())
+                tags.comment = value;
+            else if (key == "GENRE" && tags.genre.empty())
+                tags.genre = value;
+            else if (key == "DATE" && tags.year == 0)
+                tags.year = leadingNumber(value.substr(0, 4));
+            else if (key == "TRACKNUMBER" && tags.track == 0)
+                tags.track = leadingNumber(value);
+        }
+        return true;
+    }
+
+    bool readFlac(BlockReader &reader, uint64_t offset, NativeTags &tags)
+    {
+        uint64_t pos = offset + 4;
+        uint64_t totalSamples = 0;
+        bool haveStreamInfo = false;
+
+        while (true)
+        {
+            const uint8_t *blockHeader = reader.get(pos, 4);
+            if (!blockHeader)
+                return false;
+            bool last = blockHeader[0] & 0x80;
+            int type = blockHeader[0] & 0x7F;
+            uint32_t length = readBE24(blockHeader + 1);
+            uint64_t body = pos + 4;
+            pos = body + length;
+            if (pos > reader.size())
+                return false;
+
+            if (type == 0 && length >= 34)
+            {
+                const uint8_t *info = reader.get(body, 34);
+                if (!info)
+                    return false;
+                tags.sampleRate = (info[10] << 12) | (info[11] << 4) | (info[12] >> 4);
+                tags.channels = ((info[12] >> 1) & 7) + 1;
+                totalSamples = (uint64_t(info[13] & 0x0F) << 32) | readBE32(info + 14);
+                haveStreamInfo = true;
+            }
+            else if (type == 4)
+            {
+                if (length > maxCommentSize)
+                    return false;
+                const uint8_t *comment = reader.get(body, length);
+                if (!comment || !parseVorbisComment(comment, length, tags))
+                    return false;
+            }
+            if (last)
+                break;
+        }
+
+        if (!haveStreamInfo || tags.sampleRate == 0)
+            return false;
+        if (totalSamples > 0)
+        {
+            double lengthMs = totalSamples * 1000.0 / tags.sampleRate;
+            tags.duration = static_cast<int>(lengthMs / 1000);
+            tags.bitrate = static_cast<int>((reader.size() - pos) * 8.0 / lengthMs + 0.5);
+        }
+        return true;
+    }
+
+    bool readOgg(BlockReader &reader, NativeTags &tags)
+    {
+        std::vector<uint8_t> packets[2];
+        uint32_t serial;
+        if (!readOggHeaderPackets(reader, packets, 2, maxCommentSize, serial))
+            return false;
+
+        const std::vector<uint8_t> &ident = packets[0];
+        const std::vector<uint8_t> &comment = packets[1];
+        if (ident.size() < 30 || std::memcmp(ident.data(), "\x01vorbis", 7) != 0 ||
+            comment.size() < 7 || std::memcmp(comment.data(), "\x03vorbis", 7) != 0)
+            return false; // Opus, FLAC in Ogg, ...
+
+        tags.channels = ident[11];
+        tags.sampleRate = static_cast<int>(readLE32(ident.data() + 12));
+        int32_t nominalBitrate = static_cast<int32_t>(readLE32(ident.data() + 20));
+        if (tags.sampleRate == 0 || !parseVorbisComment(comment.data() + 7, comment.size() - 7, tags))
+            return false;
+
+        // Length from the granule position of the last page
+        uint64_t lastGranule = 0;
+        for (size_t tail : {size_t(8 * 1024), size_t(66 * 1024)})
+        {
+            size_t length = static_cast<size_t>(std::min<uint64_t>(tail, reader.size()));
+            const uint8_t *data = reader.get(reader.size() - length, length);
+            if (!data)
+                return false;
+            for (size_t i = length >= 27 ? length - 27 + 1 : 0; i-- > 0;)
+            {
+                if (data[i] == 'O' && !std::memcmp(data + i, "OggS", 4) && readLE32(data + i + 14) == serial)
+                {
+                    uint64_t granule = readLE64(data + i + 6);
+                    if (granule != UINT64_MAX)
+                    {
+                        lastGranule = granule;
+                        break;
+                    }
+                }
+            }
+            if (lastGranule > 0 || length == reader.size())
+                break;
+        }
+
+        if (lastGranule > 0)
+        {
+            double lengthMs = lastGranule * 1000.0 / tags.sampleRate;
+            tags.duration = static_cast<int>(lengthMs / 1000);
+            tags.bitrate = static_cast<int>(reader.size() * 8.0 / lengthMs + 0.5);
+        }
+        else if (nominalBitrate > 0)
+        {
+            tags.bitrate = static_cast<int>(nominalBitrate / 1000.0 + 0.5);
+        }
+        return true;
+    }
+}
+
+bool readNativeTags(const std::string &filepath, NativeTags &tags)
+{
+    BlockReader reader(filepath);
+    if (!reader.isOpen())
+        return false;
+
+    tags = NativeTags();
+    const uint8_t *head = reader.get(0, std::min<uint64_t>(reader.size(), 4));
+    if (!head || reader.size() < 4)
+        return false;
+
+    if (!std::memcmp(head, "OggS", 4))
+        return readOgg(reader, tags);
+
+    uint64_t tagEnd;
+    NativeTags id3v2;
+    if (!readId3v2(reader, 0, id3v2, tagEnd))
+        return false;
+
+    NativeTags id3v1;
+    bool hasId3v1 = readId3v1(reader, id3v1);
+
+    const uint8_t *magic = reader.get(tagEnd, 4);
+    if (magic && !std::memcmp(magic, "fLaC", 4))
+    {
+        // Vorbis comments take precedence over ID3 tags in FLAC files
+        if (!readFlac(reader, tagEnd, tags))
+            return false;
+        mergeMissing(tags, id3v2);
+        mergeMissing(tags, id3v1);
+        return true;
+    }
+
+    // Anything else must be MPEG audio: right at the start of an untagged file, so
+    // other formats are not mistaken for it, or shortly after the ID3v2 tag
+    uint64_t audioEnd = reader.size() - (hasId3v1 ? 128 : 0);
+    uint64_t syncWindow = tagEnd > 0 ? mpegSyncWindow : 1;
+    if (tagEnd >= audioEnd || !readMpegProperties(reader, tagEnd, audioEnd, syncWindow, tags))
+        return false;
+    mergeMissing(tags, id3v2);
+    mergeMissing(tags, id3v1);
+    return true;
+}
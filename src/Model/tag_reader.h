@@ -0,0 +1,32 @@
+#ifndef TAG_READER_H
+#define TAG_READER_H
+
+#include <string>
+
+// Tags and audio properties, as MetadataManager stores them
+struct NativeTags
+{
+    std::string title;
+    std::string artist;
+    std::string album;
+    std::string comment;
+    std::string genre;
+    unsigned int year = 0;
+    unsigned int track = 0;
+    int duration = 0; // in seconds
+    int bitrate = 0;  // kbps
+    int channels = 0;
+    int sampleRate = 0; // Hz
+};
+
+// Lightweight reader for the common formats, without building TagLib file objects:
+//   MP3: ID3v2.3/2.4 frames, ID3v1, first MPEG frame (Xing/VBRI or CBR for the length)
+//   FLAC: STREAMINFO and VORBIS_COMMENT blocks
+//   Ogg Vorbis: identification and comment headers, last page for the length
+// Only the head of the file and a few KB of its tail are read with pread; pictures
+// and other large frames are skipped without being read. Returns false for other
+// formats and for anything unusual (ID3v2.2, unsynchronised or compressed frames,
+// no MPEG frame near the tag, ...), callers then fall back to TagLib.
+bool readNativeTags(const std::string &filepath, NativeTags &tags);
+
+#endif // TAG_READER_H
@@ -0,0 +1,525 @@
+#include "tag_writer.h"
+#include "binary_io.h"
+
+#include <vector>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    const size_t copyChunkSize = 1024 * 1024;
+
+    uint32_t readBE32(const uint8_t *p) { return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3]; }
+    uint32_t readLE32(const uint8_t *p) { return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24); }
+    uint32_t readSyncsafe(const uint8_t *p) { return (uint32_t(p[0]) << 21) | (uint32_t(p[1]) << 14) | (uint32_t(p[2]) << 7) | p[3]; }
+
+    void putBE32(std::string &out, uint32_t v)
+    {
+        out += char(v >> 24);
+        out += char(v >> 16);
+        out += char(v >> 8);
+        out += char(v);
+    }
+    void putBE24(std::string &out, uint32_t v)
+    {
+        out += char(v >> 16);
+        out += char(v >> 8);
+        out += char(v);
+    }
+    void putLE32(std::string &out, uint32_t v)
+    {
+        out += char(v);
+        out += char(v >> 8);
+        out += char(v >> 16);
+        out += char(v >> 24);
+    }
+    void putSyncsafe(std::string &out, uint32_t v)
+    {
+        out += char((v >> 21) & 0x7F);
+        out += char((v >> 14) & 0x7F);
+        out += char((v >> 7) & 0x7F);
+        out += char(v & 0x7F);
+    }
+
+    bool readRange(const std::string &path, uint64_t offset, size_t length, std::string &out)
+    {
+        std::ifstream in(fs::u8path(path), std::ios::binary);
+        if (!in.is_open())
+            return false;
+        out.resize(length);
+        in.seekg(static_cast<std::streamoff>(offset));
+        in.read(&out[0], length);
+        return static_cast<size_t>(in.gcount()) == length;
+    }
+
+    // Overwrite only the span where the new header region differs from the old one
+    bool overwriteChanged(const std::string &path, uint64_t offset, const std::string &before, const std::string &after,
+                          TagWriteStats &stats)
+    {
+        size_t first = 0;
+        while (first < after.size() && before[first] == after[first])
+            first++;
+        if (first == after.size())
+            return true;
+        size_t last = after.size();
+        while (last > first && before[last - 1] == after[last - 1])
+            last--;
+
+        {
+            std::fstream file(fs::u8path(path), std::ios::in | std::ios::out | std::ios::binary);
+            if (!file.is_open())
+            {
+                std::cerr << "Failed to open " << path << " for writing tags\n";
+                return false;
+            }
+            file.seekp(static_cast<std::streamoff>(offset + first));
+            file.write(after.data() + first, last - first);
+            if (!file.flush())
+            {
+                std::cerr << "Failed to write tags to " << path << "\n";
+                return false;
+            }
+        }
+        syncFile(path);
+        stats.bytesWritten = last - first;
+        return true;
+    }
+
+    // New header followed by the file from audioOffset on, written to a copy that replaces the file
+    bool rewriteFile(const std::string &path, const std::string &header, uint64_t audioOffset, TagWriteStats &stats)
+    {
+        std::string tmpPath = path + ".tagtmp";
+        uint64_t written = header.size();
+        {
+            std::ifstream in(fs::u8path(path), std::ios::binary);
+            std::ofstream out(fs::u8path(tmpPath), std::ios::binary | std::ios::trunc);
+            if (!in.is_open() || !out.is_open())
+            {
+                std::cerr << "Failed to open " << tmpPath << " for writing\n";
+                return false;
+            }
+            out.write(header.data(), header.size());
+            in.seekg(static_cast<std::streamoff>(audioOffset));
+            std::vector<char> buffer(copyChunkSize);
+            while (in)
+            {
+                in.read(buffer.data(), buffer.size());
+                out.write(buffer.data(), in.gcount());
+                written += in.gcount();
+            }
+            if (!out.flush())
+            {
+                std::cerr << "Failed to write " << tmpPath << "\n";
+                out.close();
+                std::error_code ec;
+                fs::remove(fs::u8path(tmpPath), ec);
+                return false;
+            }
+        }
+
+        std::error_code ec;
+        fs::permissions(fs::u8path(tmpPath), fs::status(fs::u8path(path), ec).permissions(), ec);
+        syncFile(tmpPath);
+        fs::rename(fs::u8path(tmpPath), fs::u8path(path), ec);
+        if (ec)
+        {
+            std::cerr << "Failed to replace " << path << ": " << ec.message() << "\n";
+            fs::remove(fs::u8path(tmpPath), ec);
+            return false;
+        }
+        stats.bytesWritten = written;
+        stats.rewroteFile = true;
+        return true;
+    }
+
+    // Code points of a UTF-8 string; invalid bytes are taken as Latin-1
+    std::vector<uint32_t> decodeUtf8(const std::string &text)
+    {
+        std::vector<uint32_t> codePoints;
+        for (size_t i = 0; i < text.size();)
+        {
+            uint8_t c = text[i];
+            int extra = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : 0;
+            uint32_t cp = extra == 0 ? c : c & (0x3F >> extra);
+            bool valid = i + extra < text.size();
+            for (int k = 1; valid && k <= extra; ++k)
+            {
+                uint8_t next = text[i + k];
+                valid = (next & 0xC0) == 0x80;
+                cp = (cp << 6) | (next & 0x3F);
+            }
+            if (!valid || (extra == 0 && c >= 0x80))
+            {
+                cp = c;
+                extra = 0;
+            }
+            codePoints.push_back(cp);
+            i += extra + 1;
+        }
+        return codePoints;
+    }
+
+    // Encoding byte and text of an ID3v2 frame: UTF-8 in v2.4; Latin-1 or UTF-16 in v2.3
+    std::string encodeId3Text(const std::string &text, int major, bool withDescription)
+    {
+        std::string out;
+        if (major == 4)
+        {
+            out += '\x03';
+            if (withDescription)
+                out += std::string("eng") + '\0';
+            return out + text;
+        }
+
+        std::vector<uint32_t> codePoints = decodeUtf8(text);
+        bool latin1 = std::all_of(codePoints.begin(), codePoints.end(), [](uint32_t cp) { return cp < 0x100; });
+        if (latin1)
+        {
+            out += '\0';
+            if (withDescription)
+                out += std::string("eng") + '\0';
+            for (uint32_t cp : codePoints)
+                out += char(cp);
+            return out;
+        }
+
+        auto putUnit = [&out](uint32_t unit)
+        {
+            out += char(unit & 0xFF);
+            out += char(unit >> 8);
+        };
+        out += '\x01';
+        if (withDescription)
+        {
+            out += "eng";
+            out += "\xFF\xFE";
+            putUnit(0);
+        }
+        out += "\xFF\xFE";
+        for (uint32_t cp : codePoints)
+        {
+            if (cp >= 0x10000)
+            {
+                putUnit(0xD800 + ((cp - 0x10000) >> 10));
+                putUnit(0xDC00 + ((cp - 0x10000) & 0x3FF));
+            }
+            else
+            {
+                putUnit(cp);
+            }
+        }
+        return out;
+    }
+
+    std::string id3Frame(const char *id, const std::string &body, int major)
+    {
+        std::string frame(id, 4);
+        if (major == 4)
+            putSyncsafe(frame, static_cast<uint32_t>(body.size()));
+        else
+            putBE32(frame, static_cast<uint32_t>(body.size()));
+        frame += std::string(2, '\0');
+        return frame + body;
+    }
+
+    bool emptyCommentDescription(const std::string &body)
+    {
+        if (body.size() < 5)
+            return true;
+        uint8_t encoding = body[0];
+        if (encoding == 1 || encoding == 2)
+        {
+            size_t pos = 4;
+            if (body.size() >= 6 && ((uint8_t(body[4]) == 0xFF && uint8_t(body[5]) == 0xFE) ||
+                                     (uint8_t(body[4]) == 0xFE && uint8_t(body[5]) == 0xFF)))
+                pos = 6;
+            return body.size() < pos + 2 || (body[pos] == 0 && body[pos + 1] == 0);
+        }
+        return body[4] == 0;
+    }
+
+    struct Id3Edit
+    {
+        const char *id;
+        std::string body;
+        bool done = false;
+    };
+
+    std::vector<Id3Edit> id3Edits(const NativeTags &edit, int major)
+    {
+        std::vector<Id3Edit> edits;
+        auto text = [&](const char *id, const std::string &value)
+        {
+            if (!value.empty())
+                edits.push_back({id, encodeId3Text(value, major, false)});
+        };
+        text("TIT2", edit.title);
+        text("TPE1", edit.artist);
+        text("TALB", edit.album);
+        text("TCON", edit.genre);
+        if (edit.year != 0)
+            text(major == 4 ? "TDRC" : "TYER", std::to_string(edit.year));
+        if (edit.track != 0)
+            text("TRCK", std::to_string(edit.track));
+        if (!edit.comment.empty())
+            edits.push_back({"COMM", encodeId3Text(edit.comment, major, true)});
+        return edits;
+    }
+
+    TagWriteResult writeId3v2(const std::string &path, const std::string &head, const NativeTags &edit, size_t padding,
+                              TagWriteStats &stats)
+    {
+        const uint8_t *header = reinterpret_cast<const uint8_t *>(head.data());
+        bool tagged = !std::memcmp(header, "ID3", 3);
+        int major = tagged ? header[3] : 4;
+        if (tagged && ((major != 3 && major != 4) || (header[5] & 0xD0)))
+            return TagWriteResult::UNSUPPORTED; // ID3v2.2, unsynchronisation, extended header or footer
+
+        uint32_t tagSize = tagged ? readSyncsafe(header + 6) : 0;
+        std::string oldTag;
+        if (tagged && !readRange(path, 10, tagSize, oldTag))
+            return TagWriteResult::FAILED;
+
+        // Frames in their original order, the edited ones replaced where they were
+        std::vector<Id3Edit> edits = id3Edits(edit, major);
+        std::string frames;
+        bool plainCommentSeen = false;
+        size_t pos = 0;
+        while (pos + 10 <= oldTag.size() && oldTag[pos] != 0)
+        {
+            const uint8_t *frame = reinterpret_cast<const uint8_t *>(oldTag.data() + pos);
+            uint32_t size = major == 4 ? readSyncsafe(frame + 4) : readBE32(frame + 4);
+            if (pos + 10 + size > oldTag.size())
+                break;
+            std::string id(oldTag, pos, 4);
+            std::string raw(oldTag, pos, 10 + size);
+            pos += 10 + size;
+
+            bool replaced = false;
+            for (auto &e : edits)
+            {
+                if (id != e.id)
+                    continue;
+                if (id == "COMM")
+                {
+                    // Only the comment without a description is the one shown as "Comment"
+                    if (plainCommentSeen || !emptyCommentDescription(raw.substr(10)))
+                        break;
+                    plainCommentSeen = true;
+                }
+                if (!e.done)
+                    frames += id3Frame(e.id, e.body, major);
+                e.done = true;
+                replaced = true;
+                break;
+            }
+            if (!replaced)
+                frames += raw;
+        }
+        for (const auto &e : edits)
+        {
+            if (!e.done)
+                frames += id3Frame(e.id, e.body, major);
+        }
+
+        if (tagged && frames.size() <= tagSize)
+        {
+            std::string newTag = frames + std::string(tagSize - frames.size(), '\0');
+            return overwriteChanged(path, 10, oldTag, newTag, stats) ? TagWriteResult::WRITTEN : TagWriteResult::FAILED;
+        }
+
+        std::string newHeader = "ID3";
+        newHeader += char(major);
+        newHeader += std::string(2, '\0');
+        putSyncsafe(newHeader, static_cast<uint32_t>(frames.size() + padding));
+        newHeader += frames + std::string(padding, '\0');
+        return rewriteFile(path, newHeader, tagged ? 10 + tagSize : 0, stats) ? TagWriteResult::WRITTEN : TagWriteResult::FAILED;
+    }
+
+    bool sameKey(const std::string &entry, const char *key)
+    {
+        size_t length = std::strlen(key);
+        if (entry.size() <= length || entry[length] != '=')
+            return false;
+        for (size_t i = 0; i < length; ++i)
+        {
+            if (std::toupper(static_cast<unsigned char>(entry[i])) != key[i])
+                return false;
+        }
+        return true;
+    }
+
+    // Vorbis comment block with the edited fields replaced, other entries kept
+    bool rebuildVorbisComment(const std::string &block, const NativeTags &edit, std::string &out)
+    {
+        std::string vendor = "MediaPlayer";
+        std::vector<std::string> entries;
+        if (!block.empty())
+        {
+            const uint8_t *data = reinterpret_cast<const uint8_t *>(block.data());
+            if (block.size() < 8)
+                return false;
+            uint64_t pos = 4 + uint64_t(readLE32(data));
+            if (pos + 4 > block.size())
+                return false;
+            vendor.assign(block, 4, pos - 4);
+            uint32_t count = readLE32(data + pos);
+            pos += 4;
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                if (pos + 4 > block.size())
+                    return false;
+                uint32_t length = readLE32(data + pos);
+                pos += 4;
+                if (pos + length > block.size())
+                    return false;
+                entries.emplace_back(block, pos, length);
+                pos += length;
+            }
+        }
+
+        auto set = [&entries](const char *key, const std::string &value, const char *alias = nullptr)
+        {
+            if (value.empty())
+                return;
+            entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                         [&](const std::string &entry)
+                                         { return sameKey(entry, key) || (alias && sameKey(entry, alias)); }),
+                          entries.end());
+            entries.push_back(std::string(key) + "=" + value);
+        };
+        set("TITLE", edit.title);
+        set("ARTIST", edit.artist);
+        set("ALBUM", edit.album);
+        set("COMMENT", edit.comment, "DESCRIPTION");
+        set("GENRE", edit.genre);
+        set("DATE", edit.year ? std::to_string(edit.year) : std::string());
+        set("TRACKNUMBER", edit.track ? std::to_string(edit.track) : std::string());
+
+        out.clear();
+        putLE32(out, static_cast<uint32_t>(vendor.size()));
+        out += vendor;
+        putLE32(out, static_cast<uint32_t>(entries.size()));
+        for (const auto &entry : entries)
+        {
+            putLE32(out, static_cast<uint32_t>(entry.size()));
+            out += entry;
+        }
+        return true;
+    }
+
+    TagWriteResult writeFlac(const std::string &path, const NativeTags &edit, size_t padding, TagWriteStats &stats)
+    {
+        // Walk the block headers to find where the audio starts
+        std::ifstream in(fs::u8path(path), std::ios::binary);
+        if (!in.is_open())
+            return TagWriteResult::FAILED;
+        uint64_t pos = 4;
+        while (true)
+        {
+            uint8_t blockHeader[4];
+            in.seekg(static_cast<std::streamoff>(pos));
+            if (!in.read(reinterpret_cast<char *>(blockHeader), 4))
+                return TagWriteResult::UNSUPPORTED;
+            pos += 4 + ((uint32_t(blockHeader[1]) << 16) | (uint32_t(blockHeader[2]) << 8) | blockHeader[3]);
+            if (blockHeader[0] & 0x80)
+                break;
+        }
+        in.close();
+
+        std::string region;
+        if (!readRange(path, 4, pos - 4, region))
+            return TagWriteResult::UNSUPPORTED;
+
+        // Blocks in their original order without padding, the comment replaced
+        std::vector<std::pair<uint8_t, std::string>> blocks;
+        bool hasComment = false;
+        for (size_t offset = 0; offset + 4 <= region.size();)
+        {
+            const uint8_t *h = reinterpret_cast<const uint8_t *>(region.data() + offset);
+            uint8_t type = h[0] & 0x7F;
+            uint32_t length = (uint32_t(h[1]) << 16) | (uint32_t(h[2]) << 8) | h[3];
+            std::string data(region, offset + 4, length);
+            offset += 4 + length;
+
+            if (type == 1)
+                continue;
+            if (type == 4)
+            {
+                if (hasComment || !rebuildVorbisComment(data, edit, data))
+                    return TagWriteResult::UNSUPPORTED;
+                hasComment = true;
+            }
+            blocks.emplace_back(type, std::move(data));
+        }
+        if (blocks.empty() || blocks.front().first != 0)
+            return TagWriteResult::UNSUPPORTED; // STREAMINFO must come first
+        if (!hasComment)
+        {
+            std::string comment;
+            rebuildVorbisComment(std::string(), edit, comment);
+            blocks.insert(blocks.begin() + 1, {uint8_t(4), comment});
+        }
+
+        size_t used = 0;
+        for (const auto &block : blocks)
+        {
+            if (block.second.size() > 0xFFFFFF)
+                return TagWriteResult::UNSUPPORTED;
+            used += 4 + block.second.size();
+        }
+
+        // A padding block needs at least its 4 header bytes, so a gap of 1-3 bytes cannot be filled
+        bool fits = used <= region.size() && (used == region.size() || region.size() - used >= 4);
+        size_t paddingLength = fits ? (used == region.size() ? 0 : region.size() - used - 4) : padding;
+        bool withPadding = !fits || used != region.size();
+        if (withPadding)
+            blocks.emplace_back(uint8_t(1), std::string(paddingLength, '\0'));
+
+        std::string newRegion;
+        for (size_t i = 0; i < blocks.size(); ++i)
+        {
+            newRegion += char(blocks[i].first | (i + 1 == blocks.size() ? 0x80 : 0));
+            putBE24(newRegion, static_cast<uint32_t>(blocks[i].second.size()));
+            newRegion += blocks[i].second;
+        }
+
+        bool written = fits ? overwriteChanged(path, 4, region, newRegion, stats)
+                            : rewriteFile(path, "fLaC" + newRegion, pos, stats);
+        return written ? TagWriteResult::WRITTEN : TagWriteResult::FAILED;
+    }
+}
+
+TagWriteResult writeNativeTags(const std::string &filepath, const NativeTags &edit, size_t padding, TagWriteStats &stats)
+{
+    stats = TagWriteStats();
+    stats.native = true;
+
+    std::string head;
+    if (!readRange(filepath, 0, 10, head))
+        return TagWriteResult::UNSUPPORTED;
+    const uint8_t *h = reinterpret_cast<const uint8_t *>(head.data());
+
+    if (!std::memcmp(h, "fLaC", 4))
+        return writeFlac(filepath, edit, padding, stats);
+    // MP3: an ID3v2 tag, or an MPEG frame at the start of an untagged file
+    if (!std::memcmp(h, "ID3", 3) || (h[0] == 0xFF && (h[1] & 0xE0) == 0xE0))
+    {
+        if (!std::memcmp(h, "ID3", 3))
+        {
+            // FLAC behind an ID3v2 tag is left to TagLib
+            std::string magic;
+            uint64_t end = 10 + uint64_t(readSyncsafe(h + 6));
+            if (readRange(filepath, end, 4, magic) && magic == "fLaC")
+                return TagWriteResult::UNSUPPORTED;
+        }
+        return writeId3v2(filepath, head, edit, padding, stats);
+    }
+    return TagWriteResult::UNSUPPORTED;
+}
@@ -0,0 +1,32 @@
+#ifndef TAG_WRITER_H
+#define TAG_WRITER_H
+
+#include "tag_reader.h"
+
+#include <string>
+#include <cstdint>
+
+// What a tag save cost on disk
+struct TagWriteStats
+{
+    uint64_t bytesWritten = 0; // 0 when TagLib saved in place (not measured)
+    bool rewroteFile = false;  // the tag did not fit and the whole file was written again
+    bool native = false;       // saved by writeNativeTags rather than TagLib
+};
+
+enum class TagWriteResult
+{
+    WRITTEN,
+    FAILED,
+    UNSUPPORTED // not an ID3v2/MP3 or FLAC file this writer handles, use TagLib
+};
+
+// Rewrites the ID3v2 tag of an MP3 or the VORBIS_COMMENT block of a FLAC file.
+// Only the text fields of edit that are set (non-empty, year and track non-zero)
+// are changed; other frames and comments are kept. When the new tag fits in the
+// space of the old one including its padding, only the bytes of the header region
+// that changed are overwritten. Otherwise the file is written again through a
+// temporary copy and a rename, reserving padding bytes for later edits.
+TagWriteResult writeNativeTags(const std::string &filepath, const NativeTags &edit, size_t padding, TagWriteStats &stats);
+
+#endif // TAG_WRITER_H
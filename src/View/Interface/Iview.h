@@ -4,9 +4,11 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
 
 class MediaFileModel;
 class PlaylistModel;
+struct Thumbnail;
 
 // Forward declarations
 
@@ -19,6 +21,13 @@ public:
     // virtual void initialize() = 0;
     // virtual void update() = 0;
     virtual void setCurrentPlaylist(const std::string &playlistName, const std::vector<std::string> &mediaFilesNames) = 0;
+    // Replace the listed files but keep the current page
+    virtual void refreshMediaFiles(const std::vector<std::string> &mediaFilesNames) = 0;
+    // Add files at the end of the list, used while a scan is still running
+    virtual void appendMediaFiles(const std::vector<std::string> &mediaFilesNames) = 0;
+    // Switch to a browse list of rowCount rows, read a page at a time from the
+    // controller; keepPage stays on the current page when the list is refreshed
+    virtual void showBrowseList(const std::string &title, size_t rowCount, bool keepPage) = 0;
 };
 
 // Playlists List view
@@ -57,6 +66,14 @@ class MetadataInterface
 public:
     // virtual void initialize() = 0;
     virtual void showMetadata(const std::map<std::string, std::string> &metadata) = 0;
+    // Progress of a tag write queued by the controller
+    virtual void showSavePending(const std::string &filename) = 0;
+    virtual void showSaveResult(const std::string &filename, bool success) = 0;
+    // Progress of a batch edit over several files
+    virtual void showBatchProgress(size_t done, size_t total) = 0;
+    virtual void showBatchResult(size_t fileCount, bool success) = 0;
+    // Cover art of the file on screen, nullptr when it has none
+    virtual void showCoverArt(std::shared_ptr<const Thumbnail> thumbnail) = 0;
     // virtual void saveMetadata() = 0;
     // virtual void update() = 0;
 };
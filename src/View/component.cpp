@@ -1,6 +1,7 @@
 #include "component.h"
 
 #include <iostream>
+#include <algorithm>
 
 // Base UI Component implementation
 UIComponent::UIComponent(int x, int y, int w, int h)
@@ -1016,6 +1017,8 @@ bool TextField::handleEvent(SDL_Event *event)
             {
                 text.erase(cursorPosition - 1, 1);
                 cursorPosition--;
+                if (onTextEdited)
+                    onTextEdited(text);
                 return true;
             }
             break;
@@ -1025,7 +1028,8 @@ bool TextField::handleEvent(SDL_Event *event)
             if (!text.empty() && cursorPosition < text.length())
             {
                 text.erase(cursorPosition, 1);
-
+                if (onTextEdited)
+                    onTextEdited(text);
                 return true;
             }
             break;
@@ -1086,6 +1090,8 @@ bool TextField::handleEvent(SDL_Event *event)
         // Insert text at cursor position
         text.insert(cursorPosition, event->text.text);
         cursorPosition += strlen(event->text.text);
+        if (onTextEdited)
+            onTextEdited(text);
         return true;
     }
     }
@@ -1109,6 +1115,11 @@ void TextField::setOnTextChanged(std::function<void(const std::string &)> callba
     onTextChanged = callback;
 }
 
+void TextField::setOnTextEdited(std::function<void(const std::string &)> callback)
+{
+    onTextEdited = callback;
+}
+
 void TextField::focus()
 {
     isFocused = true;
@@ -1377,4 +1388,89 @@ void Pagination::updateButtonStates()
 {
     prevButton->setEnabled(currentPage > 0);
     nextButton->setEnabled(currentPage < totalPages - 1);
-}
\ No newline at end of file
+}
+// TextureUploadBudget implementation
+size_t TextureUploadBudget::remaining = TextureUploadBudget::bytesPerFrame;
+bool TextureUploadBudget::uploaded = false;
+
+void TextureUploadBudget::beginFrame()
+{
+    remaining = bytesPerFrame;
+    uploaded = false;
+}
+
+bool TextureUploadBudget::take(size_t bytes)
+{
+    if (uploaded && bytes > remaining)
+        return false;
+    remaining -= std::min(bytes, remaining);
+    uploaded = true;
+    return true;
+}
+
+// ImageComponent implementation
+ImageComponent::ImageComponent(int x, int y, int w, int h)
+    : UIComponent(x, y, w, h), texture(nullptr) {}
+
+ImageComponent::~ImageComponent()
+{
+    releaseTexture();
+}
+
+void ImageComponent::releaseTexture()
+{
+    if (texture)
+    {
+        SDL_DestroyTexture(texture);
+        texture = nullptr;
+    }
+}
+
+void ImageComponent::setImage(std::shared_ptr<const Thumbnail> thumbnail)
+{
+    if (thumbnail == image)
+        return;
+    releaseTexture();
+    image = std::move(thumbnail);
+}
+
+void ImageComponent::render(SDL_Renderer *renderer)
+{
+    if (!visible || !image || image->width <= 0 || image->height <= 0)
+        return;
+
+    if (!texture)
+    {
+        // Over budget: drawn on a later frame
+        if (!TextureUploadBudget::take(image->pixels.size()))
+            return;
+        texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, image->width, image->height);
+        if (!texture)
+        {
+            std::cerr << "Failed to create texture: " << SDL_GetError() << std::endl;
+            image.reset();
+            return;
+        }
+        SDL_UpdateTexture(texture, nullptr, image->pixels.data(), image->width * 4);
+        SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+    }
+
+    // Fit into the bounds, centred
+    SDL_Rect dest = bounds;
+    if (image->width * bounds.h > image->height * bounds.w)
+    {
+        dest.h = image->height * bounds.w / image->width;
+        dest.y += (bounds.h - dest.h) / 2;
+    }
+    else
+    {
+        dest.w = image->width * bounds.h / image->height;
+        dest.x += (bounds.w - dest.w) / 2;
+    }
+    SDL_RenderCopy(renderer, texture, nullptr, &dest);
+}
+
+bool ImageComponent::handleEvent(SDL_Event *)
+{
+    return false; // Images don't handle events
+}
@@ -7,8 +7,11 @@
 
 #include <string>
 #include <vector>
+#include <memory>
 #include <functional>
 
+#include "Model/cover_art.h"
+
 const SDL_Color TEXT_COLOR = {220, 220, 220, 255};
 const SDL_Color BACKGROUND_COLOR = {25, 25, 25, 255};
 const SDL_Color PANEL_COLOR = {35, 35, 35, 255};
@@ -222,6 +225,7 @@ private:
     bool isFocused;
     int cursorPosition;
     std::function<void(const std::string &)> onTextChanged;
+    std::function<void(const std::string &)> onTextEdited;
 
 public:
     TextField(int x, int y, int w, int h, const std::string &initialText = "");
@@ -232,6 +236,8 @@ public:
     void setText(const std::string &newText);
     void setPlaceholder(const std::string &placeholderText);
     void setOnTextChanged(std::function<void(const std::string &)> callback);
+    // Called on every keystroke that changes the text, not only on Enter
+    void setOnTextEdited(std::function<void(const std::string &)> callback);
     void focus();
     void unfocus();
 };
@@ -262,4 +268,42 @@ public:
     void updateButtonStates();
 };
 
+// Limits the pixel data uploaded to textures in one frame, so a burst of newly
+// loaded pictures is spread over several frames instead of stalling one
+class TextureUploadBudget
+{
+private:
+    static size_t remaining;
+    static bool uploaded;
+
+public:
+    static constexpr size_t bytesPerFrame = 256 * 1024;
+
+    // Called once at the start of every frame
+    static void beginFrame();
+    // True when bytes may be uploaded now; the first upload of a frame is always allowed
+    static bool take(size_t bytes);
+};
+
+// Shows a Thumbnail scaled into its bounds, keeping its aspect ratio. The
+// texture is created on the first render the upload budget allows.
+class ImageComponent : public UIComponent
+{
+private:
+    std::shared_ptr<const Thumbnail> image;
+    SDL_Texture *texture;
+
+    void releaseTexture();
+
+public:
+    ImageComponent(int x, int y, int w, int h);
+    ~ImageComponent();
+
+    void render(SDL_Renderer *renderer) override;
+    bool handleEvent(SDL_Event *event) override;
+
+    // nullptr clears the image
+    void setImage(std::shared_ptr<const Thumbnail> thumbnail);
+};
+
 #endif
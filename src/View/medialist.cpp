@@ -8,7 +8,7 @@
 
 // MediaListView Implementation
 MediaListView::MediaListView(MediaListController *controller)
-    : controller(controller), itemsPerPage(25)
+    : controller(controller), itemsPerPage(25), browsing(false), browseRowCount(0)
 {
     viewBounds = {240, 20, 500, 500};
     // Create components
@@ -18,6 +18,13 @@ MediaListView::MediaListView(MediaListController *controller)
     titleLabel = new TextComponent(450, 25, 90, 15, "Media List");
     // Create scan directory button
     openFolderButton = new Button(25, 485, 190, 30, "Open Folder");
+    // Browse by artist, album, genre or year
+    browseButton = new Button(655, 20, 80, 25, "Browse");
+    backButton = new Button(245, 20, 60, 25, "Back");
+    // Structured query over the library, run on Enter
+    queryField = new TextField(245, 485, 130, 25);
+    // Searched on every keystroke
+    searchField = new TextField(605, 485, 130, 25);
 
 
     // Add components to view
@@ -25,10 +32,17 @@ MediaListView::MediaListView(MediaListController *controller)
     addComponent(pagination);
     addComponent(titleLabel);
     addComponent(openFolderButton);
+    addComponent(browseButton);
+    addComponent(backButton);
+    addComponent(queryField);
+    addComponent(searchField);
 
     titleLabel->setAlign(TextComponent::TextAlign::Center);
 
     pagination->setVisible(false);
+    backButton->setVisible(false);
+    queryField->setPlaceholder("Query");
+    searchField->setPlaceholder("Search");
 
     show();
 }
@@ -53,6 +67,14 @@ void MediaListView::setMediaListController(MediaListController *controller)
 
     openFolderButton->setOnClick([this]()
                                  { scanDirectoryForMedia(); });
+    browseButton->setOnClick([this]()
+                             { this->controller->nextBrowseMode(); });
+    backButton->setOnClick([this]()
+                           { this->controller->browseBack(); });
+    queryField->setOnTextChanged([this](const std::string &query)
+                                 { this->controller->runQuery(query); });
+    searchField->setOnTextEdited([this](const std::string &keyword)
+                                 { this->controller->searchAsYouType(keyword); });
 }
 
 void MediaListView::render(SDL_Renderer *renderer)
@@ -89,6 +111,8 @@ bool MediaListView::handleEvent(SDL_Event *event)
 
 void MediaListView::update()
 {
+    if (controller)
+        controller->pollLibraryChanges();
 }
 
 void MediaListView::scanDirectoryForMedia()
@@ -151,6 +175,7 @@ void MediaListView::scanDirectoryForMedia()
 
 void MediaListView::setCurrentPlaylist(const std::string &playlistName, const std::vector<std::string> &mediaFilesNames)
 {
+    leaveBrowseList();
     currentFilesName.clear();
     for (const auto &file : mediaFilesNames)
     {
@@ -174,19 +199,96 @@ void MediaListView::setCurrentPlaylist(const std::string &playlistName, const st
     // Update visibility of pagination
     pagination->setVisible(totalPages > 1);
 
+    if (controller)
+        controller->setViewport(0, itemsPerPage);
     update();
 }
 
+void MediaListView::refreshMediaFiles(const std::vector<std::string> &mediaFilesNames)
+{
+    leaveBrowseList();
+    currentFilesName = mediaFilesNames;
+
+    int totalFiles = currentFilesName.size();
+    int totalPages = (totalFiles + itemsPerPage - 1) / itemsPerPage;
+    int page = std::min(pagination->getCurrentPage(), std::max(totalPages - 1, 0));
+    pagination->setTotalPages(totalPages);
+    pagination->setCurrentPage(page);
+    pagination->setVisible(totalPages > 1);
+
+    setCurrentPage(page);
+}
+
+void MediaListView::appendMediaFiles(const std::vector<std::string> &mediaFilesNames)
+{
+    if (browsing)
+        return;
+
+    int page = pagination->getCurrentPage();
+    int pageEnd = (page + 1) * itemsPerPage;
+    bool pageWasFull = static_cast<int>(currentFilesName.size()) >= pageEnd;
+
+    currentFilesName.insert(currentFilesName.end(), mediaFilesNames.begin(), mediaFilesNames.end());
+
+    int totalFiles = currentFilesName.size();
+    int totalPages = (totalFiles + itemsPerPage - 1) / itemsPerPage;
+    pagination->setTotalPages(totalPages);
+    pagination->setVisible(totalPages > 1);
+
+    // Only the visible page needs redrawing, and only if it was still filling up
+    if (!pageWasFull)
+        setCurrentPage(page);
+}
+
+void MediaListView::showBrowseList(const std::string &title, size_t rowCount, bool keepPage)
+{
+    browsing = true;
+    browseRowCount = rowCount;
+    currentFilesName.clear();
+    titleLabel->setText(title);
+    backButton->setVisible(true);
+
+    int totalPages = static_cast<int>((rowCount + itemsPerPage - 1) / itemsPerPage);
+    int page = keepPage ? std::min(pagination->getCurrentPage(), std::max(totalPages - 1, 0)) : 0;
+    pagination->setTotalPages(totalPages);
+    pagination->setCurrentPage(page);
+    pagination->setVisible(totalPages > 1);
+
+    setCurrentPage(page);
+}
+
+void MediaListView::leaveBrowseList()
+{
+    browsing = false;
+    browseRowCount = 0;
+    backButton->setVisible(false);
+}
+
 void MediaListView::setCurrentPage(int page)
 {
     int startIdx = page * itemsPerPage;
-    int endIdx = std::min(startIdx + itemsPerPage, static_cast<int>(currentFilesName.size()));
 
     fileListView->clearItems();
-    for (int i = startIdx; i < endIdx; ++i)
+    if (browsing)
     {
-        fileListView->addItem(currentFilesName[i]);
+        if (controller)
+        {
+            for (const auto &row : controller->getBrowseRows(startIdx, itemsPerPage))
+                fileListView->addItem(row);
+        }
     }
+    else
+    {
+        int endIdx = std::min(startIdx + itemsPerPage, static_cast<int>(currentFilesName.size()));
+        for (int i = startIdx; i < endIdx; ++i)
+        {
+            fileListView->addItem(currentFilesName[i]);
+        }
+    }
+
+    // Tags are only read for the rows on screen
+    if (controller)
+        controller->setViewport(startIdx, itemsPerPage);
 }
 
 int MediaListView::getCurrentPage() const
@@ -201,11 +303,12 @@ int MediaListView::getTotalPages() const
 
 void MediaListView::onFileSelected(int index)
 {
-    controller->handleMediaSelected(index);
+    // The list only holds the current page
+    controller->handleMediaSelected(pagination->getCurrentPage() * itemsPerPage + index);
 }
 void MediaListView::onFile2ClickSelected(int index)
 {
-    controller->handleMediaPlay(index);
+    controller->handleMediaPlay(pagination->getCurrentPage() * itemsPerPage + index);
 }
 
 void MediaListView::showFileContextMenu(int x, int y, int fileIndex)
@@ -12,12 +12,22 @@ private:
     Pagination *pagination;
     TextComponent *titleLabel;
     Button *openFolderButton;
+    Button *browseButton;
+    Button *backButton;
+    TextField *queryField;
+    TextField *searchField;
     ListView *contextMenu;
 
     std::vector<std::string> currentFilesName;
     int itemsPerPage;
     MediaListController *controller;
 
+    // Browse lists are not kept here, each page is read from the controller
+    bool browsing;
+    size_t browseRowCount;
+
+    void leaveBrowseList();
+
 public:
     MediaListView(MediaListController *controller);
     ~MediaListView();
@@ -30,6 +40,9 @@ public:
     void scanDirectoryForMedia();
 
     void setCurrentPlaylist(const std::string &playlistName, const std::vector<std::string> &mediaFilesNames);
+    void refreshMediaFiles(const std::vector<std::string> &mediaFilesNames);
+    void appendMediaFiles(const std::vector<std::string> &mediaFilesNames);
+    void showBrowseList(const std::string &title, size_t rowCount, bool keepPage);
     void setCurrentPage(int page);
     int getCurrentPage() const;
     int getTotalPages() const;
@@ -1,5 +1,8 @@
 #include "metadata.h"
 
+// Rows are packed so that every field, Codec included, fits above the edit buttons
+static const int rowStep = 30;
+static const int rowHeight = 27;
 
 // MetadataView Implementation
 MetadataView::MetadataView(MetadataController *controller)
@@ -21,14 +24,23 @@ MetadataView::MetadataView(MetadataController *controller)
 
     removeFieldButton = new Button(765, 450, 95, 30, "Remove key");
 
+    // Outcome of the last save, written in the background
+    statusLabel = new TextComponent(770, 46, 200, 12, "");
+
+    // Filled in when the cover loader delivers
+    coverImage = new ImageComponent(846, 60, 48, 48);
+
     addComponent(titleLabel);
     addComponent(editButton);
     addComponent(saveButton);
     addComponent(cancelButton);
     addComponent(addFieldButton);
     addComponent(removeFieldButton);
+    addComponent(statusLabel);
+    addComponent(coverImage);
 
     titleLabel->setAlign(TextComponent::TextAlign::Center);
+    statusLabel->setAlign(TextComponent::TextAlign::Center);
 
     saveButton->setVisible(false);
     cancelButton->setVisible(false);
@@ -83,7 +95,17 @@ bool MetadataView::handleEvent(SDL_Event *event)
 
 void MetadataView::update()
 {
-    // Nothing specific to update regularly
+    // Tags read in the background are applied on the UI thread
+    if (controller)
+        controller->pollMetadata();
+}
+
+// Empty for a file whose tags are not loaded yet
+static const std::string &fieldValue(const std::map<std::string, std::string> &metadata, const std::string &key)
+{
+    static const std::string empty;
+    auto it = metadata.find(key);
+    return it != metadata.end() ? it->second : empty;
 }
 
 void MetadataView::showMetadata(const std::map<std::string, std::string> &metadata)
@@ -103,120 +125,133 @@ void MetadataView::showMetadata(const std::map<std::string, std::string> &metada
     keyLabels.clear();
     valueFields.clear();
 
-    // Add metadata key-value pairs
-    int yPos = 60;
+    // Add metadata key-value pairs, below the cover
+    int yPos = 112;
 
     // Title
     {
-        TextComponent *keyLabel = new TextComponent(765, yPos, 60, 30, "Title");
+        TextComponent *keyLabel = new TextComponent(765, yPos, 60, rowHeight, "Title");
         addComponent(keyLabel);
         keyLabels.push_back(keyLabel);
 
-        TextField *valueField = new TextField(850, yPos, 125, 30, metadata.at("Title"));
+        TextField *valueField = new TextField(850, yPos, 125, rowHeight, fieldValue(metadata, "Title"));
         valueField->setEnabled(false);
         addComponent(valueField);
         valueFields.push_back(valueField);
-        yPos += 35;
+        yPos += rowStep;
     }
     {
-        TextComponent *keyLabel = new TextComponent(765, yPos, 60, 30, "Artist");
+        TextComponent *keyLabel = new TextComponent(765, yPos, 60, rowHeight, "Artist");
         addComponent(keyLabel);
         keyLabels.push_back(keyLabel);
 
-        TextField *valueField = new TextField(850, yPos, 125, 30, metadata.at("Artist"));
+        TextField *valueField = new TextField(850, yPos, 125, rowHeight, fieldValue(metadata, "Artist"));
         valueField->setEnabled(false);
         addComponent(valueField);
         valueFields.push_back(valueField);
-        yPos += 35;
+        yPos += rowStep;
     }
     {
-        TextComponent *keyLabel = new TextComponent(765, yPos, 60, 30, "Album");
+        TextComponent *keyLabel = new TextComponent(765, yPos, 60, rowHeight, "Album");
         addComponent(keyLabel);
         keyLabels.push_back(keyLabel);
 
-        TextField *valueField = new TextField(850, yPos, 125, 30, metadata.at("Album"));
+        TextField *valueField = new TextField(850, yPos, 125, rowHeight, fieldValue(metadata, "Album"));
         valueField->setEnabled(false);
         addComponent(valueField);
         valueFields.push_back(valueField);
-        yPos += 35;
+        yPos += rowStep;
     }
     {
-        TextComponent *keyLabel = new TextComponent(765, yPos, 60, 30, "Comment");
+        TextComponent *keyLabel = new TextComponent(765, yPos, 60, rowHeight, "Comment");
         addComponent(keyLabel);
         keyLabels.push_back(keyLabel);
 
-        TextField *valueField = new TextField(850, yPos, 125, 30, metadata.at("Comment"));
+        TextField *valueField = new TextField(850, yPos, 125, rowHeight, fieldValue(metadata, "Comment"));
         valueField->setEnabled(false);
         addComponent(valueField);
         valueFields.push_back(valueField);
-        yPos += 35;
+        yPos += rowStep;
     }
     {
-        TextComponent *keyLabel = new TextComponent(765, yPos, 60, 30, "Genre");
+        TextComponent *keyLabel = new TextComponent(765, yPos, 60, rowHeight, "Genre");
         addComponent(keyLabel);
         keyLabels.push_back(keyLabel);
 
-        TextField *valueField = new TextField(850, yPos, 125, 30, metadata.at("Genre"));
+        TextField *valueField = new TextField(850, yPos, 125, rowHeight, fieldValue(metadata, "Genre"));
         valueField->setEnabled(false);
         addComponent(valueField);
         valueFields.push_back(valueField);
-        yPos += 35;
+        yPos += rowStep;
     }
     {
-        TextComponent *keyLabel = new TextComponent(765, yPos, 60, 30, "Year");
+        TextComponent *keyLabel = new TextComponent(765, yPos, 60, rowHeight, "Year");
         addComponent(keyLabel);
         keyLabels.push_back(keyLabel);
 
-        TextField *valueField = new TextField(850, yPos, 125, 30, metadata.at("Year"));
+        TextField *valueField = new TextField(850, yPos, 125, rowHeight, fieldValue(metadata, "Year"));
         valueField->setEnabled(false);
         addComponent(valueField);
         valueFields.push_back(valueField);
-        yPos += 35;
+        yPos += rowStep;
     }
     {
-        TextComponent *keyLabel = new TextComponent(765, yPos, 60, 30, "Track");
+        TextComponent *keyLabel = new TextComponent(765, yPos, 60, rowHeight, "Track");
         addComponent(keyLabel);
         keyLabels.push_back(keyLabel);
 
-        TextField *valueField = new TextField(850, yPos, 125, 30, metadata.at("Track"));
+        TextField *valueField = new TextField(850, yPos, 125, rowHeight, fieldValue(metadata, "Track"));
         valueField->setEnabled(false);
         addComponent(valueField);
         valueFields.push_back(valueField);
-        yPos += 35;
+        yPos += rowStep;
     }
     {
-        TextComponent *keyLabel = new TextComponent(765, yPos, 60, 30, "Bitrate");
+        TextComponent *keyLabel = new TextComponent(765, yPos, 60, rowHeight, "Bitrate");
         addComponent(keyLabel);
         keyLabels.push_back(keyLabel);
 
-        TextField *valueField = new TextField(850, yPos, 125, 30, metadata.at("Bitrate"));
+        TextField *valueField = new TextField(850, yPos, 125, rowHeight, fieldValue(metadata, "Bitrate"));
         valueField->setEnabled(false);
         addComponent(valueField);
         valueFields.push_back(valueField);
-        yPos += 35;
+        yPos += rowStep;
     }
     {
-        TextComponent *keyLabel = new TextComponent(765, yPos, 60, 30, "Channels");
+        TextComponent *keyLabel = new TextComponent(765, yPos, 60, rowHeight, "Channels");
         addComponent(keyLabel);
         keyLabels.push_back(keyLabel);
 
-        TextField *valueField = new TextField(850, yPos, 125, 30, metadata.at("Channels"));
+        TextField *valueField = new TextField(850, yPos, 125, rowHeight, fieldValue(metadata, "Channels"));
         valueField->setEnabled(false);
         addComponent(valueField);
         valueFields.push_back(valueField);
-        yPos += 35;
+        yPos += rowStep;
     }
     {
-        TextComponent *keyLabel = new TextComponent(765, yPos-5, 60, 30, "Sample Rate");
+        TextComponent *keyLabel = new TextComponent(765, yPos-5, 60, rowHeight, "Sample Rate");
         keyLabel->setLines(2);
         addComponent(keyLabel);
         keyLabels.push_back(keyLabel);
 
-        TextField *valueField = new TextField(850, yPos, 125, 30, metadata.at("Sample Rate"));
+        TextField *valueField = new TextField(850, yPos, 125, rowHeight, fieldValue(metadata, "Sample Rate"));
+        valueField->setEnabled(false);
+        addComponent(valueField);
+        valueFields.push_back(valueField);
+        yPos += rowStep;
+    }
+    // Video files only
+    if (metadata.count("Codec"))
+    {
+        TextComponent *keyLabel = new TextComponent(765, yPos, 60, rowHeight, "Codec");
+        addComponent(keyLabel);
+        keyLabels.push_back(keyLabel);
+
+        TextField *valueField = new TextField(850, yPos, 125, rowHeight, fieldValue(metadata, "Codec"));
         valueField->setEnabled(false);
         addComponent(valueField);
         valueFields.push_back(valueField);
-        yPos += 35;
+        yPos += rowStep;
     }
     // Reset edit mode
     isEditing = false;
@@ -227,6 +262,32 @@ void MetadataView::showMetadata(const std::map<std::string, std::string> &metada
     editButton->setVisible(true);
 }
 
+void MetadataView::showSavePending(const std::string &filename)
+{
+    statusLabel->setText("Saving " + filename + "...");
+}
+
+void MetadataView::showSaveResult(const std::string &filename, bool success)
+{
+    statusLabel->setText(success ? "Saved " + filename : "Failed to save " + filename);
+}
+
+void MetadataView::showBatchProgress(size_t done, size_t total)
+{
+    statusLabel->setText("Saving " + std::to_string(done) + "/" + std::to_string(total) + " files...");
+}
+
+void MetadataView::showBatchResult(size_t fileCount, bool success)
+{
+    std::string files = std::to_string(fileCount) + " files";
+    statusLabel->setText(success ? "Saved " + files : "Failed to save " + files + ", changes undone");
+}
+
+void MetadataView::showCoverArt(std::shared_ptr<const Thumbnail> thumbnail)
+{
+    coverImage->setImage(std::move(thumbnail));
+}
+
 void MetadataView::enterEditMode()
 {
     isEditing = true;
@@ -14,6 +14,8 @@ private:
     Button *saveButton;
     Button *cancelButton;
     Button *editButton;
+    TextComponent *statusLabel;
+    ImageComponent *coverImage;
     MediaFileModel *currentFile;
     bool isEditing;
 
@@ -30,6 +32,11 @@ public:
     void update() override;
 
     void showMetadata(const std::map<std::string, std::string> &metadata);
+    void showSavePending(const std::string &filename);
+    void showSaveResult(const std::string &filename, bool success);
+    void showBatchProgress(size_t done, size_t total);
+    void showBatchResult(size_t fileCount, bool success);
+    void showCoverArt(std::shared_ptr<const Thumbnail> thumbnail);
     void enterEditMode();
     void saveChanges();
     void cancelChanges();
@@ -231,10 +231,16 @@ void ViewManager::handleEvents()
 
 void ViewManager::update()
 {
+    // PlayerView is refreshed by the playback monitor thread
+    mediaListView->update();
+    playlistsListView->update();
+    metadataView->update();
 }
 
 void ViewManager::render()
 {
+    // Texture uploads are spread over frames
+    TextureUploadBudget::beginFrame();
 
     // Clear screen
     SDL_SetRenderDrawColor(renderer, BACKGROUND_COLOR.r, BACKGROUND_COLOR.g, BACKGROUND_COLOR.b, BACKGROUND_COLOR.a); // Light gray background
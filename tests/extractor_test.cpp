@@ -0,0 +1,108 @@
+// Extractor test: a video read through MetadataExtractor, as the player reads it,
+// gets its duration and codecs from the container probe.
+//
+//   extractor_test
+//
+// The MP4 is written to a temporary directory and removed afterwards. Returns 0
+// when every check passes.
+
+#include "Model/metadata_extractor.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <fstream>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+static void putBE32(std::string &out, uint32_t value)
+{
+    for (int shift = 24; shift >= 0; shift -= 8)
+        out.push_back(static_cast<char>((value >> shift) & 0xFF));
+}
+
+static std::string box(const char *type, const std::string &payload)
+{
+    std::string out;
+    putBE32(out, static_cast<uint32_t>(payload.size() + 8));
+    out.append(type, 4);
+    return out + payload;
+}
+
+// ftyp, then moov with a 7 s mvhd and one H.264 video track
+static std::string minimalMp4()
+{
+    std::string mvhd(100, '\0');
+    std::string times;
+    putBE32(times, 1000); // timescale
+    putBE32(times, 7000); // duration
+    mvhd.replace(12, 8, times);
+
+    std::string hdlr(24, '\0');
+    hdlr.replace(8, 4, "vide");
+
+    std::string stsd(8, '\0');
+    stsd[7] = 1; // entry count
+    std::string entry;
+    putBE32(entry, 86);
+    entry += "avc1";
+    entry.resize(86, '\0');
+    stsd += entry;
+
+    std::string trak = box("trak", box("mdia", box("hdlr", hdlr) + box("minf", box("stbl", box("stsd", stsd)))));
+    return box("ftyp", std::string("isom\0\0\0\0isom", 12)) + box("moov", box("mvhd", mvhd) + trak);
+}
+
+static int failures = 0;
+
+static void check(bool condition, const char *what)
+{
+    if (!condition)
+    {
+        std::fprintf(stderr, "FAILED: %s\n", what);
+        ++failures;
+    }
+}
+
+int main()
+{
+    fs::path dir = fs::temp_directory_path() / "extractor_test";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    fs::path path = dir / "clip.mp4";
+    {
+        std::ofstream out(path, std::ios::binary);
+        out << minimalMp4();
+    }
+
+    // Typed the way the library scan types it
+    auto file = std::make_shared<VideoFileModel>(path.u8string());
+    MetadataExtractor extractor(1);
+    extractor.enqueue(file, MetadataExtractor::Priority::HIGH);
+
+    std::vector<MetadataExtractor::Result> results;
+    for (int i = 0; i < 500 && results.empty(); ++i)
+    {
+        results = extractor.takeResults();
+        if (results.empty())
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    check(results.size() == 1, "one result");
+    if (!results.empty())
+    {
+        check(results.front().success, "extraction succeeds");
+        MetadataExtractor::applyResult(results.front());
+        check(file->getDuration() == 7, "duration from mvhd");
+        check(file->getMetadata(MetadataField::CODEC) == "H.264", "codec from stsd");
+    }
+
+    fs::remove_all(dir);
+    if (failures)
+        return 1;
+    std::printf("extractor_test passed\n");
+    return 0;
+}